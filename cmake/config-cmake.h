@@ -51,6 +51,15 @@
 /* Define to 1 if you have the 'memalign' function. */
 #cmakedefine HAVE_MEMALIGN 1
 
+/* Define to 1 if you have the 'pread' and 'pwrite' functions. */
+#cmakedefine HAVE_PREAD 1
+
+/* Define to 1 if you have the 'mmap' function. */
+#cmakedefine HAVE_MMAP 1
+
+/* Define to 1 if you have the 'fsync' function. */
+#cmakedefine HAVE_FSYNC 1
+
 /* Define to 1 if you have the 'gettimeofday' function. */
 #cmakedefine HAVE_GETTIMEOFDAY 1
 
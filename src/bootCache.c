@@ -0,0 +1,493 @@
+/*
+  Previous - bootCache.c
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+
+  Boot state cache
+
+  Booting runs the ROM self tests and the kernel before the machine can
+  be used. With the boot cache enabled, the emulator starts from a memory
+  snapshot of an earlier boot instead. The snapshots are kept in a
+  directory and named after a hash of everything the boot depends on:
+  machine, CPU, memory, boot options and the ROM and disk images with
+  their size and modification time. The name is determined at startup,
+  before anything is written to the disks. If there is no snapshot for the
+  configuration yet, the machine boots and the snapshot is saved after a
+  number of VBLs, or when the "bootcache" shortcut is invoked (e.g. by the
+  remote control once the guest has signalled that it is up).
+
+  The disks have to match the snapshot, so the images must not change:
+  hard disks need an overlay and magneto-optical disks have to be write
+  protected, otherwise the cache is not used. The overlays are saved with
+  the snapshot and put back in place when it is restored, so every start
+  from the cache begins with the disks as they were at the snapshot.
+  Only the most recently saved snapshots are kept.
+*/
+const char BootCache_fileid[] = "Previous bootCache.c : " __DATE__ " " __TIME__;
+
+#include <sys/stat.h>
+
+#include "main.h"
+#include "configuration.h"
+#include "bootCache.h"
+#include "file.h"
+#include "log.h"
+#include "memorySnapShot.h"
+#include "reset.h"
+#include "scandir.h"
+#include "scsi.h"
+
+#if defined(WIN32) && !defined(mkdir)
+#define mkdir(name,mode) mkdir(name)
+#endif
+
+
+#define FNV_OFFSET  0xcbf29ce484222325ULL   /* 64 bit FNV-1a */
+#define FNV_PRIME   0x100000001b3ULL
+
+#define BOOTCACHE_MAX_ENTRIES   8
+
+static bool bSavePending;
+static int nBootVBLs;
+static char szCacheName[32];    /* snapshot for the configuration at startup */
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Add data to the hash.
+ */
+static void BootCache_Hash(Uint64 *pHash, const void *pData, size_t nSize)
+{
+	const Uint8 *p = pData;
+
+	while (nSize--)
+	{
+		*pHash ^= *p++;
+		*pHash *= FNV_PRIME;
+	}
+}
+
+static void BootCache_HashValue(Uint64 *pHash, int nValue)
+{
+	BootCache_Hash(pHash, &nValue, sizeof(nValue));
+}
+
+/**
+ * Add a file to the hash, it is identified by name, size and
+ * modification time.
+ */
+static void BootCache_HashFile(Uint64 *pHash, const char *pszFileName)
+{
+	struct stat st;
+	Uint64 n;
+
+	BootCache_Hash(pHash, pszFileName, strlen(pszFileName) + 1);
+	if (pszFileName[0] && stat(pszFileName, &st) == 0)
+	{
+		n = st.st_size;
+		BootCache_Hash(pHash, &n, sizeof(n));
+		n = st.st_mtime;
+		BootCache_Hash(pHash, &n, sizeof(n));
+	}
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Hash the parts of the configuration the boot state depends on.
+ */
+static Uint64 BootCache_HashConfig(void)
+{
+	CNF_SYSTEM *pSystem = &ConfigureParams.System;
+	CNF_BOOT *pBoot = &ConfigureParams.Boot;
+	Uint64 nHash = FNV_OFFSET;
+	int i;
+
+	/* Snapshots are only compatible with the same version */
+	BootCache_Hash(&nHash, PROG_NAME, sizeof(PROG_NAME));
+
+	/* Machine */
+	BootCache_HashValue(&nHash, pSystem->nMachineType);
+	BootCache_HashValue(&nHash, pSystem->bColor);
+	BootCache_HashValue(&nHash, pSystem->bTurbo);
+	BootCache_HashValue(&nHash, pSystem->bADB);
+	BootCache_HashValue(&nHash, pSystem->nSCSI);
+	BootCache_HashValue(&nHash, pSystem->nRTC);
+	BootCache_HashValue(&nHash, pSystem->nCpuLevel);
+	BootCache_HashValue(&nHash, pSystem->nCpuFreq);
+	BootCache_HashValue(&nHash, pSystem->bCompatibleCpu);
+	BootCache_HashValue(&nHash, pSystem->bCycleExactCpu);
+	BootCache_HashValue(&nHash, pSystem->bAddressSpace24);
+	BootCache_HashValue(&nHash, pSystem->n_FPUType);
+	BootCache_HashValue(&nHash, pSystem->bCompatibleFPU);
+	BootCache_HashValue(&nHash, pSystem->bMMU);
+	BootCache_HashValue(&nHash, pSystem->nDSPType);
+	BootCache_HashValue(&nHash, pSystem->bRealTimeClock);
+	BootCache_HashValue(&nHash, pSystem->nSCSITiming);
+	BootCache_HashValue(&nHash, pSystem->nMOTiming);
+	BootCache_HashValue(&nHash, pSystem->nEnetTiming);
+	BootCache_HashValue(&nHash, ConfigureParams.Screen.nMonitorType);
+
+	/* Memory */
+	for (i = 0; i < 4; i++)
+		BootCache_HashValue(&nHash, ConfigureParams.Memory.nMemoryBankSize[i]);
+	BootCache_HashValue(&nHash, ConfigureParams.Memory.nMemorySpeed);
+
+	/* Boot options */
+	BootCache_HashValue(&nHash, pBoot->nBootDevice);
+	BootCache_HashValue(&nHash, pBoot->bEnableDRAMTest);
+	BootCache_HashValue(&nHash, pBoot->bEnablePot);
+	BootCache_HashValue(&nHash, pBoot->bExtendedPot);
+	BootCache_HashValue(&nHash, pBoot->bEnableSoundTest);
+	BootCache_HashValue(&nHash, pBoot->bEnableSCSITest);
+	BootCache_HashValue(&nHash, pBoot->bLoopPot);
+	BootCache_HashValue(&nHash, pBoot->bVerbose);
+
+	/* ROM */
+	BootCache_HashFile(&nHash, ConfigureParams.Rom.szRom030FileName);
+	BootCache_HashFile(&nHash, ConfigureParams.Rom.szRom040FileName);
+	BootCache_HashFile(&nHash, ConfigureParams.Rom.szRomTurboFileName);
+
+	/* SCSI disks */
+	for (i = 0; i < ESP_MAX_DEVS; i++)
+	{
+		BootCache_HashValue(&nHash, ConfigureParams.SCSI.target[i].bAttached);
+		if (!ConfigureParams.SCSI.target[i].bAttached)
+			continue;
+		BootCache_HashValue(&nHash, ConfigureParams.SCSI.target[i].bCDROM);
+		BootCache_HashFile(&nHash, ConfigureParams.SCSI.target[i].szImageName);
+		/* The contents of the overlay are saved with the snapshot */
+		BootCache_Hash(&nHash, ConfigureParams.SCSI.target[i].szOverlayName,
+		               strlen(ConfigureParams.SCSI.target[i].szOverlayName) + 1);
+	}
+
+	/* MO drives */
+	for (i = 0; i < MO_MAX_DRIVES; i++)
+	{
+		BootCache_HashValue(&nHash, ConfigureParams.MO.drive[i].bDriveConnected);
+		BootCache_HashValue(&nHash, ConfigureParams.MO.drive[i].bDiskInserted);
+		if (!ConfigureParams.MO.drive[i].bDriveConnected ||
+		    !ConfigureParams.MO.drive[i].bDiskInserted)
+			continue;
+		BootCache_HashValue(&nHash, ConfigureParams.MO.drive[i].bWriteProtected);
+		BootCache_HashFile(&nHash, ConfigureParams.MO.drive[i].szImageName);
+	}
+
+	return nHash;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Check that none of the disk images can be written, which would make
+ * them differ from the state in the snapshot.
+ */
+static bool BootCache_DisksFrozen(void)
+{
+	int i;
+
+	for (i = 0; i < ESP_MAX_DEVS; i++)
+	{
+		if (ConfigureParams.SCSI.target[i].bAttached &&
+		    !ConfigureParams.SCSI.target[i].bCDROM &&
+		    !ConfigureParams.SCSI.target[i].szOverlayName[0])
+		{
+			Log_Printf(LOG_WARN, "Boot cache: SCSI disk %i has no overlay, not using the cache.\n", i);
+			return false;
+		}
+	}
+	for (i = 0; i < MO_MAX_DRIVES; i++)
+	{
+		if (ConfigureParams.MO.drive[i].bDriveConnected &&
+		    ConfigureParams.MO.drive[i].bDiskInserted &&
+		    !ConfigureParams.MO.drive[i].bWriteProtected)
+		{
+			Log_Printf(LOG_WARN, "Boot cache: MO disk %i is not write protected, not using the cache.\n", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Get the name of a file of the cache entry, with an optional extension.
+ * Returns a newly allocated string or NULL.
+ */
+static char *BootCache_FileName(const char *pszExt)
+{
+	return File_MakePath(ConfigureParams.Memory.szBootCacheDir, szCacheName, pszExt);
+}
+
+static char *BootCache_OverlayName(const char *pszName, int nTarget)
+{
+	char szExt[8];
+
+	snprintf(szExt, sizeof(szExt), "ov%i", nTarget);
+	return File_MakePath(ConfigureParams.Memory.szBootCacheDir, pszName, szExt);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Copy a file. The copy is written to a temporary file first and renamed
+ * when complete.
+ */
+static bool BootCache_CopyFile(const char *pszSrc, const char *pszDest)
+{
+	Uint8 buf[0x10000];
+	char *pszTempName;
+	FILE *in, *out;
+	size_t n;
+	bool ok;
+
+	pszTempName = malloc(strlen(pszDest) + 5);
+	if (!pszTempName)
+		return false;
+	sprintf(pszTempName, "%s.tmp", pszDest);
+
+	in = File_Open(pszSrc, "rb");
+	out = File_Open(pszTempName, "wb");
+	ok = in && out;
+	while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+		ok = fwrite(buf, 1, n, out) == n;
+	ok = ok && !ferror(in) && fflush(out) == 0;
+	File_Close(in);
+	File_Close(out);
+
+	if (ok)
+	{
+		remove(pszDest);
+		ok = rename(pszTempName, pszDest) == 0;
+	}
+	if (!ok)
+		remove(pszTempName);
+	free(pszTempName);
+	return ok;
+}
+
+/**
+ * Copy the overlays of the SCSI disks to or from the cache entry.
+ */
+static bool BootCache_CopyOverlays(bool bSave)
+{
+	char *pszCopy;
+	const char *pszOverlay;
+	bool ok = true;
+	int i;
+
+	for (i = 0; i < ESP_MAX_DEVS && ok; i++)
+	{
+		pszOverlay = ConfigureParams.SCSI.target[i].szOverlayName;
+		if (!ConfigureParams.SCSI.target[i].bAttached ||
+		    ConfigureParams.SCSI.target[i].bCDROM || !pszOverlay[0])
+			continue;
+		pszCopy = BootCache_OverlayName(szCacheName, i);
+		if (!pszCopy)
+			return false;
+		if (bSave)
+			ok = BootCache_CopyFile(pszOverlay, pszCopy);
+		else
+			ok = File_Exists(pszCopy) && BootCache_CopyFile(pszCopy, pszOverlay);
+		free(pszCopy);
+	}
+	return ok;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Remove the oldest entries of the cache, so that at most
+ * BOOTCACHE_MAX_ENTRIES are left.
+ */
+typedef struct {
+	char *pszName;
+	time_t mtime;
+} BOOTCACHE_ENTRY;
+
+static int BootCache_CompareAge(const void *a, const void *b)
+{
+	const BOOTCACHE_ENTRY *e1 = a, *e2 = b;
+
+	return (e1->mtime < e2->mtime) ? 1 : (e1->mtime > e2->mtime) ? -1 : 0;
+}
+
+static void BootCache_Prune(void)
+{
+	struct dirent **files;
+	BOOTCACHE_ENTRY *entries;
+	struct stat st;
+	char *pszPath;
+	size_t len;
+	int nFiles, nEntries = 0, i, j;
+
+	nFiles = scandir(ConfigureParams.Memory.szBootCacheDir, &files, 0, alphasort);
+	if (nFiles < 0)
+		return;
+
+	entries = malloc((nFiles + 1) * sizeof(*entries));
+	for (i = 0; i < nFiles; i++)
+	{
+		len = strlen(files[i]->d_name);
+		if (entries && strncmp(files[i]->d_name, "boot-", 5) == 0 &&
+		    len > 4 && strcmp(files[i]->d_name + len - 4, ".sav") == 0)
+		{
+			pszPath = File_MakePath(ConfigureParams.Memory.szBootCacheDir, files[i]->d_name, NULL);
+			if (pszPath && stat(pszPath, &st) == 0)
+			{
+				entries[nEntries].pszName = strdup(files[i]->d_name);
+				entries[nEntries].mtime = st.st_mtime;
+				if (entries[nEntries].pszName)
+					nEntries++;
+			}
+			free(pszPath);
+		}
+		free(files[i]);
+	}
+	free(files);
+	if (!entries)
+		return;
+
+	qsort(entries, nEntries, sizeof(*entries), BootCache_CompareAge);
+	for (i = 0; i < nEntries; i++)
+	{
+		if (i >= BOOTCACHE_MAX_ENTRIES)
+		{
+			Log_Printf(LOG_INFO, "Removing old boot state '%s'.\n", entries[i].pszName);
+			pszPath = File_MakePath(ConfigureParams.Memory.szBootCacheDir, entries[i].pszName, NULL);
+			if (pszPath)
+				remove(pszPath);
+			free(pszPath);
+			for (j = 0; j < ESP_MAX_DEVS; j++)
+			{
+				pszPath = BootCache_OverlayName(entries[i].pszName, j);
+				if (pszPath)
+					remove(pszPath);
+				free(pszPath);
+			}
+		}
+		free(entries[i].pszName);
+	}
+	free(entries);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Restore the boot state of the current configuration from the cache, or
+ * boot and save it later if there is none yet. The name of the snapshot
+ * is determined now, before booting writes to the disks.
+ */
+void BootCache_Start(void)
+{
+	char *pszFileName;
+
+	bSavePending = false;
+	if (!ConfigureParams.Memory.bBootCache || !BootCache_DisksFrozen())
+		return;
+
+	snprintf(szCacheName, sizeof(szCacheName), "boot-%016llx.sav",
+	         (unsigned long long)BootCache_HashConfig());
+
+	pszFileName = BootCache_FileName(NULL);
+	if (pszFileName && File_Exists(pszFileName))
+	{
+		Log_Printf(LOG_INFO, "Restoring boot state from '%s'.\n", pszFileName);
+
+		/* Put the disks back into the state of the snapshot, the reset
+		 * while restoring opens them again */
+		SCSI_Uninit();
+		if (BootCache_CopyOverlays(false))
+		{
+			SCSI_Init();
+			if (MemorySnapShot_Restore(pszFileName, false))
+			{
+				/* Deltas can not be based on it, it may be pruned */
+				MemorySnapShot_ResetChain();
+				free(pszFileName);
+				return;
+			}
+		}
+		else
+		{
+			SCSI_Init();
+		}
+		Log_Printf(LOG_WARN, "Boot state '%s' can not be used, booting.\n", pszFileName);
+		remove(pszFileName);
+		Reset_Cold();
+	}
+	free(pszFileName);
+	nBootVBLs = 0;
+	bSavePending = true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Save the boot state after the configured number of VBLs.
+ */
+void BootCache_VBL(void)
+{
+	if (bSavePending && ConfigureParams.Memory.nBootCacheVBLs > 0 &&
+	    ++nBootVBLs >= ConfigureParams.Memory.nBootCacheVBLs)
+	{
+		BootCache_Save();
+	}
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Save the boot state and the overlays of the disks to the cache. The
+ * snapshot is renamed when complete, so other instances never see
+ * partial ones.
+ */
+void BootCache_Save(void)
+{
+	char *pszFileName, *pszTempName;
+	bool ok;
+
+	if (!bSavePending)
+	{
+		Log_Printf(LOG_WARN, "No boot state to save.\n");
+		return;
+	}
+	bSavePending = false;
+
+	if (!File_DirExists(ConfigureParams.Memory.szBootCacheDir) &&
+	    mkdir(ConfigureParams.Memory.szBootCacheDir, 0755) != 0)
+	{
+		Log_Printf(LOG_WARN, "Can not create boot cache directory '%s'.\n",
+		           ConfigureParams.Memory.szBootCacheDir);
+		return;
+	}
+
+	pszFileName = BootCache_FileName(NULL);
+	pszTempName = BootCache_FileName("tmp");
+	if (pszFileName && pszTempName)
+	{
+		/* Saving the snapshot finishes all disk I/O, so the overlays
+		 * match it when they are copied right after */
+		remove(pszTempName);
+		ok = MemorySnapShot_Capture(pszTempName, false) &&
+		     BootCache_CopyOverlays(true) &&
+		     rename(pszTempName, pszFileName) == 0;
+		/* The snapshot is renamed and may be pruned later, so deltas
+		 * can not be based on it */
+		MemorySnapShot_ResetChain();
+		if (ok)
+		{
+			Log_Printf(LOG_INFO, "Boot state saved to '%s'.\n", pszFileName);
+			BootCache_Prune();
+		}
+		else
+		{
+			remove(pszTempName);
+			Log_Printf(LOG_WARN, "Saving boot state to '%s' failed.\n", pszFileName);
+		}
+	}
+	free(pszTempName);
+	free(pszFileName);
+}
@@ -122,6 +122,8 @@ static const struct Config_Tag configs_ShortCutWithMod[] =
 	{ "keyLoadMem",    Int_Tag, &ConfigureParams.Shortcut.withModifier[SHORTCUT_LOADMEM] },
 	{ "keySaveMem",    Int_Tag, &ConfigureParams.Shortcut.withModifier[SHORTCUT_SAVEMEM] },
 	{ "keyInsertDiskA",Int_Tag, &ConfigureParams.Shortcut.withModifier[SHORTCUT_INSERTDISKA] },
+	{ "keyRewind",     Int_Tag, &ConfigureParams.Shortcut.withModifier[SHORTCUT_REWIND] },
+	{ "keyBootCache",  Int_Tag, &ConfigureParams.Shortcut.withModifier[SHORTCUT_BOOTCACHE] },
 	{ NULL , Error_Tag, NULL }
 };
 
@@ -146,6 +148,8 @@ static const struct Config_Tag configs_ShortCutWithoutMod[] =
 	{ "keyLoadMem",    Int_Tag, &ConfigureParams.Shortcut.withoutModifier[SHORTCUT_LOADMEM] },
 	{ "keySaveMem",    Int_Tag, &ConfigureParams.Shortcut.withoutModifier[SHORTCUT_SAVEMEM] },
 	{ "keyInsertDiskA",Int_Tag, &ConfigureParams.Shortcut.withoutModifier[SHORTCUT_INSERTDISKA] },
+	{ "keyRewind",     Int_Tag, &ConfigureParams.Shortcut.withoutModifier[SHORTCUT_REWIND] },
+	{ "keyBootCache",  Int_Tag, &ConfigureParams.Shortcut.withoutModifier[SHORTCUT_BOOTCACHE] },
 	{ NULL , Error_Tag, NULL }
 };
 
@@ -173,6 +177,14 @@ static const struct Config_Tag configs_Memory[] =
 	{ "bAutoSave", Bool_Tag, &ConfigureParams.Memory.bAutoSave },
 	{ "szMemoryCaptureFileName", String_Tag, ConfigureParams.Memory.szMemoryCaptureFileName },
 	{ "szAutoSaveFileName", String_Tag, ConfigureParams.Memory.szAutoSaveFileName },
+	{ "bCompressSnapShots", Bool_Tag, &ConfigureParams.Memory.bCompressSnapShots },
+	{ "bRewind", Bool_Tag, &ConfigureParams.Memory.bRewind },
+	{ "nRewindInterval", Int_Tag, &ConfigureParams.Memory.nRewindInterval },
+	{ "nRewindCheckpoints", Int_Tag, &ConfigureParams.Memory.nRewindCheckpoints },
+	{ "nRewindMemSize", Int_Tag, &ConfigureParams.Memory.nRewindMemSize },
+	{ "bBootCache", Bool_Tag, &ConfigureParams.Memory.bBootCache },
+	{ "szBootCacheDir", String_Tag, ConfigureParams.Memory.szBootCacheDir },
+	{ "nBootCacheVBLs", Int_Tag, &ConfigureParams.Memory.nBootCacheVBLs },
 	{ NULL , Error_Tag, NULL }
 };
 
@@ -209,35 +221,46 @@ static const struct Config_Tag configs_Boot[] =
 static const struct Config_Tag configs_SCSI[] =
 {
     { "szImageName0", String_Tag, ConfigureParams.SCSI.target[0].szImageName },
+    { "szOverlayName0", String_Tag, ConfigureParams.SCSI.target[0].szOverlayName },
     { "bAttached0", Bool_Tag, &ConfigureParams.SCSI.target[0].bAttached },
     { "bCDROM0", Bool_Tag, &ConfigureParams.SCSI.target[0].bCDROM },
     
     { "szImageName1", String_Tag, ConfigureParams.SCSI.target[1].szImageName },
+    { "szOverlayName1", String_Tag, ConfigureParams.SCSI.target[1].szOverlayName },
     { "bAttached1", Bool_Tag, &ConfigureParams.SCSI.target[1].bAttached },
     { "bCDROM1", Bool_Tag, &ConfigureParams.SCSI.target[1].bCDROM },
 
     { "szImageName2", String_Tag, ConfigureParams.SCSI.target[2].szImageName },
+    { "szOverlayName2", String_Tag, ConfigureParams.SCSI.target[2].szOverlayName },
     { "bAttached2", Bool_Tag, &ConfigureParams.SCSI.target[2].bAttached },
     { "bCDROM2", Bool_Tag, &ConfigureParams.SCSI.target[2].bCDROM },
 
     { "szImageName3", String_Tag, ConfigureParams.SCSI.target[3].szImageName },
+    { "szOverlayName3", String_Tag, ConfigureParams.SCSI.target[3].szOverlayName },
     { "bAttached3", Bool_Tag, &ConfigureParams.SCSI.target[3].bAttached },
     { "bCDROM3", Bool_Tag, &ConfigureParams.SCSI.target[3].bCDROM },
 
     { "szImageName4", String_Tag, ConfigureParams.SCSI.target[4].szImageName },
+    { "szOverlayName4", String_Tag, ConfigureParams.SCSI.target[4].szOverlayName },
     { "bAttached4", Bool_Tag, &ConfigureParams.SCSI.target[4].bAttached },
     { "bCDROM4", Bool_Tag, &ConfigureParams.SCSI.target[4].bCDROM },
 
     { "szImageName5", String_Tag, ConfigureParams.SCSI.target[5].szImageName },
+    { "szOverlayName5", String_Tag, ConfigureParams.SCSI.target[5].szOverlayName },
     { "bAttached5", Bool_Tag, &ConfigureParams.SCSI.target[5].bAttached },
     { "bCDROM5", Bool_Tag, &ConfigureParams.SCSI.target[5].bCDROM },
 
     { "szImageName6", String_Tag, ConfigureParams.SCSI.target[6].szImageName },
+    { "szOverlayName6", String_Tag, ConfigureParams.SCSI.target[6].szOverlayName },
     { "bAttached6", Bool_Tag, &ConfigureParams.SCSI.target[6].bAttached },
     { "bCDROM6", Bool_Tag, &ConfigureParams.SCSI.target[6].bCDROM },
 
 	{ "bBootFromHardDisk", Bool_Tag, &ConfigureParams.SCSI.bBootFromHardDisk },
 	{ "nWriteProtection", Int_Tag, &ConfigureParams.SCSI.nWriteProtection },
+	{ "nBufferSize", Int_Tag, &ConfigureParams.SCSI.nBufferSize },
+	{ "bMapImages", Bool_Tag, &ConfigureParams.SCSI.bMapImages },
+	{ "nCacheSize", Int_Tag, &ConfigureParams.SCSI.nCacheSize },
+	{ "nCachePolicy", Int_Tag, &ConfigureParams.SCSI.nCachePolicy },
 	{ NULL , Error_Tag, NULL }
 };
 
@@ -317,6 +340,12 @@ static const struct Config_Tag configs_System[] =
     { "n_FPUType", Int_Tag, &ConfigureParams.System.n_FPUType },
     { "bCompatibleFPU", Bool_Tag, &ConfigureParams.System.bCompatibleFPU },
     { "bMMU", Bool_Tag, &ConfigureParams.System.bMMU },
+    { "bIdleDetect", Bool_Tag, &ConfigureParams.System.bIdleDetect },
+    { "nIdleLoopPC", Int_Tag, &ConfigureParams.System.nIdleLoopPC },
+    { "nSCSITiming", Int_Tag, &ConfigureParams.System.nSCSITiming },
+    { "nMOTiming", Int_Tag, &ConfigureParams.System.nMOTiming },
+    { "nEnetTiming", Int_Tag, &ConfigureParams.System.nEnetTiming },
+    { "bAsyncDiskIO", Bool_Tag, &ConfigureParams.System.bAsyncDiskIO },
     { NULL , Error_Tag, NULL }
     };
 
@@ -388,9 +417,14 @@ void Configuration_SetDefault(void)
     int target;
     for (target = 0; target < ESP_MAX_DEVS; target++) {
         strcpy(ConfigureParams.SCSI.target[target].szImageName, psWorkingDir);
+        ConfigureParams.SCSI.target[target].szOverlayName[0] = '\0';
         ConfigureParams.SCSI.target[target].bAttached = false;
         ConfigureParams.SCSI.target[target].bCDROM = false;
     }
+    ConfigureParams.SCSI.nBufferSize = 1024;
+    ConfigureParams.SCSI.bMapImages = true;
+    ConfigureParams.SCSI.nCacheSize = 8192;
+    ConfigureParams.SCSI.nCachePolicy = SCSI_CACHE_WRITEBACK;
     
     /* Set defaults for MO drives */
     int drive;
@@ -436,6 +470,7 @@ void Configuration_SetDefault(void)
 	ConfigureParams.Shortcut.withModifier[SHORTCUT_LOADMEM] = SDLK_l;
 	ConfigureParams.Shortcut.withModifier[SHORTCUT_SAVEMEM] = SDLK_k;
 	ConfigureParams.Shortcut.withModifier[SHORTCUT_INSERTDISKA] = SDLK_1;
+	ConfigureParams.Shortcut.withModifier[SHORTCUT_REWIND] = SDLK_b;
 
 	/* Set defaults for Memory */
 	memset(ConfigureParams.Memory.nMemoryBankSize, 16, 
@@ -446,6 +481,15 @@ void Configuration_SetDefault(void)
 	        psHomeDir, PATHSEP);
 	sprintf(ConfigureParams.Memory.szAutoSaveFileName, "%s%cauto.sav",
 	        psHomeDir, PATHSEP);
+	ConfigureParams.Memory.bCompressSnapShots = true;
+	ConfigureParams.Memory.bRewind = false;
+	ConfigureParams.Memory.nRewindInterval = 68;
+	ConfigureParams.Memory.nRewindCheckpoints = 60;
+	ConfigureParams.Memory.nRewindMemSize = 256;
+	ConfigureParams.Memory.bBootCache = false;
+	sprintf(ConfigureParams.Memory.szBootCacheDir, "%s%cbootcache",
+	        psHomeDir, PATHSEP);
+	ConfigureParams.Memory.nBootCacheVBLs = 8160;   /* 2 minutes */
 
 	/* Set defaults for Printer */
 	ConfigureParams.Printer.bEnablePrinting = false;
@@ -520,6 +564,12 @@ void Configuration_SetDefault(void)
     ConfigureParams.System.n_FPUType = FPU_68882;
     ConfigureParams.System.bCompatibleFPU = true;
     ConfigureParams.System.bMMU = true;
+    ConfigureParams.System.bIdleDetect = true;
+    ConfigureParams.System.nIdleLoopPC = 0;
+    ConfigureParams.System.nSCSITiming = IO_TIMING_ACCURATE;
+    ConfigureParams.System.nMOTiming = IO_TIMING_ACCURATE;
+    ConfigureParams.System.nEnetTiming = IO_TIMING_ACCURATE;
+    ConfigureParams.System.bAsyncDiskIO = true;
 
     /* Set defaults for Video */
 #if HAVE_LIBPNG
@@ -614,6 +664,33 @@ void Configuration_Apply(bool bReset)
     /* Check memory size for each bank and change to supported values */
     Configuration_CheckMemory(ConfigureParams.Memory.nMemoryBankSize);
     
+    /* Fall back to accurate timing for unknown I/O timing modes */
+    if ((unsigned)ConfigureParams.System.nSCSITiming > IO_TIMING_INSTANT)
+        ConfigureParams.System.nSCSITiming = IO_TIMING_ACCURATE;
+    if ((unsigned)ConfigureParams.System.nMOTiming > IO_TIMING_INSTANT)
+        ConfigureParams.System.nMOTiming = IO_TIMING_ACCURATE;
+    if ((unsigned)ConfigureParams.System.nEnetTiming > IO_TIMING_INSTANT)
+        ConfigureParams.System.nEnetTiming = IO_TIMING_ACCURATE;
+    
+    /* Do not risk data with an unknown cache policy */
+    if ((unsigned)ConfigureParams.SCSI.nCachePolicy > SCSI_CACHE_UNSAFE)
+        ConfigureParams.SCSI.nCachePolicy = SCSI_CACHE_WRITETHROUGH;
+    if (ConfigureParams.SCSI.nCacheSize < 0)
+        ConfigureParams.SCSI.nCacheSize = 0;
+    
+    /* Rewind needs at least one checkpoint */
+    if (ConfigureParams.Memory.nRewindInterval < 1)
+        ConfigureParams.Memory.nRewindInterval = 1;
+    if (ConfigureParams.Memory.nRewindCheckpoints < 1)
+        ConfigureParams.Memory.nRewindCheckpoints = 1;
+    if (ConfigureParams.Memory.nRewindMemSize < 1)
+        ConfigureParams.Memory.nRewindMemSize = 1;
+    /* The memory used by the checkpoints is counted in 32 bits */
+    if (ConfigureParams.Memory.nRewindMemSize > 4095)
+        ConfigureParams.Memory.nRewindMemSize = 4095;
+    if (ConfigureParams.Memory.nBootCacheVBLs < 0)
+        ConfigureParams.Memory.nBootCacheVBLs = 0;
+    
 	/* Clean file and directory names */    
     File_MakeAbsoluteName(ConfigureParams.Rom.szRom030FileName);
     File_MakeAbsoluteName(ConfigureParams.Rom.szRom040FileName);
@@ -622,9 +699,12 @@ void Configuration_Apply(bool bReset)
     int target;
     for (target = 0; target < ESP_MAX_DEVS; target++) {
         File_MakeAbsoluteName(ConfigureParams.SCSI.target[target].szImageName);
+        if (strlen(ConfigureParams.SCSI.target[target].szOverlayName) > 0)
+            File_MakeAbsoluteName(ConfigureParams.SCSI.target[target].szOverlayName);
     }
     
 	File_MakeAbsoluteName(ConfigureParams.Memory.szMemoryCaptureFileName);
+	File_MakeAbsoluteName(ConfigureParams.Memory.szBootCacheDir);
 	File_MakeAbsoluteName(ConfigureParams.Sound.szYMCaptureFileName);
 	if (strlen(ConfigureParams.Keyboard.szMappingFileName) > 0)
 		File_MakeAbsoluteName(ConfigureParams.Keyboard.szMappingFileName);
@@ -7,6 +7,13 @@
   NeXT mono, memory to SDL_Surface
 */
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static Uint32 monoexpand[256][4];   /* 4 pixels of a mono byte as 32 bit host pixels */
+static bool bColorSSE2;             /* host surface is 0x00RRGGBB */
+
 static inline void putpixelbw(SDL_Surface * surface, Uint16 x, Uint16 y, Uint32 col)
 
 {
@@ -110,39 +117,136 @@ static inline void putpixel(SDL_Surface * surface, Uint16 x, Uint16 y, Uint32 co
 
 }
 
-static char buffer[832*1152*2];
+/* Build the color lookup tables for the current host surface */
+static void ConvertHighRes_SetupTables(void)
+{
+	int x, i;
+
+	for (x=0;x<4;x++)
+		colors[x] = SDL_MapRGB(sdlscrn->format, sdlColors[x].r, sdlColors[x].g, sdlColors[x].b);
+	for (x=0;x<4096;x++)
+		hicolors[x]=SDL_MapRGB(sdlscrn->format,((x&0x0F00)>>4)|((x&0x0F00)>>8),(x&0x00F0)|((x&0x00F0)>>4),((x&0x000F)<<4)|(x&0x000F));
+	for (x=0;x<256;x++)
+		for (i=0;i<4;i++)
+			monoexpand[x][i] = colors[(x>>(6-2*i))&3];
+
+	bColorSSE2 = sdlscrn->format->BitsPerPixel == 32 &&
+	             sdlscrn->format->Rmask == 0x00FF0000 &&
+	             sdlscrn->format->Gmask == 0x0000FF00 &&
+	             sdlscrn->format->Bmask == 0x000000FF;
+}
+
+
+/* Convert one line of mono (2 bit) pixels to a 32 bit host surface */
+static void Convert_MonoLine32(Uint32 *dst, const Uint8 *src, int width)
+{
+	int x;
+
+	for (x = 0; x < width; x += 4)
+	{
+		memcpy(dst, monoexpand[*src++], sizeof(monoexpand[0]));
+		dst += 4;
+	}
+}
+
+
+/* Convert one line of color (16 bit RGBA 4:4:4:4) pixels to a 32 bit host surface */
+static void Convert_ColorLine32(Uint32 *dst, const Uint8 *src, int width)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	if (bColorSSE2)
+	{
+		const __m128i nibble = _mm_set1_epi8(0x0F);
+		const __m128i lowword = _mm_set1_epi32(0xFFFF);
+		__m128i v, lo, hi, p0, p1;
+
+		for (; x + 8 <= width; x += 8)
+		{
+			v = _mm_loadu_si128((const __m128i *)(src + 2*x));
+			lo = _mm_and_si128(v, nibble);
+			hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+			/* one pixel per 32 bit lane: G | R<<8 | A<<16 | B<<24 */
+			p0 = _mm_unpacklo_epi8(lo, hi);
+			p1 = _mm_unpackhi_epi8(lo, hi);
+			/* reorder to B | G<<8 | R<<16 */
+			p0 = _mm_or_si128(_mm_srli_epi32(p0, 24), _mm_slli_epi32(_mm_and_si128(p0, lowword), 8));
+			p1 = _mm_or_si128(_mm_srli_epi32(p1, 24), _mm_slli_epi32(_mm_and_si128(p1, lowword), 8));
+			/* expand 4 bit to 8 bit components (x * 0x11) */
+			p0 = _mm_or_si128(p0, _mm_slli_epi32(p0, 4));
+			p1 = _mm_or_si128(p1, _mm_slli_epi32(p1, 4));
+			_mm_storeu_si128((__m128i *)(dst + x), p0);
+			_mm_storeu_si128((__m128i *)(dst + x + 4), p1);
+		}
+	}
+#endif
+	for (; x < width; x++)
+		dst[x] = hicolors[((src[2*x]<<8) | src[2*x+1]) >> 4];
+}
+
+
+/* Convert the scanlines that have been written since the last update for
+ * 32 bit host surfaces */
+static void ConvertHighRes_640x32Bit(void)
+{
+	void (*pLineFunction)(Uint32 *dst, const Uint8 *src, int width);
+	const Uint8 *src;
+	Uint8 *dst;
+	int y, width, height, linebytes;
+
+	if (ConfigureParams.System.bColor) {
+		pLineFunction = Convert_ColorLine32;
+		src = NEXTColorVideo;
+		width = ConfigureParams.System.bTurbo ? 832 : 1120;
+		height = ConfigureParams.System.bTurbo ? 624 : 832;
+		linebytes = ConfigureParams.System.bTurbo ? 208*8 : 288*8;
+	} else {
+		pLineFunction = Convert_MonoLine32;
+		src = NEXTVideo;
+		width = ConfigureParams.System.bTurbo ? 832 : 1120;
+		height = ConfigureParams.System.bTurbo ? 624 : 832;
+		linebytes = ConfigureParams.System.bTurbo ? 280 : 288;
+	}
+	if (width > sdlscrn->w)
+		width = sdlscrn->w;
+	if (height > NEXTScreenRect.h)
+		height = NEXTScreenRect.h;
+
+	dst = (Uint8 *)sdlscrn->pixels;
+	for (y = 0; y < height; y++)
+	{
+		if (!Screen_LineDirty(y))
+			continue;
+		pLineFunction((Uint32 *)(dst + y * sdlscrn->pitch), src + y * linebytes, width);
+		Screen_AddDirtyLine(y);
+	}
+}
+
 
+/* Convert the scanlines that have been written since the last update and
+ * add them to the rectangles that are passed to SDL */
 static void ConvertHighRes_640x8Bit(void)
 {
 	int y, x;
 	int	col;
-	static int first=1;
 	int adr;	
 
-	if (first) {
-		first=0;
-		for (x=0;x<4;x++)
-			colors[x] = SDL_MapRGB(sdlscrn->format, sdlColors[x].r, sdlColors[x].g, sdlColors[x].b);
-		for (x=0;x<4096;x++)
-			hicolors[x]=SDL_MapRGB(sdlscrn->format,((x&0x0F00)>>4)|((x&0x0F00)>>8),(x&0x00F0)|((x&0x00F0)>>4),((x&0x000F)<<4)|(x&0x000F));
-	}
-
 	/* non turbo color */
 	if ((ConfigureParams.System.bColor) && (!(ConfigureParams.System.bTurbo)) ){
 		for (y = 0; y < 832; y++)
 		{
+			if (!Screen_LineDirty(y))
+				continue;
 			adr=y*288*8;
 
 			for (x = 0; x < 1120; x++)
 			{
-			   if ((buffer[adr]!=NEXTColorVideo[adr]) || (buffer[1+adr]!=NEXTColorVideo[1+adr])) {
 				col=(  (NEXTColorVideo[adr]<<8) |  (NEXTColorVideo[1+adr])  )>>4;
 				putpixel(sdlscrn,x,y,hicolors[col]);
-				buffer[adr]=NEXTColorVideo[adr];
-				buffer[adr+1]=NEXTColorVideo[adr+1];
-				}
-			adr+=2;
+				adr+=2;
 			}
+			Screen_AddDirtyLine(y);
 		}
 		return;
 	}
@@ -151,18 +255,17 @@ static void ConvertHighRes_640x8Bit(void)
 	if ((ConfigureParams.System.bColor) && ((ConfigureParams.System.bTurbo)) ){
 		for (y = 0; y < 624; y++)
 		{
+			if (!Screen_LineDirty(y))
+				continue;
 			adr=y*208*8;
 
 			for (x = 0; x < 832; x++)
 			{
-			   if ((buffer[adr]!=NEXTColorVideo[adr]) || (buffer[1+adr]!=NEXTColorVideo[1+adr])) {
 				col=(  (NEXTColorVideo[adr]<<8) |  (NEXTColorVideo[1+adr])  )>>4;
 				putpixel(sdlscrn,x,y,hicolors[col]);
-				buffer[adr]=NEXTColorVideo[adr];
-				buffer[adr+1]=NEXTColorVideo[adr+1];
-				}
-			adr+=2;
+				adr+=2;
 			}
+			Screen_AddDirtyLine(y);
 		}
 		return;
 	}
@@ -170,10 +273,11 @@ static void ConvertHighRes_640x8Bit(void)
 	if (ConfigureParams.System.bTurbo) {
 		for (y = 0; y < 624; y++)
 		{
+			if (!Screen_LineDirty(y))
+				continue;
 			adr=y*280;            
 			for (x = 0; x < 832; x+=4)
 			{
-                if (buffer[adr]!=NEXTVideo[adr]) {
                         col=(NEXTVideo[adr]&0xC0)>>6;
 			putpixelbw(sdlscrn,x,y,col);
                         col=(NEXTVideo[adr]&0x30)>>4;
@@ -182,20 +286,20 @@ static void ConvertHighRes_640x8Bit(void)
 			putpixelbw(sdlscrn,x+2,y,col);
                         col=(NEXTVideo[adr]&0x03);
 			putpixelbw(sdlscrn,x+3,y,col);
-                    buffer[adr]=NEXTVideo[adr];
-                }
 			adr+=1;
 			}
+			Screen_AddDirtyLine(y);
 		}
 	}
 	else {
 
 		for (y = 0; y < 832; y++)
 		{
+			if (!Screen_LineDirty(y))
+				continue;
 			adr=y*288;            
 			for (x = 0; x < 1120; x+=4)
 			{
-                if (buffer[adr]!=NEXTVideo[adr]) {
                         col=(NEXTVideo[adr]&0xC0)>>6;
 			putpixelbw(sdlscrn,x,y,col);
                         col=(NEXTVideo[adr]&0x30)>>4;
@@ -204,10 +308,9 @@ static void ConvertHighRes_640x8Bit(void)
 			putpixelbw(sdlscrn,x+2,y,col);
                         col=(NEXTVideo[adr]&0x03);
 			putpixelbw(sdlscrn,x+3,y,col);
-                    buffer[adr]=NEXTVideo[adr];
-                }
 			adr+=1;
 			}
+			Screen_AddDirtyLine(y);
 		}
 
 	}
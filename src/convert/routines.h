@@ -10,6 +10,8 @@
 #ifndef HATARI_CONVERTROUTINES_H
 #define HATARI_CONVERTROUTINES_H
 
+static void ConvertHighRes_SetupTables(void);
 static void ConvertHighRes_640x8Bit(void);
+static void ConvertHighRes_640x32Bit(void);
 
 #endif /* HATARI_CONVERTROUTINES_H */
@@ -28,6 +28,8 @@
  */
 
 
+#include <string.h>
+
 #include "sysconfig.h"
 #include "sysdeps.h"
 
@@ -54,6 +56,9 @@
 static int bBusErrorReadWrite;
 static int atcindextable[32];
 static int tt_enabled;
+/* Transparent translation result (TT_OK_MATCH or 0) for
+ * [write][function code][address bits 31-24] */
+static uae_u8 tt_table[2][8][256];
 
 int mmu030_idx;
 
@@ -130,6 +135,91 @@ struct {
     uae_u16 status;
 } mmu030;
 
+/* Number of ATC entries with history bit set */
+static int atc_mru_count;
+
+
+/* Soft TLB
+ *
+ * Direct mapped cache in front of the ATC. It holds host pointers for
+ * logical pages (per function code) that are translated by a valid ATC
+ * entry to plain RAM or VRAM (banks flagged ABFLAG_DIRECT, or for reads
+ * only ABFLAG_DIRECTREAD). A hit skips
+ * the transparent translation check, the ATC search and the memory bank
+ * function call. Every line belongs to exactly one ATC entry and is
+ * invalidated together with it, so PTEST and bus errors are not affected.
+ */
+
+#define MMU030_TLB_BITS     8
+#define MMU030_TLB_SIZE     (1<<MMU030_TLB_BITS)
+#define MMU030_TLB_VALID    0x08 /* tag bits 0-2 hold the function code */
+
+typedef struct {
+    uaecptr tag;    /* logical page address | TLB_VALID | fc */
+    uae_u8 *host;   /* host address of the physical page */
+    uae_u32 ram;    /* offset of the page in NEXTRam, for writes */
+    int atc;        /* ATC entry this line belongs to */
+    bool write;     /* writes may go directly to host memory */
+} MMU030_TLB_LINE;
+
+static MMU030_TLB_LINE mmu030_tlb[MMU030_TLB_SIZE];
+
+static ALWAYS_INLINE MMU030_TLB_LINE *mmu030_tlb_line(uaecptr page, uae_u32 fc) {
+    return &mmu030_tlb[((page >> mmu030.translation.page.size) ^ fc) & (MMU030_TLB_SIZE-1)];
+}
+
+/* Returns the TLB line for addr and fc or NULL if it is not cached. On a hit
+ * the history bit of the underlying ATC entry is maintained just like on an
+ * ATC hit. */
+static ALWAYS_INLINE MMU030_TLB_LINE *mmu030_tlb_lookup(uaecptr addr, uae_u32 fc) {
+    uaecptr page = addr & mmu030.translation.page.imask;
+    MMU030_TLB_LINE *t = mmu030_tlb_line(page, fc);
+    
+    if (t->tag != (page | MMU030_TLB_VALID | fc))
+        return NULL;
+    if (!mmu030.atc[t->atc].mru)
+        mmu030_atc_handle_history_bit(t->atc);
+    return t;
+}
+
+static void mmu030_tlb_flush(void) {
+    memset(mmu030_tlb, 0, sizeof(mmu030_tlb));
+}
+
+/* Invalidate the TLB line belonging to ATC entry l */
+static void mmu030_tlb_invalidate_atc(int l) {
+    MMU030_TLB_LINE *t;
+    
+    if (!mmu030.atc[l].logical.valid)
+        return;
+    t = mmu030_tlb_line(mmu030.atc[l].logical.addr, mmu030.atc[l].logical.fc);
+    if (t->atc == l)
+        t->tag = 0;
+}
+
+/* Cache the translation of ATC entry l, if it maps to direct memory */
+static void mmu030_tlb_fill(uaecptr addr, uae_u32 fc, int l) {
+    uaecptr physical = mmu030.atc[l].physical.addr;
+    uaecptr page = addr & mmu030.translation.page.imask;
+    addrbank *ab = &get_mem_bank(physical);
+    MMU030_TLB_LINE *t;
+    
+    if (!(ab->flags & (ABFLAG_DIRECT | ABFLAG_DIRECTREAD)) || mmu030.atc[l].physical.bus_error)
+        return;
+    /* Transparent translation may differ between reads and writes */
+    if (mmu030_match_ttr_access(addr, fc, false))
+        return;
+    
+    t = mmu030_tlb_line(page, fc);
+    t->tag = page | MMU030_TLB_VALID | fc;
+    t->host = ab->xlateaddr(physical);
+    t->atc = l;
+    t->write = (ab->flags & ABFLAG_DIRECT) &&
+               mmu030.atc[l].physical.modified && !mmu030.atc[l].physical.write_protect &&
+               !mmu030_match_ttr_access(addr, fc, true);
+    t->ram = t->write ? (uae_u32)(t->host - NEXTRam) : 0;
+}
+
 
 
 /* MMU Status Register
@@ -276,10 +366,16 @@ void mmu_op30_pmove (uaecptr pc, uae_u32 opcode, uae_u16 next, uaecptr extra)
             return;
 	}
     
+    if (!rw && !(preg==0x18)) {
+        /* TLB depends on page size and transparent translation */
+        mmu030_tlb_flush();
+    }
     if (!fd && !rw && !(preg==0x18)) {
         mmu030_flush_atc_all();
     }
-	tt_enabled = (tt0_030 & TT_ENABLE) || (tt1_030 & TT_ENABLE);
+	if (!rw && (preg==0x02 || preg==0x03)) {
+		mmu030_build_tt_table();
+	}
 }
 
 void mmu_op30_ptest (uaecptr pc, uae_u32 opcode, uae_u16 next, uaecptr extra)
@@ -421,6 +517,7 @@ void mmu030_flush_atc_fc(uae_u32 fc_base, uae_u32 fc_mask) {
     for (i=0; i<ATC030_NUM_ENTRIES; i++) {
         if (((fc_base&fc_mask)==(mmu030.atc[i].logical.fc&fc_mask)) &&
             mmu030.atc[i].logical.valid) {
+            mmu030_tlb_invalidate_atc(i);
             mmu030.atc[i].logical.valid = false;
 #if MMU030_OP_DBG_MSG
             write_log(_T("ATC: Flushing %08X\n"), mmu030.atc[i].physical.addr);
@@ -438,6 +535,7 @@ void mmu030_flush_atc_page_fc(uaecptr logical_addr, uae_u32 fc_base, uae_u32 fc_
         if (((fc_base&fc_mask)==(mmu030.atc[i].logical.fc&fc_mask)) &&
             (mmu030.atc[i].logical.addr == logical_addr) &&
             mmu030.atc[i].logical.valid) {
+            mmu030_tlb_invalidate_atc(i);
             mmu030.atc[i].logical.valid = false;
 #if MMU030_OP_DBG_MSG
             write_log(_T("ATC: Flushing %08X\n"), mmu030.atc[i].physical.addr);
@@ -453,6 +551,7 @@ void mmu030_flush_atc_page(uaecptr logical_addr) {
     for (i=0; i<ATC030_NUM_ENTRIES; i++) {
         if ((mmu030.atc[i].logical.addr == logical_addr) &&
             mmu030.atc[i].logical.valid) {
+            mmu030_tlb_invalidate_atc(i);
             mmu030.atc[i].logical.valid = false;
 #if MMU030_OP_DBG_MSG
             write_log(_T("ATC: Flushing %08X\n"), mmu030.atc[i].physical.addr);
@@ -470,6 +569,7 @@ void mmu030_flush_atc_all(void) {
     for (i=0; i<ATC030_NUM_ENTRIES; i++) {
         mmu030.atc[i].logical.valid = false;
     }
+    mmu030_tlb_flush();
 }
 
 
@@ -580,12 +680,40 @@ int mmu030_match_ttr(uaecptr addr, uae_u32 fc, bool write)
 }
 int mmu030_match_ttr_access(uaecptr addr, uae_u32 fc, bool write)
 {
-    int tt0, tt1;
-	if (!tt_enabled)
-		return 0;
-    tt0 = mmu030_do_match_ttr(tt0_030, mmu030.transparent.tt0, addr, fc, write);
-    tt1 = mmu030_do_match_ttr(tt1_030, mmu030.transparent.tt1, addr, fc, write);
-    return (tt0|tt1) & TT_OK_MATCH;
+    return tt_table[write ? 1 : 0][fc & 7][addr >> 24];
+}
+
+/* TT registers only compare the function code and address bits 31-24,
+ * so the result of mmu030_match_ttr_access can be precomputed for all
+ * possible accesses whenever TT0 or TT1 change */
+void mmu030_build_tt_table(void)
+{
+    int write, fc, i;
+    uaecptr addr;
+    
+    tt_enabled = (tt0_030 & TT_ENABLE) || (tt1_030 & TT_ENABLE);
+    
+    for (write = 0; write < 2; write++) {
+        for (fc = 0; fc < 8; fc++) {
+            for (i = 0; i < 256; i++) {
+                addr = (uaecptr)i << 24;
+                tt_table[write][fc][i] =
+                    (mmu030_do_match_ttr(tt0_030, mmu030.transparent.tt0, addr, fc, write) |
+                     mmu030_do_match_ttr(tt1_030, mmu030.transparent.tt1, addr, fc, write)) & TT_OK_MATCH;
+            }
+        }
+    }
+}
+
+/* Decode all MMU registers again, after they have been restored from a
+ * snapshot */
+void mmu030_restore_regs(void)
+{
+    mmu030_flush_atc_all();
+    mmu030.transparent.tt0 = mmu030_decode_tt(tt0_030);
+    mmu030.transparent.tt1 = mmu030_decode_tt(tt1_030);
+    mmu030_decode_tc(tc_030);
+    mmu030_build_tt_table();
 }
 
 /* Locked Read-Modify-Write */
@@ -708,13 +836,17 @@ int mmu030_do_match_lrmw_ttr(uae_u32 tt, TT_info comp, uaecptr addr, uae_u32 fc)
 
 void mmu030_decode_tc(uae_u32 TC) {
         
+    mmu030_tlb_flush();
+    
     /* Set MMU condition */    
     if (TC & TC_ENABLE_TRANSLATION) {
         mmu030.enabled = true;
+        m68k_set_mmu030_translation(true);
     } else {
 		if (mmu030.enabled)
 			write_log(_T("MMU disabled\n"));
         mmu030.enabled = false;
+        m68k_set_mmu030_translation(false);
         return;
     }
     
@@ -1448,6 +1580,7 @@ uae_u32 mmu030_table_search(uaecptr addr, uae_u32 fc, bool write, int level) {
 		write_log (_T("ATC entry not found!!!\n"));
 	}
 
+    mmu030_tlb_invalidate_atc(i);
     mmu030_atc_handle_history_bit(i);
     
     /* Create ATC entry */
@@ -1604,6 +1737,7 @@ void mmu030_put_long_atc(uaecptr addr, uae_u32 val, int l, uae_u32 fc) {
         return;
     }
 
+    mmu030_tlb_fill(addr, fc, l);
     phys_put_long(physical_addr, val);
 }
 
@@ -1623,6 +1757,7 @@ void mmu030_put_word_atc(uaecptr addr, uae_u16 val, int l, uae_u32 fc) {
         return;
     }
 
+    mmu030_tlb_fill(addr, fc, l);
     phys_put_word(physical_addr, val);
 }
 
@@ -1642,6 +1777,7 @@ void mmu030_put_byte_atc(uaecptr addr, uae_u8 val, int l, uae_u32 fc) {
         return;
     }
 
+    mmu030_tlb_fill(addr, fc, l);
     phys_put_byte(physical_addr, val);
 }
 
@@ -1661,6 +1797,7 @@ uae_u32 mmu030_get_long_atc(uaecptr addr, int l, uae_u32 fc) {
         return 0;
     }
 
+    mmu030_tlb_fill(addr, fc, l);
     return phys_get_long(physical_addr);
 }
 
@@ -1679,7 +1816,8 @@ uae_u16 mmu030_get_word_atc(uaecptr addr, int l, uae_u32 fc) {
         mmu030_page_fault(addr, true, MMU030_SSW_SIZE_W, fc);
         return 0;
     }
-    
+
+    mmu030_tlb_fill(addr, fc, l);
     return phys_get_word(physical_addr);
 }
 
@@ -1699,6 +1837,7 @@ uae_u8 mmu030_get_byte_atc(uaecptr addr, int l, uae_u32 fc) {
         return 0;
     }
 
+    mmu030_tlb_fill(addr, fc, l);
     return phys_get_byte(physical_addr);
 }
 
@@ -1777,6 +1916,7 @@ int mmu030_logical_is_in_atc(uaecptr addr, uae_u32 fc, bool write) {
                 atcindextable[offset] = index;
                 return index;
             } else {
+                mmu030_tlb_invalidate_atc(index);
                 mmu030.atc[index].logical.valid = false;
             }
 		}
@@ -1789,17 +1929,17 @@ int mmu030_logical_is_in_atc(uaecptr addr, uae_u32 fc, bool write) {
 
 void mmu030_atc_handle_history_bit(int entry_num) {
     int j;
+    if (mmu030.atc[entry_num].mru)
+        return;
     mmu030.atc[entry_num].mru = 1;
-    for (j=0; j<ATC030_NUM_ENTRIES; j++) {
-        if (!mmu030.atc[j].mru)
-            break;
-    }
+    atc_mru_count++;
     /* If there are no more zero-bits, reset all */
-    if (j==ATC030_NUM_ENTRIES) {
+    if (atc_mru_count==ATC030_NUM_ENTRIES) {
         for (j=0; j<ATC030_NUM_ENTRIES; j++) {
             mmu030.atc[j].mru = 0;
         }
         mmu030.atc[entry_num].mru = 1;
+        atc_mru_count = 1;
 #if MMU030_ATC_DBG_MSG
         write_log(_T("ATC: No more history zero-bits. Reset all.\n"));
 #endif
@@ -1816,6 +1956,15 @@ void mmu030_atc_handle_history_bit(int entry_num) {
 
 void mmu030_put_long(uaecptr addr, uae_u32 val, uae_u32 fc) {
     
+    MMU030_TLB_LINE *t = mmu030_tlb_lookup(addr, fc);
+    if (t && t->write) {
+        uae_u32 offset = addr & mmu030.translation.page.mask;
+        NEXTmem_set_dirty(t->ram + offset);
+        NEXTmem_set_dirty(t->ram + offset + 3);
+        do_put_mem_long(t->host + offset, val);
+        return;
+    }
+    
 	//                                        addr,super,write
 	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr,fc,true)) || (fc==7)) {
 		phys_put_long(addr,val);
@@ -1834,6 +1983,15 @@ void mmu030_put_long(uaecptr addr, uae_u32 val, uae_u32 fc) {
 
 void mmu030_put_word(uaecptr addr, uae_u16 val, uae_u32 fc) {
     
+    MMU030_TLB_LINE *t = mmu030_tlb_lookup(addr, fc);
+    if (t && t->write) {
+        uae_u32 offset = addr & mmu030.translation.page.mask;
+        NEXTmem_set_dirty(t->ram + offset);
+        NEXTmem_set_dirty(t->ram + offset + 1);
+        do_put_mem_word(t->host + offset, val);
+        return;
+    }
+    
 	//                                        addr,super,write
 	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr,fc,true)) || (fc==7)) {
 		phys_put_word(addr,val);
@@ -1852,6 +2010,14 @@ void mmu030_put_word(uaecptr addr, uae_u16 val, uae_u32 fc) {
 
 void mmu030_put_byte(uaecptr addr, uae_u8 val, uae_u32 fc) {
     
+    MMU030_TLB_LINE *t = mmu030_tlb_lookup(addr, fc);
+    if (t && t->write) {
+        uae_u32 offset = addr & mmu030.translation.page.mask;
+        NEXTmem_set_dirty(t->ram + offset);
+        t->host[offset] = val;
+        return;
+    }
+    
 	//                                        addr,super,write
 	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr, fc, true)) || (fc==7)) {
 		phys_put_byte(addr,val);
@@ -1870,6 +2036,11 @@ void mmu030_put_byte(uaecptr addr, uae_u8 val, uae_u32 fc) {
 
 uae_u32 mmu030_get_long(uaecptr addr, uae_u32 fc) {
     
+    MMU030_TLB_LINE *t = mmu030_tlb_lookup(addr, fc);
+    if (t) {
+        return do_get_mem_long(t->host + (addr & mmu030.translation.page.mask));
+    }
+    
 	//                                        addr,super,write
 	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr,fc,false)) || (fc==7)) {
 		return phys_get_long(addr);
@@ -1887,6 +2058,11 @@ uae_u32 mmu030_get_long(uaecptr addr, uae_u32 fc) {
 
 uae_u16 mmu030_get_word(uaecptr addr, uae_u32 fc) {
     
+    MMU030_TLB_LINE *t = mmu030_tlb_lookup(addr, fc);
+    if (t) {
+        return do_get_mem_word(t->host + (addr & mmu030.translation.page.mask));
+    }
+    
 	//                                        addr,super,write
 	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr,fc,false)) || (fc==7)) {
 		return phys_get_word(addr);
@@ -1904,6 +2080,11 @@ uae_u16 mmu030_get_word(uaecptr addr, uae_u32 fc) {
 
 uae_u8 mmu030_get_byte(uaecptr addr, uae_u32 fc) {
     
+    MMU030_TLB_LINE *t = mmu030_tlb_lookup(addr, fc);
+    if (t) {
+        return t->host[addr & mmu030.translation.page.mask];
+    }
+    
 	//                                        addr,super,write
 	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr,fc,false)) || (fc==7)) {
 		return phys_get_byte(addr);
@@ -2158,7 +2339,9 @@ void mmu030_reset(int hardreset)
 {
     /* A CPU reset causes the E-bits of TC and TT registers to be zeroed. */
     mmu030.enabled = false;
+    m68k_set_mmu030_translation(false);
 	regs.mmu_page_size = 0;
+	mmu030_tlb_flush();
 	tc_030 &= ~TC_ENABLE_TRANSLATION;
 	tt0_030 &= ~TT_ENABLE;
 	tt1_030 &= ~TT_ENABLE;
@@ -2168,6 +2351,7 @@ void mmu030_reset(int hardreset)
         mmusr_030 = 0;
         mmu030_flush_atc_all();
 	}
+	mmu030_build_tt_table();
 }
 
 
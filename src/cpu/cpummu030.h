@@ -74,6 +74,8 @@ uaecptr mmu030_translate(uaecptr addr, bool super, bool data, bool write);
 
 int mmu030_match_ttr(uaecptr addr, uae_u32 fc, bool write);
 int mmu030_match_ttr_access(uaecptr addr, uae_u32 fc, bool write);
+void mmu030_build_tt_table(void);
+void mmu030_restore_regs(void);
 int mmu030_match_lrmw_ttr(uaecptr addr, uae_u32 fc);
 int mmu030_do_match_ttr(uae_u32 tt, TT_info masks, uaecptr addr, uae_u32 fc, bool write);
 int mmu030_do_match_lrmw_ttr(uae_u32 tt, TT_info masks, uaecptr addr, uae_u32 fc);
@@ -457,6 +459,156 @@ STATIC_INLINE uae_u32 next_ilong_mmu030 (void)
 	return v;
 }
 
+/* Accessors for the opcode table that is used while address translation
+ * is disabled (TC.E = 0). Accesses go straight to physical memory, but the
+ * access state is kept for restarting instructions after a bus error. */
+
+static ALWAYS_INLINE uae_u32 uae_nommu030_get_ilong(uaecptr addr)
+{
+	if (unlikely(is_unaligned(addr, 4)))
+		return mmu030_get_long_unaligned(addr, (regs.s ? 4 : 0) | 2, 0);
+	return phys_get_long(addr);
+}
+static ALWAYS_INLINE uae_u16 uae_nommu030_get_iword(uaecptr addr)
+{
+	if (unlikely(is_unaligned(addr, 2)))
+		return mmu030_get_word_unaligned(addr, (regs.s ? 4 : 0) | 2, 0);
+	return phys_get_word(addr);
+}
+static ALWAYS_INLINE uae_u32 uae_nommu030_get_long(uaecptr addr)
+{
+	if (unlikely(is_unaligned(addr, 4)))
+		return mmu030_get_long_unaligned(addr, (regs.s ? 4 : 0) | 1, 0);
+	return phys_get_long(addr);
+}
+static ALWAYS_INLINE uae_u16 uae_nommu030_get_word(uaecptr addr)
+{
+	if (unlikely(is_unaligned(addr, 2)))
+		return mmu030_get_word_unaligned(addr, (regs.s ? 4 : 0) | 1, 0);
+	return phys_get_word(addr);
+}
+static ALWAYS_INLINE void uae_nommu030_put_long(uaecptr addr, uae_u32 val)
+{
+	if (unlikely(is_unaligned(addr, 4)))
+		mmu030_put_long_unaligned(addr, val, (regs.s ? 4 : 0) | 1, 0);
+	else
+		phys_put_long(addr, val);
+}
+static ALWAYS_INLINE void uae_nommu030_put_word(uaecptr addr, uae_u16 val)
+{
+	if (unlikely(is_unaligned(addr, 2)))
+		mmu030_put_word_unaligned(addr, val, (regs.s ? 4 : 0) | 1, 0);
+	else
+		phys_put_word(addr, val);
+}
+
+STATIC_INLINE void put_byte_nommu030_state (uaecptr addr, uae_u32 v)
+{
+	ACCESS_CHECK_PUT
+	phys_put_byte (addr, v);
+	ACCESS_EXIT_PUT
+}
+STATIC_INLINE void put_word_nommu030_state (uaecptr addr, uae_u32 v)
+{
+	ACCESS_CHECK_PUT
+	uae_nommu030_put_word (addr, v);
+	ACCESS_EXIT_PUT
+}
+STATIC_INLINE void put_long_nommu030_state (uaecptr addr, uae_u32 v)
+{
+	ACCESS_CHECK_PUT
+	uae_nommu030_put_long (addr, v);
+	ACCESS_EXIT_PUT
+}
+STATIC_INLINE uae_u32 get_byte_nommu030_state (uaecptr addr)
+{
+	uae_u32 v;
+	ACCESS_CHECK_GET
+	v = phys_get_byte (addr);
+	ACCESS_EXIT_GET
+	return v;
+}
+STATIC_INLINE uae_u32 get_word_nommu030_state (uaecptr addr)
+{
+	uae_u32 v;
+	ACCESS_CHECK_GET
+	v = uae_nommu030_get_word (addr);
+	ACCESS_EXIT_GET
+	return v;
+}
+STATIC_INLINE uae_u32 get_long_nommu030_state (uaecptr addr)
+{
+	uae_u32 v;
+	ACCESS_CHECK_GET
+	v = uae_nommu030_get_long (addr);
+	ACCESS_EXIT_GET
+	return v;
+}
+STATIC_INLINE uae_u32 get_ibyte_nommu030_state (int o)
+{
+	uae_u32 v;
+	uae_u32 addr = m68k_getpc () + o;
+	ACCESS_CHECK_GET
+	v = uae_nommu030_get_iword (addr);
+	ACCESS_EXIT_GET
+	return v;
+}
+STATIC_INLINE uae_u32 get_iword_nommu030_state (int o)
+{
+	uae_u32 v;
+	uae_u32 addr = m68k_getpc () + o;
+	ACCESS_CHECK_GET
+	v = uae_nommu030_get_iword (addr);
+	ACCESS_EXIT_GET
+	return v;
+}
+STATIC_INLINE uae_u32 get_ilong_nommu030_state (int o)
+{
+	uae_u32 v;
+	uae_u32 addr = m68k_getpc () + o;
+	ACCESS_CHECK_GET
+	v = uae_nommu030_get_ilong (addr);
+	ACCESS_EXIT_GET
+	return v;
+}
+STATIC_INLINE uae_u32 next_iword_nommu030_state (void)
+{
+	uae_u32 v;
+	uae_u32 addr = m68k_getpc ();
+	ACCESS_CHECK_GET_PC(2);
+	v = uae_nommu030_get_iword (addr);
+	m68k_incpci (2);
+	ACCESS_EXIT_GET
+	return v;
+}
+STATIC_INLINE uae_u32 next_ilong_nommu030_state (void)
+{
+	uae_u32 v;
+	uae_u32 addr = m68k_getpc ();
+	ACCESS_CHECK_GET_PC(4);
+	v = uae_nommu030_get_ilong (addr);
+	m68k_incpci (4);
+	ACCESS_EXIT_GET
+	return v;
+}
+
+STATIC_INLINE uae_u32 get_word_nommu030 (uaecptr addr)
+{
+	return uae_nommu030_get_word (addr);
+}
+STATIC_INLINE uae_u32 get_long_nommu030 (uaecptr addr)
+{
+	return uae_nommu030_get_long (addr);
+}
+STATIC_INLINE void put_word_nommu030 (uaecptr addr, uae_u32 v)
+{
+	uae_nommu030_put_word (addr, v);
+}
+STATIC_INLINE void put_long_nommu030 (uaecptr addr, uae_u32 v)
+{
+	uae_nommu030_put_long (addr, v);
+}
+
 extern void m68k_do_rts_mmu030 (void);
 extern void m68k_do_rte_mmu030 (uaecptr a7);
 extern void flush_mmu030 (uaecptr, int);
@@ -38,6 +38,7 @@ static int using_exception_3;
 static int using_ce;
 static int using_tracer;
 static int using_waitstates;
+static int using_nommu030;
 static int cpu_level;
 static int count_read, count_write, count_cycles, count_ncycles;
 static int count_cycles_ce020;
@@ -2628,6 +2629,32 @@ static void resetvars (void)
 			dstb = "put_byte_ce020";
 		}
 #endif
+	} else if (using_mmu == 68030 && using_nommu030) {
+		// 68030 MMU, address translation disabled
+		disp020 = "get_disp_ea_020_mmu030";
+		prefetch_long = "get_ilong_nommu030_state";
+		prefetch_word = "get_iword_nommu030_state";
+		nextw = "next_iword_nommu030_state";
+		nextl = "next_ilong_nommu030_state";
+		srcli = "get_ilong_nommu030_state";
+		srcwi = "get_iword_nommu030_state";
+		srcbi = "get_ibyte_nommu030_state";
+		srcl = "get_long_nommu030_state";
+		dstl = "put_long_nommu030_state";
+		srcw = "get_word_nommu030_state";
+		dstw = "put_word_nommu030_state";
+		srcb = "get_byte_nommu030_state";
+		dstb = "put_byte_nommu030_state";
+		srcblrmw = "get_lrmw_byte_mmu030_state";
+		srcwlrmw = "get_lrmw_word_mmu030_state";
+		srcllrmw = "get_lrmw_long_mmu030_state";
+		dstblrmw = "put_lrmw_byte_mmu030_state";
+		dstwlrmw = "put_lrmw_word_mmu030_state";
+		dstllrmw = "put_lrmw_long_mmu030_state";
+		srcld = "get_long_nommu030";
+		srcwd = "get_word_nommu030";
+		dstld = "put_long_nommu030";
+		dstwd = "put_word_nommu030";
 	} else if (using_mmu == 68030) {
 		// 68030 MMU
 		disp020 = "get_disp_ea_020_mmu030";
@@ -5051,7 +5078,7 @@ static void generate_includes (FILE * f, int id)
 	fprintf (f, "#include \"cputbl.h\"\n");
 	if (id == 31 || id == 33)
 		fprintf (f, "#include \"cpummu.h\"\n");
-	else if (id == 32)
+	else if (id == 32 || id == 34)
 		fprintf (f, "#include \"cpummu030.h\"\n");
 
 	fprintf (f, "#define CPUFUNC(x) x##_ff\n"
@@ -5390,7 +5417,7 @@ static void generate_cpu (int id, int mode)
 	}
 
 	postfix = id;
-	if (id == 0 || id == 11 || id == 13 || id == 20 || id == 21 || id == 22 || id == 31 || id == 32 || id == 33) {
+	if (id == 0 || id == 11 || id == 13 || id == 20 || id == 21 || id == 22 || id == 31 || id == 32 || id == 33 || id == 34) {
 		if (generate_stbl)
 			fprintf (stblfile, "#ifdef CPUEMU_%d%s\n", postfix, extraup);
 		postfix2 = postfix;
@@ -5404,6 +5431,7 @@ static void generate_cpu (int id, int mode)
 	using_ce = 0;
 	using_ce020 = 0;
 	using_mmu = 0;
+	using_nommu030 = 0;
 	using_waitstates = 0;
 	memory_cycle_cnt = 4;
 	mmu_postfix = "";
@@ -5462,10 +5490,11 @@ static void generate_cpu (int id, int mode)
 		read_counts ();
 		for (rp = 0; rp < nr_cpuop_funcs; rp++)
 			opcode_next_clev[rp] = cpu_level;
-	} else if (id == 32) { // 32 = 68030 MMU
+	} else if (id == 32 || id == 34) { // 32 = 68030 MMU, 34 = 68030 MMU with translation disabled
 		mmu_postfix = "030";
 		cpu_level = 3;
 		using_mmu = 68030;
+		using_nommu030 = id == 34;
 		read_counts ();
 		for (rp = 0; rp < nr_cpuop_funcs; rp++)
 			opcode_next_clev[rp] = cpu_level;
@@ -5524,9 +5553,9 @@ int main (int argc, char **argv)
 	using_exception_3 = 1;
 	using_ce = 0;
 
-	for (i = 0; i <= 33; i++) {
+	for (i = 0; i <= 34; i++) {
 		//if ((i >= 6 && i < 11) || (i > 14 && i < 20) || (i > 24 && i < 31))
-        if (i!=31 && i!=32)
+        if (i!=31 && i!=32 && i!=34)
 			continue;
 		generate_stbl = 1;
 		generate_cpu (i, 0);
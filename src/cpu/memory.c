@@ -96,6 +96,42 @@ uae_u8  NEXTVideo[256*1024];
 #define NEXTcolorvideo_mask 0x001FFFFF
 uae_u8 NEXTColorVideo[2*1024*1024];
 
+/* Scanlines of video memory written since the last screen update */
+uae_u32 NEXTVideo_DirtyLines[NEXT_VIDEO_MAX_LINES/32];
+static uae_u32 NEXTvideo_linebytes = 288;
+
+static inline void NEXTvideo_set_dirty(uaecptr addr)
+{
+    uae_u32 line = addr / NEXTvideo_linebytes;
+    if (line < NEXT_VIDEO_MAX_LINES)
+        NEXTVideo_DirtyLines[line>>5] |= 1u << (line&31);
+}
+
+static void NEXTvideo_set_dirty_range(uaecptr addr, uae_u32 len)
+{
+    uae_u32 line = addr / NEXTvideo_linebytes;
+    uae_u32 last = (addr + len - 1) / NEXTvideo_linebytes;
+    
+    for (; line <= last && line < NEXT_VIDEO_MAX_LINES; line++)
+        NEXTVideo_DirtyLines[line>>5] |= 1u << (line&31);
+}
+
+/* Pages of main memory written since the last memory snapshot */
+uae_u32 NEXTRam_DirtyPages[NEXT_RAM_MAX_PAGES/32+1];
+
+void NEXTmem_set_dirty_host(const uae_u8 *host, uae_u32 len)
+{
+    uae_u32 page, last;
+    
+    if (host < NEXTRam || host >= NEXTRam + sizeof(NEXTRam) || len == 0)
+        return;
+    page = (host - NEXTRam) >> NEXT_RAM_PAGE_SHIFT;
+    last = (host - NEXTRam + len - 1) >> NEXT_RAM_PAGE_SHIFT;
+    
+    for (; page <= last && page < NEXT_RAM_MAX_PAGES; page++)
+        NEXTRam_DirtyPages[page>>5] |= 1u << (page&31);
+}
+
 
 #define IOmem_mask 			0x0001FFFF
 #define	IOmem_size			0x0001C000
@@ -298,18 +334,23 @@ static uae_u32 NEXTmem_bget(uaecptr addr)
 static void NEXTmem_lput(uaecptr addr, uae_u32 l)
 {
     addr &= NEXTmem_mask;
+    NEXTmem_set_dirty(addr);
+    NEXTmem_set_dirty(addr+3);
     do_put_mem_long(NEXTRam + addr, l);
 }
 
 static void NEXTmem_wput(uaecptr addr, uae_u32 w)
 {
     addr &= NEXTmem_mask;
+    NEXTmem_set_dirty(addr);
+    NEXTmem_set_dirty(addr+1);
     do_put_mem_word(NEXTRam + addr, w);
 }
 
 static void NEXTmem_bput(uaecptr addr, uae_u32 b)
 {
     addr &= NEXTmem_mask;
+    NEXTmem_set_dirty(addr);
     NEXTRam[addr] = b;
 }
 
@@ -364,6 +405,8 @@ static void NEXTempty_lput(uaecptr addr, uae_u32 l)
     
     if (MemBank_Size[bank]) {
         addr = (((addr%MemBank_Size[bank])+(bank<<bankshift))+NEXT_RAM_START)&NEXTmem_mask;
+        NEXTmem_set_dirty(addr);
+        NEXTmem_set_dirty(addr+3);
         do_put_mem_long(NEXTRam + addr, l);
     }
 }
@@ -428,18 +471,23 @@ static void NEXTvideo_lput(uaecptr addr, uae_u32 l)
 {
     addr &= NEXTvideo_mask;
     do_put_mem_long(NEXTVideo + addr, l);
+    NEXTvideo_set_dirty(addr);
+    NEXTvideo_set_dirty(addr+3);
 }
 
 static void NEXTvideo_wput(uaecptr addr, uae_u32 w)
 {
     addr &= NEXTvideo_mask;
     do_put_mem_word(NEXTVideo + addr, w);
+    NEXTvideo_set_dirty(addr);
+    NEXTvideo_set_dirty(addr+1);
 }
 
 static void NEXTvideo_bput(uaecptr addr, uae_u32 b)
 {
     addr &= NEXTvideo_mask;
     NEXTVideo[addr] = b;
+    NEXTvideo_set_dirty(addr);
 }
 
 static int NEXTvideo_check(uaecptr addr, uae_u32 size)
@@ -485,47 +533,58 @@ static uae_u8 mwf3[4][4] = { /* A+B-AB */
     { 3, 3, 3, 3 }
 };
 
+static uae_u8 (* const mwf[4])[4] = { mwf0, mwf1, mwf2, mwf3 };
+
+/* Results of the write functions for whole bytes (4 pixels): [function][old][new] */
+static uae_u8 mwf_table[4][256][256];
+
+static void memory_write_func_init(void)
+{
+    int function,a,b,i;
+    uae_u8 v;
+    
+    for (function=0; function<4; function++) {
+        for (a=0; a<256; a++) {
+            for (b=0; b<256; b++) {
+                v=0;
+                for (i=0; i<4; i++) {
+                    v|=mwf[function][(a>>(i*2))&3][(b>>(i*2))&3]<<(i*2);
+                }
+                mwf_table[function][a][b]=v;
+            }
+        }
+    }
+}
+
 static uae_u32 memory_write_func(uae_u32 old, uae_u32 new, int function, int size)
 {
-    int a,b,i;
-    uae_u32 v=0;
+    uae_u8 (*table)[256] = mwf_table[function&3];
 #if 0
     write_log("[MWF] Function%i: size=%i, old=%08X, new=%08X\n",function,size,old,new);
 #endif
     
-    switch (function) {
-        case 0:
-            for (i=0; i<(size*4); i++) {
-                a=old>>(i*2)&3;
-                b=new>>(i*2)&3;
-                v|=mwf0[a][b]<<(i*2);
-            }
-            return v;
-        case 1:
-            for (i=0; i<(size*4); i++) {
-                a=old>>(i*2)&3;
-                b=new>>(i*2)&3;
-                v|=mwf1[a][b]<<(i*2);
-            }
-            return v;
+    switch (size) {
+        case 4:
+            return (table[old>>24][new>>24]<<24) |
+                   (table[(old>>16)&0xFF][(new>>16)&0xFF]<<16) |
+                   (table[(old>>8)&0xFF][(new>>8)&0xFF]<<8) |
+                   table[old&0xFF][new&0xFF];
         case 2:
-            for (i=0; i<(size*4); i++) {
-                a=old>>(i*2)&3;
-                b=new>>(i*2)&3;
-                v|=mwf2[a][b]<<(i*2);
-            }
-            return v;
-        case 3:
-            for (i=0; i<(size*4); i++) {
-                a=old>>(i*2)&3;
-                b=new>>(i*2)&3;
-                v|=mwf3[a][b]<<(i*2);
-            }
-            return v;
-            
+            return (table[(old>>8)&0xFF][(new>>8)&0xFF]<<8) |
+                   table[old&0xFF][new&0xFF];
         default:
-            write_log("Unknown memory write function!\n");
-            abort();
+            return table[old&0xFF][new&0xFF];
+    }
+}
+
+/* Apply a write function to a span of bytes in host memory */
+static void memory_write_func_span(uae_u8 *dst, const uae_u8 *src, uae_u32 len, int function)
+{
+    uae_u8 (*table)[256] = mwf_table[function&3];
+    uae_u32 i;
+    
+    for (i=0; i<len; i++) {
+        dst[i] = table[dst[i]][src[i]];
     }
 }
 
@@ -691,18 +750,23 @@ static void NEXTcolorvideo_lput(uaecptr addr, uae_u32 l)
 {
     addr &= NEXTcolorvideo_mask;
     do_put_mem_long(NEXTColorVideo + addr, l);
+    NEXTvideo_set_dirty(addr);
+    NEXTvideo_set_dirty(addr+3);
 }
 
 static void NEXTcolorvideo_wput(uaecptr addr, uae_u32 w)
 {
     addr &= NEXTcolorvideo_mask;
     do_put_mem_word(NEXTColorVideo + addr, w);
+    NEXTvideo_set_dirty(addr);
+    NEXTvideo_set_dirty(addr+1);
 }
 
 static void NEXTcolorvideo_bput(uaecptr addr, uae_u32 b)
 {
     addr &= NEXTcolorvideo_mask;
     NEXTColorVideo[addr] = b;
+    NEXTvideo_set_dirty(addr);
 }
 
 static int NEXTcolorvideo_check(uaecptr addr, uae_u32 size)
@@ -924,7 +988,7 @@ static addrbank NEXTmem_bank =
     NEXTmem_lget, NEXTmem_wget, NEXTmem_bget,
     NEXTmem_lput, NEXTmem_wput, NEXTmem_bput,
     NEXTmem_xlate, NEXTmem_check, NULL, (char*)"NEXT memory",
-    NEXTmem_lget, NEXTmem_wget, ABFLAG_RAM
+    NEXTmem_lget, NEXTmem_wget, ABFLAG_RAM | ABFLAG_DIRECT
 
 };
 
@@ -965,7 +1029,7 @@ static addrbank Video_bank =
     NEXTvideo_lget, NEXTvideo_wget, NEXTvideo_bget,
     NEXTvideo_lput, NEXTvideo_wput, NEXTvideo_bput,
     NEXTvideo_xlate, NEXTvideo_check, NULL, (char*)"Video memory",
-    NEXTvideo_lget, NEXTvideo_wget, ABFLAG_RAM
+    NEXTvideo_lget, NEXTvideo_wget, ABFLAG_RAM | ABFLAG_DIRECTREAD
 };
 
 static addrbank ColorVideo_bank =
@@ -973,7 +1037,7 @@ static addrbank ColorVideo_bank =
     NEXTcolorvideo_lget, NEXTcolorvideo_wget, NEXTcolorvideo_bget,
     NEXTcolorvideo_lput, NEXTcolorvideo_wput, NEXTcolorvideo_bput,
     NEXTcolorvideo_xlate, NEXTcolorvideo_check, NULL, (char*)"Color Video memory",
-    NEXTcolorvideo_lget, NEXTcolorvideo_wget, ABFLAG_RAM
+    NEXTcolorvideo_lget, NEXTcolorvideo_wget, ABFLAG_RAM | ABFLAG_DIRECTREAD
 };
 
 static addrbank bmap_bank =
@@ -1010,6 +1074,59 @@ static void init_mem_banks (void)
 }
 
 
+/* Store a block of bytes through the memory write functions. This is for
+ * DMA and fill operations that target the MWF aliases of RAM or VRAM and
+ * avoids going through the bank functions for every byte. Returns false
+ * without storing anything if the block is not entirely in MWF aliases. */
+bool memory_write_func_put_block(uaecptr addr, const uae_u8 *src, uae_u32 len)
+{
+    addrbank *ab, *target_ab;
+    uaecptr target, end;
+    uae_u32 n, i;
+    int function;
+    
+    if (len == 0)
+        return true;
+    for (end = addr + len - 1; ; end -= 0x10000) {
+        ab = &get_mem_bank(end);
+        if (ab != &NEXTmem_mwf && ab != &Video_mwf)
+            return false;
+        if ((end >> 16) == (addr >> 16))
+            break;
+    }
+    
+    while (len > 0) {
+        /* Stay inside one 64k bank */
+        n = 0x10000 - (addr & 0xFFFF);
+        if (n > len)
+            n = len;
+        
+        ab = &get_mem_bank(addr);
+        if (ab == &NEXTmem_mwf) {
+            function = (addr>>26)&0x3;
+            target = NEXT_RAM_START|(addr&0x03FFFFFF);
+        } else {
+            function = (addr>>24)&0x3;
+            target = NEXT_SCREEN|(addr&NEXTvideo_mask);
+        }
+        
+        target_ab = &get_mem_bank(target);
+        if (target_ab->flags & (ABFLAG_DIRECT | ABFLAG_DIRECTREAD)) {
+            memory_write_func_span(target_ab->xlateaddr(target), src, n, function);
+            if (target_ab == &Video_bank)
+                NEXTvideo_set_dirty_range(target&NEXTvideo_mask, n);
+            else
+                NEXTmem_set_dirty_host(target_ab->xlateaddr(target), n);
+        } else {
+            for (i=0; i<n; i++)
+                byteput(target+i, memory_write_func(byteget(target+i), src[i], function, 1));
+        }
+        addr += n; src += n; len -= n;
+    }
+    return true;
+}
+
+
 /*
  * Initialize the memory banks
  */
@@ -1033,6 +1150,7 @@ const char* memory_init(int *nNewNEXTMemSize)
         NEXTmem_mask = 0x03FFFFFF;
         bankshift = 24;
     }
+    NEXTRamEnd = NEXTmem_mask+1;   /* part of NEXTRam saved in memory snapshots */
 
     write_log("Memory init: Memory size: %iMB\n", Configuration_CheckMemory(nNewNEXTMemSize));
     
@@ -1043,6 +1161,7 @@ const char* memory_init(int *nNewNEXTMemSize)
     
 	/* fill every 65536 bank with dummy */
     init_mem_banks(); 
+    memory_write_func_init();
     
     
 #define MEM_HARDCODE 0
@@ -1076,15 +1195,19 @@ const char* memory_init(int *nNewNEXTMemSize)
     
     /* Map video memory */
     if (ConfigureParams.System.bTurbo && ConfigureParams.System.bColor) {
+        NEXTvideo_linebytes = 208*8;
         map_banks(&ColorVideo_bank, NEXT_TURBOSCREEN>>16, NEXT_COLORSCREEN_SIZE >> 16);
         write_log("Mapping Video Memory at $%08x: %ikB\n", NEXT_TURBOSCREEN, NEXT_COLORSCREEN_SIZE/1024);
     } else if (ConfigureParams.System.bTurbo) {
+        NEXTvideo_linebytes = 280;
         map_banks(&ColorVideo_bank, NEXT_TURBOSCREEN>>16, NEXT_SCREEN_SIZE >> 16);
         write_log("Mapping Video Memory at $%08x: %ikB\n", NEXT_TURBOSCREEN, NEXT_SCREEN_SIZE/1024);
     } else if (ConfigureParams.System.bColor) {
+        NEXTvideo_linebytes = 288*8;
         map_banks(&ColorVideo_bank, NEXT_COLORSCREEN>>16, NEXT_COLORSCREEN_SIZE >> 16);
         write_log("Mapping Video Memory at $%08x: %ikB\n", NEXT_COLORSCREEN, NEXT_COLORSCREEN_SIZE/1024);
     } else {
+        NEXTvideo_linebytes = 288;
         map_banks(&Video_bank, NEXT_SCREEN>>16, NEXT_SCREEN_SIZE >> 16);
         write_log("Mapping Video Memory at $%08x: %ikB\n", NEXT_SCREEN, NEXT_SCREEN_SIZE/1024);
         
@@ -1140,6 +1263,8 @@ const char* memory_init(int *nNewNEXTMemSize)
 		int i;
 		for (i=0;i<sizeof(NEXTVideo);i++) NEXTVideo[i]=0xAA;
 		for (i=0;i<sizeof(NEXTRam);i++) NEXTRam[i]=0xAA;
+		/* Snapshot and rewind users must not keep their copies of the old contents */
+		NEXTmem_set_dirty_host(NEXTRam, sizeof(NEXTRam));
 	}
     
 	return NULL;
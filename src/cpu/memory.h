@@ -34,6 +34,28 @@ extern uae_u8 NEXTVideo[256*1024];
 #define NEXT_COLORSCREEN_SIZE   0x00200000
 extern uae_u8 NEXTColorVideo[2*1024*1024];
 
+/* Dirty scanline bitmap, set by the video memory write functions */
+#define NEXT_VIDEO_MAX_LINES    1024
+extern uae_u32 NEXTVideo_DirtyLines[NEXT_VIDEO_MAX_LINES/32];
+
+/* Dirty page bitmap of main memory, set by the RAM write functions and by
+ * everything else that writes to NEXTRam directly. Used for saving delta
+ * memory snapshots. Offsets are relative to the start of NEXTRam; there is
+ * one spare word for accesses crossing the end of memory. */
+extern uae_u8 NEXTRam[128*1024*1024];
+#define NEXT_RAM_PAGE_SHIFT     12
+#define NEXT_RAM_PAGE_SIZE      (1<<NEXT_RAM_PAGE_SHIFT)
+#define NEXT_RAM_MAX_PAGES      (sizeof(NEXTRam)>>NEXT_RAM_PAGE_SHIFT)
+extern uae_u32 NEXTRam_DirtyPages[NEXT_RAM_MAX_PAGES/32+1];
+
+static inline void NEXTmem_set_dirty(uae_u32 offset)
+{
+    uae_u32 page = offset >> NEXT_RAM_PAGE_SHIFT;
+    NEXTRam_DirtyPages[page>>5] |= 1u << (page&31);
+}
+
+extern void NEXTmem_set_dirty_host(const uae_u8 *host, uae_u32 len);
+
 uae_u32 MemBank_Size[4]; // experimental, sizes for all 4 memory banks
 
 
@@ -59,7 +81,11 @@ extern void wait_cpu_cycle_write (uaecptr addr, int mode, uae_u32 v);
 extern uae_u32 wait_cpu_cycle_read_ce020 (uaecptr addr, int mode);
 extern void wait_cpu_cycle_write_ce020 (uaecptr addr, int mode, uae_u32 v);
 
-enum { ABFLAG_UNK = 0, ABFLAG_RAM = 1, ABFLAG_ROM = 2, ABFLAG_ROMIN = 4, ABFLAG_IO = 8, ABFLAG_NONE = 16, ABFLAG_SAFE = 32 };
+enum { ABFLAG_UNK = 0, ABFLAG_RAM = 1, ABFLAG_ROM = 2, ABFLAG_ROMIN = 4, ABFLAG_IO = 8, ABFLAG_NONE = 16, ABFLAG_SAFE = 32, ABFLAG_DIRECT = 64, ABFLAG_DIRECTREAD = 128 };
+/* ABFLAG_DIRECT: plain memory without side effects, xlateaddr may be used
+ * to access it directly (used by the 68030 MMU soft TLB).
+ * ABFLAG_DIRECTREAD: same, but only for reads; writes have side effects
+ * (e.g. video memory marking dirty scanlines) and must use the bank. */
 typedef struct {
 	/* These ones should be self-explanatory... */
 	mem_get_func lget, wget, bget;
@@ -105,6 +131,7 @@ extern addrbank mem_banks[65536];
 #endif
 
 extern const char* memory_init(int *membanks);
+extern bool memory_write_func_put_block(uaecptr addr, const uae_u8 *src, uae_u32 len);
 extern void memory_uninit (void);
 extern void map_banks(addrbank *bank, int first, int count);
 
@@ -75,6 +75,12 @@ int movem_index2[256];
 int movem_next[256];
 
 cpuop_func *cpufunctbl[65536];
+#ifdef CPUEMU_34
+/* Previous: 68030 opcodes used while MMU address translation is disabled */
+static cpuop_func *cpufunctbl_nommu030[65536];
+#endif
+/* Previous: opcode table used by m68k_run_mmu030 */
+static cpuop_func **cpufunctbl030 = cpufunctbl;
 
 int OpcodeFamily;
 struct mmufixup mmufixup[2];
@@ -320,10 +326,56 @@ static unsigned long REGPARAM2 op_illg_1 (uae_u32 opcode)
 	return 4;
 }
 
-void build_cpufunctbl (void)
+static int build_cpufunctbl_from (cpuop_func **functbl, const struct cputbl *tbl, int lvl)
 {
 	int i, opcnt;
 	unsigned long opcode;
+
+	for (opcode = 0; opcode < 65536; opcode++)
+		functbl[opcode] = op_illg_1;
+	for (i = 0; tbl[i].handler != NULL; i++) {
+		opcode = tbl[i].opcode;
+		functbl[opcode] = tbl[i].handler;
+	}
+
+	opcnt = 0;
+	for (opcode = 0; opcode < 65536; opcode++) {
+		cpuop_func *f;
+
+		if (table68k[opcode].mnemo == i_ILLG)
+			continue;
+		if (table68k[opcode].clev > lvl) {
+			continue;
+		}
+
+		if (table68k[opcode].handler != -1) {
+			int idx = table68k[opcode].handler;
+			f = functbl[idx];
+			if (f == op_illg_1)
+				abort ();
+			functbl[opcode] = f;
+			opcnt++;
+		}
+	}
+	return opcnt;
+}
+
+/* Previous: the 68030 runs a separate opcode table without address
+ * translation while TC.E is cleared. Called when TC.E changes. */
+void m68k_set_mmu030_translation (bool enabled)
+{
+#ifdef CPUEMU_34
+	if (currprefs.cpu_model == 68030) {
+		cpufunctbl030 = enabled ? cpufunctbl : cpufunctbl_nommu030;
+		return;
+	}
+#endif
+	cpufunctbl030 = cpufunctbl;
+}
+
+void build_cpufunctbl (void)
+{
+	int opcnt;
 	const struct cputbl *tbl = 0;
 	int lvl;
 
@@ -398,32 +450,12 @@ void build_cpufunctbl (void)
 		abort ();
 	}
 
-	for (opcode = 0; opcode < 65536; opcode++)
-		cpufunctbl[opcode] = op_illg_1;
-	for (i = 0; tbl[i].handler != NULL; i++) {
-		opcode = tbl[i].opcode;
-		cpufunctbl[opcode] = tbl[i].handler;
-	}
-
-	opcnt = 0;
-	for (opcode = 0; opcode < 65536; opcode++) {
-		cpuop_func *f;
-
-		if (table68k[opcode].mnemo == i_ILLG)
-			continue;
-		if (table68k[opcode].clev > lvl) {
-			continue;
-		}
-
-		if (table68k[opcode].handler != -1) {
-			int idx = table68k[opcode].handler;
-			f = cpufunctbl[idx];
-			if (f == op_illg_1)
-				abort ();
-			cpufunctbl[opcode] = f;
-			opcnt++;
-		}
-	}
+	opcnt = build_cpufunctbl_from (cpufunctbl, tbl, lvl);
+#ifdef CPUEMU_34
+	if (currprefs.cpu_model == 68030)
+		build_cpufunctbl_from (cpufunctbl_nommu030, op_smalltbl_34_ff, lvl);
+#endif
+	m68k_set_mmu030_translation (true);
 	write_log ("Building CPU, %d opcodes (%d %d %d)\n",
 		opcnt, lvl,
 		currprefs.cpu_cycle_exact ? -1 : currprefs.cpu_compatible ? 1 : 0, currprefs.address_space_24);
@@ -1804,10 +1836,31 @@ void NMI (void)
 	do_interrupt (7, false);
 }
 
+/* Previous: the interrupt level is only recomputed by sysReg.c when the
+ * interrupt status, mask or timer IPL changes. It then raises SPCFLAG_INT.
+ * The flag is cleared as long as no interrupt can be taken, also while the
+ * pending one is masked. MakeFromSR raises it again when the mask changes.
+ */
+static int lastintr;
+
+STATIC_INLINE void do_interrupt_check (void)
+{
+	int intr = intlev ();
+
+	if (intr > regs.intmask || (intr == 7 && intr > lastintr))
+		do_interrupt (intr, false);
+	else
+		unset_special (SPCFLAG_INT | SPCFLAG_DOINT);
+	lastintr = intr;
+}
+
 void m68k_reset (int hardreset)
 {
     regs.spcflags &= (SPCFLAG_MODE_CHANGE | SPCFLAG_BRK);
 	regs.ipl = regs.ipl_pin = 0;
+	lastintr = 0;
+	/* re-evaluate interrupts that are still pending after the reset */
+	set_special (SPCFLAG_INT);
 #ifdef SAVESTATE
 	if (savestate_state == STATE_RESTORE || savestate_state == STATE_REWIND) {
 		m68k_setpc (regs.pc);
@@ -2101,7 +2154,11 @@ STATIC_INLINE int do_specialties (int cycles)
 			return 1;
 	
 		do_cycles (currprefs.cpu_cycle_exact ? 2 * CYCLE_UNIT : 4 * CYCLE_UNIT);
-		M68000_AddCycles(cpu_cycles * 2 / CYCLE_UNIT);
+		/* Previous: nothing can happen before the next event, skip to it */
+		if (bCpuIdleSkip)
+			M68000_SkipIdleCycles();
+		else
+			M68000_AddCycles(cpu_cycles * 2 / CYCLE_UNIT);
 
 	    /* It is possible one or more ints happen at the same time */
 	    /* We must process them during the same cpu cycle until the special INT flag is set */
@@ -2127,15 +2184,8 @@ STATIC_INLINE int do_specialties (int cycles)
 					do_interrupt (regs.ipl, true);
 			}
 		} else {
-#if 0
-			if (regs.spcflags & (SPCFLAG_INT | SPCFLAG_DOINT)) {
-				int intr = intlev ();
-				unset_special (SPCFLAG_INT | SPCFLAG_DOINT);
-				if (intr > 0 && intr > regs.intmask)
-						do_interrupt (intr, true);
-			}
-#endif
-
+			if (regs.spcflags & (SPCFLAG_INT | SPCFLAG_DOINT))
+				do_interrupt_check ();
 		}
 		if ((regs.spcflags & (SPCFLAG_BRK | SPCFLAG_MODE_CHANGE))) {
 			unset_special (SPCFLAG_BRK | SPCFLAG_MODE_CHANGE);
@@ -2176,19 +2226,8 @@ STATIC_INLINE int do_specialties (int cycles)
 			do_interrupt (regs.ipl, true);
 		}
 	} else {
-#if 0
-		if (regs.spcflags & SPCFLAG_INT) {
-			int intr = intlev ();
-			unset_special (SPCFLAG_INT | SPCFLAG_DOINT);
-			if (intr > 0 && (intr > regs.intmask || intr == 7))
-				do_interrupt (intr, false);		/* call do_interrupt() with Pending=false, not necessarily true but harmless */
-		}
-#endif
-	}
-
-	if (regs.spcflags & SPCFLAG_DOINT) {
-		unset_special (SPCFLAG_DOINT);
-		set_special (SPCFLAG_INT);
+		if (regs.spcflags & (SPCFLAG_INT | SPCFLAG_DOINT))
+			do_interrupt_check ();
 	}
 
 	if ( do_specialties_interrupt(false) ) {	/* test if there's an interrupt and add non pending jitter */
@@ -2449,8 +2488,6 @@ static void m68k_run_mmu030 (void)
 	uaecptr pc;
 	struct flag_struct f;
 	m68k_exception save_except;
-    int intr = 0;
-    int lastintr = 0;
 
 	mmu030_opcode_stageb = -1;
 retry:
@@ -2481,7 +2518,7 @@ insretry:
 				count_instr (opcode);
 				do_cycles (cpu_cycles);
 				mmu030_retry = false;
-				cpu_cycles = (*cpufunctbl[opcode])(opcode);
+				cpu_cycles = (*cpufunctbl030[opcode])(opcode);
 				cnt--; // so that we don't get in infinite loop if things go horribly wrong
 				if (!mmu030_retry)
 					break;
@@ -2495,7 +2532,19 @@ insretry:
 
 			mmu030_opcode = -1;
 
-			M68000_AddCycles(cpu_cycles * 2 / CYCLE_UNIT);
+			M68000_AddCyclesBatched(cpu_cycles * 2 / CYCLE_UNIT);
+
+			/* Previous: the guest is spinning in its idle loop, skip to the next event */
+			if (pc == nCpuIdleLoopPC) {
+				M68000_SyncCycles();
+				M68000_SkipIdleCycles();
+			}
+
+			/* Previous: cycles are only applied to the cycle counters when the next */
+			/* interrupt event is due or when a special condition has to be handled */
+			if (!M68000_BatchDone() && !regs.spcflags)
+				continue;
+			M68000_SyncCycles();
 
 			if (regs.spcflags & SPCFLAG_EXTRA_CYCLES) {
 				/* Add some extra cycles to simulate a wait state */
@@ -2514,16 +2563,6 @@ insretry:
 				do_specialties_interrupt(false);		/* test if there's an mfp/video interrupt and add non pending jitter */
 			}
 
-            /* Previous: for now we poll the interrupt pins with every instruction.
-             * TODO: only do this when an actual interrupt is active to not
-             * unneccessarily slow down emulation.
-             */
-            intr = intlev ();
-            if (intr>regs.intmask || (intr==7 && intr>lastintr)) {
-                do_interrupt (intr, false);
-            }
-            lastintr = intr;
-
 			if (regs.spcflags) {
 				if (do_specialties (cpu_cycles* 2 / CYCLE_UNIT))
 					return;
@@ -2564,8 +2603,6 @@ static void m68k_run_mmu040 (void)
 	struct flag_struct f;
 	uaecptr pc;
 	m68k_exception save_except;
-    int intr = 0;
-    int lastintr = 0;
 	
 	for (;;) {
 	TRY (prb) {
@@ -2582,7 +2619,19 @@ static void m68k_run_mmu040 (void)
 			count_instr (opcode);
 			cpu_cycles = (*cpufunctbl[opcode])(opcode);
 
-			M68000_AddCycles(cpu_cycles * 2 / CYCLE_UNIT);
+			M68000_AddCyclesBatched(cpu_cycles * 2 / CYCLE_UNIT);
+
+			/* Previous: the guest is spinning in its idle loop, skip to the next event */
+			if (pc == nCpuIdleLoopPC) {
+				M68000_SyncCycles();
+				M68000_SkipIdleCycles();
+			}
+
+			/* Previous: cycles are only applied to the cycle counters when the next */
+			/* interrupt event is due or when a special condition has to be handled */
+			if (!M68000_BatchDone() && !regs.spcflags)
+				continue;
+			M68000_SyncCycles();
 
 			if (regs.spcflags & SPCFLAG_EXTRA_CYCLES) {
 				/* Add some extra cycles to simulate a wait state */
@@ -2601,17 +2650,6 @@ static void m68k_run_mmu040 (void)
 				do_specialties_interrupt(false);		/* test if there's an mfp/video interrupt and add non pending jitter */
 			}
 
-            /* Previous: for now we poll the interrupt pins with every instruction.
-             * TODO: only do this when an actual interrupt is active to not
-             * unneccessarily slow down emulation.
-             */
-            intr = intlev ();
-            if (intr>regs.intmask || (intr==7 && intr>lastintr)) {
-                do_interrupt (intr, false);
-            }
-            lastintr = intr;
-            
-            
 			if (regs.spcflags) {
 				if (do_specialties (cpu_cycles* 2 / CYCLE_UNIT))
 					return;
@@ -498,6 +498,7 @@ extern const struct cputbl op_smalltbl_31_ff[]; // MMU
 extern const struct cputbl op_smalltbl_2_ff[];
 extern const struct cputbl op_smalltbl_24_ff[]; // CE
 extern const struct cputbl op_smalltbl_32_ff[]; // MMU
+extern const struct cputbl op_smalltbl_34_ff[]; // MMU, translation disabled
 /* 68020 */
 extern const struct cputbl op_smalltbl_3_ff[];
 extern const struct cputbl op_smalltbl_20_ff[]; // prefetch
@@ -515,6 +516,7 @@ extern cpuop_func *cpufunctbl[65536] ASM_SYM_FOR_FUNC ("cpufunctbl");
 
 /* Added for hatari_glue.c */
 extern void build_cpufunctbl(void);
+extern void m68k_set_mmu030_translation(bool enabled);
 
 #ifdef JIT
 extern void flush_icache (uaecptr, int);
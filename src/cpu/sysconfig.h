@@ -56,6 +56,7 @@
 #define CPUEMU_21 /* 68030 (040/060) "cycle-exact" + blitter */
 #define CPUEMU_31 /* 68040 Aranym MMU */
 #define CPUEMU_32 /* 68030 with MMU */
+#define CPUEMU_34 /* 68030 with MMU, translation disabled */
 //#define ACTION_REPLAY /* Action Replay 1/2/3 support */
 #define PICASSO96 /* Picasso96 display card emulation */
 #define UAEGFX_INTERNAL /* built-in libs:picasso96/uaegfx.card */
@@ -5,12 +5,19 @@
   your option any later version. Read the file gpl.txt for details.
 
   This code handles our table with callbacks for cycle accurate program
-  interruption. We add any pending callback handler into a table so that we do
-  not need to test for every possible interrupt event. We then scan
-  the list if used entries in the table and copy the one with the least cycle
-  count into the global 'PendingInterruptCount' variable. This is then
-  decremented by the execution loop - rather than decrement each and every
-  entry (as the others cannot occur before this one).
+  interruption. Each pending callback handler gets an absolute 64 bit deadline
+  and is kept in a binary min-heap ordered by that deadline, so adding and
+  removing an event is O(log n) and the next event is always at the top of
+  the heap. The distance to the next event is copied into the global
+  'PendingInterruptCount' variable. This is then decremented by the execution
+  loop - the deadlines themselves never have to be rebased. The current time
+  is the deadline of the next event minus 'PendingInterruptCount'.
+  Devices register their handler functions at reset with
+  CycInt_RegisterHandler, using the stable IDs from 'interrupt_id' (these IDs
+  are also what is stored in memory snapshots).
+  The execution loop batches the cycles of several instructions and only
+  applies them when the next interrupt is due or when the counters are read
+  (see M68000_SyncCycles), so all functions here sync first.
   We have two methods of adding interrupts; Absolute and Relative.
   Absolute will set values from the time of the previous interrupt (e.g., add
   HBL every 512 cycles), and Relative will add from the current cycle time.
@@ -55,190 +62,262 @@ const char CycInt_fileid[] = "Hatari cycInt.c : " __DATE__ " " __TIME__;
 #include "memorySnapShot.h"
 #include "screen.h"
 #include "video.h"
-#include "sysReg.h"
-#include "esp.h"
-#include "mo.h"
-#include "ethernet.h"
-#include "dma.h"
 
 
 void (*PendingInterruptFunction)(void);
 int PendingInterruptCount;
 
-static int nCyclesOver;
-
-/* List of possible interrupt handlers to be store in 'PendingInterruptTable',
- * used for 'MemorySnapShot' */
-static void (* const pIntHandlerFunctions[MAX_INTERRUPTS])(void) =
-{
-	NULL,
-	Video_InterruptHandler_VBL,
-	Hardclock_InterruptHandler,
-    ESP_InterruptHandler,
-    ESP_IO_Handler,
-    M2RDMA_InterruptHandler,
-    R2MDMA_InterruptHandler,
-    MO_InterruptHandler,
-    MO_IO_Handler,
-    ECC_IO_Handler,
-    ENET_IO_Handler
-};
-
-/* Event timer structure - keeps next timer to occur in structure so don't need
- * to check all entries */
+/* Event timer structure - one entry per interrupt ID, the used entries are
+ * linked into the heap by 'HeapPos' */
 typedef struct
 {
 	bool bUsed;                   /* Is interrupt active? */
-	Sint64 Cycles;
+	Sint64 Deadline;              /* Absolute time of the interrupt */
+	Sint64 Remaining;             /* Cycles left when the interrupt was stopped */
+	int HeapPos;                  /* Index in 'InterruptHeap' if active */
 	void (*pFunction)(void);
 } INTERRUPTHANDLER;
 
 static INTERRUPTHANDLER InterruptHandlers[MAX_INTERRUPTS];
-static int ActiveInterrupt=0;
+static interrupt_id InterruptHeap[MAX_INTERRUPTS];
+static int nHeapSize;
+
+static interrupt_id ActiveInterrupt = INTERRUPT_NULL;
+static Sint64 NextInterruptTime;  /* Absolute time 'PendingInterruptCount' counts down to */
+static Sint64 LastInterruptTime;  /* Deadline of the last acknowledged interrupt */
+
+static void CycInt_SetNewInterrupt(Sint64 Now);
 
-static void CycInt_SetNewInterrupt(void);
 
 /*-----------------------------------------------------------------------*/
 /**
- * Reset interrupts, handlers
+ * Return the current time in internal cycles. The batched CPU cycles must
+ * have been applied with M68000_SyncCycles before.
  */
-void CycInt_Reset(void)
+static inline Sint64 CycInt_Now(void)
 {
-	int i;
+	return NextInterruptTime - PendingInterruptCount;
+}
 
-	/* Reset counts */
-	PendingInterruptCount = 0;
-	ActiveInterrupt = 0;
-	nCyclesOver = 0;
 
-	/* Reset interrupt table */
-	for (i=0; i<MAX_INTERRUPTS; i++)
+/*-----------------------------------------------------------------------*/
+/**
+ * Heap helpers: entries are ordered by deadline, then by ID so that
+ * interrupts due at the same time are always processed in the same order.
+ */
+static inline bool CycInt_HeapLess(interrupt_id a, interrupt_id b)
+{
+	if (InterruptHandlers[a].Deadline != InterruptHandlers[b].Deadline)
+		return InterruptHandlers[a].Deadline < InterruptHandlers[b].Deadline;
+	return a < b;
+}
+
+static inline void CycInt_HeapSet(int pos, interrupt_id Handler)
+{
+	InterruptHeap[pos] = Handler;
+	InterruptHandlers[Handler].HeapPos = pos;
+}
+
+static void CycInt_HeapSiftUp(int pos)
+{
+	interrupt_id Handler = InterruptHeap[pos];
+
+	while (pos > 0)
 	{
-		InterruptHandlers[i].bUsed = false;
-		InterruptHandlers[i].Cycles = INT_MAX;
-		InterruptHandlers[i].pFunction = pIntHandlerFunctions[i];
+		int parent = (pos - 1) / 2;
+		if (!CycInt_HeapLess(Handler, InterruptHeap[parent]))
+			break;
+		CycInt_HeapSet(pos, InterruptHeap[parent]);
+		pos = parent;
 	}
+	CycInt_HeapSet(pos, Handler);
+}
+
+static void CycInt_HeapSiftDown(int pos)
+{
+	interrupt_id Handler = InterruptHeap[pos];
+
+	for (;;)
+	{
+		int child = 2 * pos + 1;
+		if (child >= nHeapSize)
+			break;
+		if (child + 1 < nHeapSize && CycInt_HeapLess(InterruptHeap[child+1], InterruptHeap[child]))
+			child++;
+		if (!CycInt_HeapLess(InterruptHeap[child], Handler))
+			break;
+		CycInt_HeapSet(pos, InterruptHeap[child]);
+		pos = child;
+	}
+	CycInt_HeapSet(pos, Handler);
+}
+
+/**
+ * Insert an interrupt into the heap or move it after its deadline changed
+ */
+static void CycInt_HeapUpdate(interrupt_id Handler)
+{
+	int pos;
+
+	if (!InterruptHandlers[Handler].bUsed)
+	{
+		InterruptHandlers[Handler].bUsed = true;
+		pos = nHeapSize++;
+		CycInt_HeapSet(pos, Handler);
+	}
+	else
+	{
+		pos = InterruptHandlers[Handler].HeapPos;
+	}
+	CycInt_HeapSiftUp(pos);
+	CycInt_HeapSiftDown(InterruptHandlers[Handler].HeapPos);
+}
+
+/**
+ * Remove an interrupt from the heap
+ */
+static void CycInt_HeapRemove(interrupt_id Handler)
+{
+	int pos = InterruptHandlers[Handler].HeapPos;
+	interrupt_id Last;
+
+	InterruptHandlers[Handler].bUsed = false;
+	InterruptHandlers[Handler].HeapPos = -1;
+
+	nHeapSize--;
+	if (pos == nHeapSize)
+		return;
+
+	/* Move the last entry into the hole */
+	Last = InterruptHeap[nHeapSize];
+	CycInt_HeapSet(pos, Last);
+	CycInt_HeapSiftUp(pos);
+	CycInt_HeapSiftDown(InterruptHandlers[Last].HeapPos);
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
- * Convert interrupt handler function pointer to ID, used for saving
+ * Reset interrupts. The registered handler functions are kept.
  */
-static int CycInt_HandlerFunctionToID(void (*pHandlerFunction)(void))
+void CycInt_Reset(void)
 {
 	int i;
 
-	/* Scan for function match */
+	/* Reset counts */
+	M68000_SyncCycles();
+	PendingInterruptCount = 0;
+	ActiveInterrupt = INTERRUPT_NULL;
+	NextInterruptTime = 0;
+	LastInterruptTime = 0;
+
+	/* Reset interrupt table */
+	nHeapSize = 0;
 	for (i=0; i<MAX_INTERRUPTS; i++)
 	{
-		if (pIntHandlerFunctions[i]==pHandlerFunction)
-			return i;
+		InterruptHandlers[i].bUsed = false;
+		InterruptHandlers[i].Deadline = 0;
+		InterruptHandlers[i].Remaining = INT_MAX;
+		InterruptHandlers[i].HeapPos = -1;
 	}
 
-	/* Didn't find one! Oops */
-	fprintf(stderr, "\nError: didn't find interrupt function matching 0x%p\n",
-	        pHandlerFunction);
-	return 0;
+	CycInt_SetNewInterrupt(0);
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
- * Convert ID back into interrupt handler function, used for restoring
+ * Register the handler function for an interrupt ID. Devices call this
+ * when they are reset, before adding any interrupt with this ID.
  */
-static void *CycInt_IDToHandlerFunction(int ID)
+void CycInt_RegisterHandler(interrupt_id Handler, void (*pFunction)(void))
 {
-	/* Get function pointer */
-	return pIntHandlerFunctions[ID];
+	assert(Handler > INTERRUPT_NULL && Handler < MAX_INTERRUPTS);
+
+	InterruptHandlers[Handler].pFunction = pFunction;
+
+	/* The handler might be the next one to be called */
+	if (Handler == ActiveInterrupt)
+		PendingInterruptFunction = pFunction;
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
  * Save/Restore snapshot of local variables('MemorySnapShot_Store' handles type)
+ * Only the interrupt IDs are stored, the handler functions are those
+ * registered by the devices.
  */
 void CycInt_MemorySnapShot_Capture(bool bSave)
 {
-	int i,ID;
+	int i;
+	Sint64 Now;
+
+	/* Apply cycles of the current instruction block first */
+	M68000_SyncCycles();
+	Now = CycInt_Now();
 
 	/* Save/Restore details */
 	for (i=0; i<MAX_INTERRUPTS; i++)
 	{
 		MemorySnapShot_Store(&InterruptHandlers[i].bUsed, sizeof(InterruptHandlers[i].bUsed));
-		MemorySnapShot_Store(&InterruptHandlers[i].Cycles, sizeof(InterruptHandlers[i].Cycles));
-		if (bSave)
-		{
-			/* Convert function to ID */
-			ID = CycInt_HandlerFunctionToID(InterruptHandlers[i].pFunction);
-			MemorySnapShot_Store(&ID, sizeof(int));
-		}
-		else
-		{
-			/* Convert ID to function */
-			MemorySnapShot_Store(&ID, sizeof(int));
-			InterruptHandlers[i].pFunction = CycInt_IDToHandlerFunction(ID);
-		}
+		MemorySnapShot_Store(&InterruptHandlers[i].Deadline, sizeof(InterruptHandlers[i].Deadline));
+		MemorySnapShot_Store(&InterruptHandlers[i].Remaining, sizeof(InterruptHandlers[i].Remaining));
 	}
-	MemorySnapShot_Store(&nCyclesOver, sizeof(nCyclesOver));
-	MemorySnapShot_Store(&PendingInterruptCount, sizeof(PendingInterruptCount));
-	if (bSave)
-	{
-		/* Convert function to ID */
-		ID = CycInt_HandlerFunctionToID(PendingInterruptFunction);
-		MemorySnapShot_Store(&ID, sizeof(int));
-	}
-	else
-	{
-		/* Convert ID to function */
-		MemorySnapShot_Store(&ID, sizeof(int));
-		PendingInterruptFunction = CycInt_IDToHandlerFunction(ID);
-	}
-
+	MemorySnapShot_Store(&LastInterruptTime, sizeof(LastInterruptTime));
+	MemorySnapShot_Store(&Now, sizeof(Now));
 
 	if (!bSave)
-		CycInt_SetNewInterrupt();	/* when restoring snapshot, compute current state after */
+	{
+		/* Rebuild the heap from the restored entries */
+		nHeapSize = 0;
+		for (i=0; i<MAX_INTERRUPTS; i++)
+		{
+			InterruptHandlers[i].HeapPos = -1;
+			if (InterruptHandlers[i].bUsed)
+			{
+				InterruptHandlers[i].bUsed = false;
+				CycInt_HeapUpdate(i);
+			}
+		}
+		/* when restoring snapshot, compute current state after */
+		CycInt_SetNewInterrupt(Now);
+	}
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
- * Find next interrupt to occur, and store to global variables for decrement
- * in instruction decode loop.
- * Note: Although InterruptHandlers.Cycles and LowestCycleCount are 64 bit
- * variables to get all the cycle counters right (e.g. the DMA sound counter
- * can get very high), PendingInterruptCount is still a 32 bit variable for
- * performance reasons (it's decremented after each CPU instruction).
- * So we have to initialize LowestCycleCount with INT_MAX, not with INT64_MAX!
- * Since there is always a VBL or HBL counter pending which fits fine into the
- * 32 bit variable, we can be sure that we don't run into problems here.
+ * Take the next interrupt to occur from the top of the heap, and store it to
+ * global variables for decrement in instruction decode loop.
+ * Note: Although the deadlines are 64 bit variables, PendingInterruptCount
+ * is still a 32 bit variable for performance reasons (it's decremented after
+ * each CPU instruction). So it is limited to INT_MAX. Since there is always
+ * a VBL pending which fits fine into the 32 bit variable, we can be sure
+ * that we don't run into problems here.
  */
-static void CycInt_SetNewInterrupt(void)
+static void CycInt_SetNewInterrupt(Sint64 Now)
 {
-	Sint64 LowestCycleCount = INT_MAX;
-	interrupt_id LowestInterrupt = INTERRUPT_NULL, i;
+	Sint64 Count = INT_MAX;
 
 	LOG_TRACE(TRACE_INT, "int set new in video_cyc=%d active_int=%d pending_count=%d\n",
 	          Cycles_GetCounter(CYCLES_COUNTER_VIDEO), ActiveInterrupt, PendingInterruptCount);
 
-	/* Find next interrupt to go off */
-	for (i = INTERRUPT_NULL+1; i < MAX_INTERRUPTS; i++)
+	if (nHeapSize > 0)
 	{
-		/* Is interrupt pending? */
-		if (InterruptHandlers[i].bUsed)
-		{
-			if (InterruptHandlers[i].Cycles < LowestCycleCount)
-			{
-				LowestCycleCount = InterruptHandlers[i].Cycles;
-				LowestInterrupt = i;
-			}
-		}
+		ActiveInterrupt = InterruptHeap[0];
+		if (InterruptHandlers[ActiveInterrupt].Deadline - Now < Count)
+			Count = InterruptHandlers[ActiveInterrupt].Deadline - Now;
+	}
+	else
+	{
+		ActiveInterrupt = INTERRUPT_NULL;
 	}
 
 	/* Set new counts, active interrupt */
-	PendingInterruptCount = InterruptHandlers[LowestInterrupt].Cycles;
-	PendingInterruptFunction = InterruptHandlers[LowestInterrupt].pFunction;
-	ActiveInterrupt = LowestInterrupt;
+	PendingInterruptCount = Count;
+	PendingInterruptFunction = InterruptHandlers[ActiveInterrupt].pFunction;
+	NextInterruptTime = Now + Count;
 
 	LOG_TRACE(TRACE_INT, "int set new out video_cyc=%d active_int=%d pending_count=%d\n",
 	               Cycles_GetCounter(CYCLES_COUNTER_VIDEO), ActiveInterrupt, PendingInterruptCount );
@@ -247,49 +326,29 @@ static void CycInt_SetNewInterrupt(void)
 
 /*-----------------------------------------------------------------------*/
 /**
- * Adjust all interrupt timings, MUST call CycInt_SetNewInterrupt after this.
+ * Remove 'ActiveInterrupt' from the heap as it has occured, and set the
+ * next interrupt.
  */
-static void CycInt_UpdateInterrupt(void)
+void CycInt_AcknowledgeInterrupt(void)
 {
-	Sint64 CycleSubtract;
-	int i;
+	Sint64 Now;
 
-	/* Find out how many cycles we went over (<=0) */
-	nCyclesOver = PendingInterruptCount;
-	/* Calculate how many cycles have passed, included time we went over */
-	CycleSubtract = InterruptHandlers[ActiveInterrupt].Cycles - nCyclesOver;
+	/* Apply cycles of the current instruction block first */
+	M68000_SyncCycles();
+	Now = CycInt_Now();
 
-	/* Adjust table */
-	for (i = 0; i < MAX_INTERRUPTS; i++)
+	/* Disable interrupt entry which has just occured */
+	if (ActiveInterrupt != INTERRUPT_NULL && InterruptHandlers[ActiveInterrupt].bUsed)
 	{
-		if (InterruptHandlers[i].bUsed)
-			InterruptHandlers[i].Cycles -= CycleSubtract;
+		LastInterruptTime = InterruptHandlers[ActiveInterrupt].Deadline;
+		CycInt_HeapRemove(ActiveInterrupt);
 	}
 
-	LOG_TRACE(TRACE_INT, "int upd video_cyc=%d cycle_over=%d cycle_sub=%lld\n",
-	          Cycles_GetCounter(CYCLES_COUNTER_VIDEO), nCyclesOver,
-	          (long long)CycleSubtract);
-}
-
-
-/*-----------------------------------------------------------------------*/
-/**
- * Adjust all interrupt timings as 'ActiveInterrupt' has occured, and
- * remove from active list.
- */
-void CycInt_AcknowledgeInterrupt(void)
-{
-	/* Update list cycle counts */
-	CycInt_UpdateInterrupt();
-
-	/* Disable interrupt entry which has just occured */
-	InterruptHandlers[ActiveInterrupt].bUsed = false;
-
 	/* Set new */
-	CycInt_SetNewInterrupt();
+	CycInt_SetNewInterrupt(Now);
 
-	LOG_TRACE(TRACE_INT, "int ack video_cyc=%d active_int=%d active_cyc=%d pending_count=%d\n",
-	               Cycles_GetCounter(CYCLES_COUNTER_VIDEO), ActiveInterrupt, (int)InterruptHandlers[ActiveInterrupt].Cycles, PendingInterruptCount );
+	LOG_TRACE(TRACE_INT, "int ack video_cyc=%d active_int=%d pending_count=%d\n",
+	               Cycles_GetCounter(CYCLES_COUNTER_VIDEO), ActiveInterrupt, PendingInterruptCount );
 }
 
 
@@ -301,20 +360,17 @@ void CycInt_AddAbsoluteInterrupt(int CycleTime, int CycleType, interrupt_id Hand
 {
 	assert(CycleTime >= 0);
 
-	/* Update list cycle counts with current PendingInterruptCount before adding a new int, */
-	/* because CycInt_SetNewInterrupt can change the active int / PendingInterruptCount */
-	if ( ActiveInterrupt > 0 )
-		CycInt_UpdateInterrupt();
+	M68000_SyncCycles();
 
-	InterruptHandlers[Handler].bUsed = true;
-	InterruptHandlers[Handler].Cycles = INT_CONVERT_TO_INTERNAL((Sint64)CycleTime , CycleType) + nCyclesOver;
+	InterruptHandlers[Handler].Deadline = LastInterruptTime + INT_CONVERT_TO_INTERNAL((Sint64)CycleTime , CycleType);
+	CycInt_HeapUpdate(Handler);
 
 	/* Set new active int and compute a new value for PendingInterruptCount*/
-	CycInt_SetNewInterrupt();
+	CycInt_SetNewInterrupt(CycInt_Now());
 
 	LOG_TRACE(TRACE_INT, "int add abs video_cyc=%d handler=%d handler_cyc=%lld pending_count=%d\n",
 	          Cycles_GetCounter(CYCLES_COUNTER_VIDEO), Handler,
-	          (long long)InterruptHandlers[Handler].Cycles, PendingInterruptCount );
+	          (long long)InterruptHandlers[Handler].Deadline, PendingInterruptCount );
 }
 
 
@@ -341,22 +397,22 @@ void CycInt_AddRelativeInterrupt(int CycleTime, int CycleType, interrupt_id Hand
  */
 void CycInt_AddRelativeInterruptWithOffset(int CycleTime, int CycleType, interrupt_id Handler, int CycleOffset)
 {
+	Sint64 Now;
+
 	assert(CycleTime >= 0);
 
-	/* Update list cycle counts with current PendingInterruptCount before adding a new int, */
-	/* because CycInt_SetNewInterrupt can change the active int / PendingInterruptCount */
-	if ( ActiveInterrupt > 0 )
-		CycInt_UpdateInterrupt();
+	M68000_SyncCycles();
+	Now = CycInt_Now();
 
-	InterruptHandlers[Handler].bUsed = true;
-	InterruptHandlers[Handler].Cycles = INT_CONVERT_TO_INTERNAL((Sint64)CycleTime , CycleType) + CycleOffset;
+	InterruptHandlers[Handler].Deadline = Now + INT_CONVERT_TO_INTERNAL((Sint64)CycleTime , CycleType) + CycleOffset;
+	CycInt_HeapUpdate(Handler);
 
 	/* Set new active int and compute a new value for PendingInterruptCount*/
-	CycInt_SetNewInterrupt();
+	CycInt_SetNewInterrupt(Now);
 
 	LOG_TRACE(TRACE_INT, "int add rel offset video_cyc=%d handler=%d handler_cyc=%lld offset_cyc=%d pending_count=%d\n",
 	          Cycles_GetCounter(CYCLES_COUNTER_VIDEO), Handler,
-	          (long long)InterruptHandlers[Handler].Cycles, CycleOffset, PendingInterruptCount);
+	          (long long)InterruptHandlers[Handler].Deadline, CycleOffset, PendingInterruptCount);
 }
 
 
@@ -366,19 +422,24 @@ void CycInt_AddRelativeInterruptWithOffset(int CycleTime, int CycleType, interru
  */
 void CycInt_RemovePendingInterrupt(interrupt_id Handler)
 {
-	/* Update list cycle counts, including the handler we want to remove */
-	/* to be able to resume it later (for MFP timers) */
-	CycInt_UpdateInterrupt();
+	Sint64 Now;
 
-	/* Stop interrupt after CycInt_UpdateInterrupt, for CycInt_ResumeStoppedInterrupt */
-	InterruptHandlers[Handler].bUsed = false;
+	M68000_SyncCycles();
+	Now = CycInt_Now();
+
+	if (InterruptHandlers[Handler].bUsed)
+	{
+		/* Keep the cycles left to be able to resume it later (for MFP timers) */
+		InterruptHandlers[Handler].Remaining = InterruptHandlers[Handler].Deadline - Now;
+		CycInt_HeapRemove(Handler);
+	}
 
 	/* Set new */
-	CycInt_SetNewInterrupt();
+	CycInt_SetNewInterrupt(Now);
 
 	LOG_TRACE(TRACE_INT, "int remove pending video_cyc=%d handler=%d handler_cyc=%lld pending_count=%d\n",
 	          Cycles_GetCounter(CYCLES_COUNTER_VIDEO), Handler,
-	          (long long)InterruptHandlers[Handler].Cycles, PendingInterruptCount);
+	          (long long)InterruptHandlers[Handler].Remaining, PendingInterruptCount);
 }
 
 
@@ -388,17 +449,24 @@ void CycInt_RemovePendingInterrupt(interrupt_id Handler)
  */
 void CycInt_ResumeStoppedInterrupt(interrupt_id Handler)
 {
+	Sint64 Now;
+
+	M68000_SyncCycles();
+	Now = CycInt_Now();
+
 	/* Restart interrupt */
-	InterruptHandlers[Handler].bUsed = true;
+	if (!InterruptHandlers[Handler].bUsed)
+	{
+		InterruptHandlers[Handler].Deadline = Now + InterruptHandlers[Handler].Remaining;
+		CycInt_HeapUpdate(Handler);
+	}
 
-	/* Update list cycle counts */
-	CycInt_UpdateInterrupt();
 	/* Set new */
-	CycInt_SetNewInterrupt();
+	CycInt_SetNewInterrupt(Now);
 
 	LOG_TRACE(TRACE_INT, "int resume stopped video_cyc=%d handler=%d handler_cyc=%lld pending_count=%d\n",
 	          Cycles_GetCounter(CYCLES_COUNTER_VIDEO), Handler,
-	          (long long)InterruptHandlers[Handler].Cycles, PendingInterruptCount);
+	          (long long)InterruptHandlers[Handler].Deadline, PendingInterruptCount);
 }
 
 
@@ -418,18 +486,34 @@ bool CycInt_InterruptActive(interrupt_id Handler)
 
 /*-----------------------------------------------------------------------*/
 /**
- * Return cycles passed for an interrupt handler
+ * Return the current time in internal cycles, for devices that need to
+ * remember absolute deadlines of their own.
+ */
+Sint64 CycInt_GetTime(void)
+{
+	M68000_SyncCycles();
+	return CycInt_Now();
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Return cycles left until an interrupt handler will be called
  */
 int CycInt_FindCyclesPassed(interrupt_id Handler, int CycleType)
 {
-	Sint64 CyclesPassed, CyclesFromLastInterrupt;
+	Sint64 CyclesPassed;
 
-	CyclesFromLastInterrupt = InterruptHandlers[ActiveInterrupt].Cycles - PendingInterruptCount;
-	CyclesPassed = InterruptHandlers[Handler].Cycles - CyclesFromLastInterrupt;
+	M68000_SyncCycles();
+
+	if (InterruptHandlers[Handler].bUsed)
+		CyclesPassed = InterruptHandlers[Handler].Deadline - CycInt_Now();
+	else
+		CyclesPassed = InterruptHandlers[Handler].Remaining;
 
-	LOG_TRACE(TRACE_INT, "int find passed cyc video_cyc=%d handler=%d last_cyc=%lld passed_cyc=%lld\n",
+	LOG_TRACE(TRACE_INT, "int find passed cyc video_cyc=%d handler=%d passed_cyc=%lld\n",
 	          Cycles_GetCounter(CYCLES_COUNTER_VIDEO), Handler,
-	          (long long)CyclesFromLastInterrupt, (long long)CyclesPassed);
+	          (long long)CyclesPassed);
 
 	return INT_CONVERT_FROM_INTERNAL ( CyclesPassed , CycleType ) ;
 }
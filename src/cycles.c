@@ -48,6 +48,8 @@ int CurrentInstrCycles;
  */
 void Cycles_MemorySnapShot_Capture(bool bSave)
 {
+	M68000_SyncCycles();
+
 	/* Save/Restore details */
 	MemorySnapShot_Store(&nCyclesMainCounter, sizeof(nCyclesMainCounter));
 	MemorySnapShot_Store(nCyclesCounter, sizeof(nCyclesCounter));
@@ -63,6 +65,8 @@ static void Cycles_UpdateCounters(void)
 {
 	int i;
 
+	M68000_SyncCycles();
+
 	for (i = 0; i < CYCLES_COUNTER_MAX; i++)
 	{
 		nCyclesCounter[i] += nCyclesMainCounter;
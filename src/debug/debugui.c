@@ -288,6 +288,8 @@ static int DebugUI_DoMemorySnap(int argc, char *argv[])
 
 	if (strcmp(argv[0], "stateload") == 0)
 		MemorySnapShot_Restore(file, true);
+	else if (strcmp(argv[0], "statedelta") == 0)
+		MemorySnapShot_CaptureDelta(file, true);
 	else
 		MemorySnapShot_Capture(file, true);
 
@@ -823,6 +825,14 @@ static const dbgcommand_t uicommand[] =
 	  "[filename]\n"
 	  "\tSave emulation snapshot to default or given file",
 	  false },
+	{ DebugUI_DoMemorySnap, NULL,
+	  "statedelta", "",
+	  "save emulation state as delta",
+	  "[filename]\n"
+	  "\tSave emulation snapshot to default or given file, with only the\n"
+	  "\tmemory changed since the last snapshot saved or restored. That\n"
+	  "\tsnapshot is needed for restoring the delta and must be kept.",
+	  false },
 	{ DebugUI_SetTracing, Log_MatchTrace,
 	  "trace", "t",
 	  "select Hatari tracing settings",
@@ -0,0 +1,383 @@
+/*
+  Previous - diskIO.c
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+
+  Disk I/O thread
+
+  The SCSI and MO emulation hand their disk image accesses to a worker
+  thread, so that slow host I/O does not stall the emulation. Requests are
+  passed through two single producer, single consumer rings: the emulation
+  thread puts requests into the submission ring, the worker takes them out
+  in order, performs them and puts them into the completion ring. Finished
+  requests are picked up by a cycle interrupt. Each request has its own
+  deadline, given by the latency the device models for the access, and the
+  interrupt is scheduled for the earliest one. A request is completed when
+  its deadline has passed and the host has finished it; if the host is
+  late, the interrupt is repeated until it has. The done function of the
+  request is then called on the emulation thread.
+
+  Because the rings are processed in order, a read always sees the data of
+  all writes that were submitted before it.
+
+  If the thread is disabled or can not be started, requests are performed
+  immediately when they are submitted.
+*/
+const char DiskIO_fileid[] = "Previous diskIO.c : " __DATE__ " " __TIME__;
+
+#include "main.h"
+#include <SDL.h>
+#include "configuration.h"
+#include "cycInt.h"
+#include "diskIO.h"
+#include "log.h"
+
+
+#define DISKIO_RING_SIZE    64      /* must be a power of two */
+#define DISKIO_POLL_DELAY   1000    /* CPU cycles between checks for late completions */
+
+typedef struct {
+	DISKIO_REQUEST *req[DISKIO_RING_SIZE];
+	SDL_atomic_t head;      /* only written by the producer */
+	SDL_atomic_t tail;      /* only written by the consumer */
+} DISKIO_RING;
+
+static DISKIO_RING submitted;
+static DISKIO_RING completed;
+
+static SDL_Thread *pThread = NULL;
+static SDL_sem *pSubmitSem = NULL;  /* counts submitted requests */
+static SDL_sem *pCompleteSem = NULL; /* counts completed requests */
+static SDL_atomic_t bQuit;
+
+static int nInFlight = 0;           /* submitted, but not finished by the thread yet */
+static DISKIO_REQUEST *pPending = NULL; /* submitted, but done not called yet, in order */
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Put a request into a ring. Returns false if the ring is full.
+ */
+static bool diskio_ring_put(DISKIO_RING *ring, DISKIO_REQUEST *req)
+{
+	Uint32 head = SDL_AtomicGet(&ring->head);
+	Uint32 tail = SDL_AtomicGet(&ring->tail);
+
+	if (head - tail == DISKIO_RING_SIZE)
+		return false;
+
+	ring->req[head & (DISKIO_RING_SIZE-1)] = req;
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&ring->head, head+1);
+	return true;
+}
+
+/**
+ * Take the oldest request from a ring. Returns NULL if the ring is empty.
+ */
+static DISKIO_REQUEST *diskio_ring_get(DISKIO_RING *ring)
+{
+	Uint32 tail = SDL_AtomicGet(&ring->tail);
+	DISKIO_REQUEST *req;
+
+	if (tail == (Uint32)SDL_AtomicGet(&ring->head))
+		return NULL;
+
+	SDL_MemoryBarrierAcquire();
+	req = ring->req[tail & (DISKIO_RING_SIZE-1)];
+	SDL_AtomicSet(&ring->tail, tail+1);
+	return req;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * The worker thread. Sleeps until requests are submitted.
+ */
+static int diskio_thread(void *unused)
+{
+	DISKIO_REQUEST *req;
+
+	while (true)
+	{
+		SDL_SemWait(pSubmitSem);
+		if (SDL_AtomicGet(&bQuit))
+			break;
+
+		while ((req = diskio_ring_get(&submitted)) != NULL)
+		{
+			req->result = req->work(req);
+			diskio_ring_put(&completed, req);
+			SDL_SemPost(pCompleteSem);
+		}
+	}
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Take finished requests out of the completion ring. Their done functions
+ * are called later, when their deadline has passed.
+ */
+static void diskio_collect(void)
+{
+	DISKIO_REQUEST *req;
+
+	while ((req = diskio_ring_get(&completed)) != NULL)
+	{
+		req->finished = true;
+		nInFlight--;
+	}
+}
+
+/**
+ * Remove a finished request from the pending list and call its done function.
+ */
+static void diskio_finish(DISKIO_REQUEST *req)
+{
+	DISKIO_REQUEST **link = &pPending;
+
+	while (*link != req)
+		link = &(*link)->next;
+	*link = req->next;
+
+	req->busy = false;
+	req->finished = false;
+	if (req->done)
+		req->done(req);
+}
+
+/**
+ * Schedule the interrupt for the earliest deadline of the pending requests.
+ * Requests that are late are checked again after the poll delay.
+ */
+static void diskio_schedule(void)
+{
+	DISKIO_REQUEST *req;
+	Sint64 now, delay, next = -1;
+
+	CycInt_RemovePendingInterrupt(INTERRUPT_DISKIO);
+	if (!pPending)
+		return;
+
+	now = CycInt_GetTime();
+	for (req = pPending; req; req = req->next)
+	{
+		delay = req->deadline - now;
+		if (delay <= 0)
+			delay = INT_CONVERT_TO_INTERNAL(DISKIO_POLL_DELAY, INT_CPU_CYCLE);
+		if (next < 0 || delay < next)
+			next = delay;
+	}
+	CycInt_AddRelativeInterrupt(INT_CONVERT_FROM_INTERNAL(next, INT_CPU_CYCLE), INT_CPU_CYCLE, INTERRUPT_DISKIO);
+}
+
+/**
+ * Call the done functions of the finished requests whose deadline has
+ * passed, or of all finished requests if bAll is set. The list is scanned
+ * again after each call, because done functions may submit new requests.
+ */
+static void diskio_deliver(bool bAll)
+{
+	DISKIO_REQUEST *req;
+	Sint64 now;
+
+	do
+	{
+		diskio_collect();
+		now = bAll ? 0 : CycInt_GetTime();
+		for (req = pPending; req; req = req->next)
+		{
+			if (req->finished && (bAll || req->deadline <= now))
+				break;
+		}
+		if (req)
+			diskio_finish(req);
+	} while (req);
+
+	diskio_schedule();
+}
+
+/**
+ * Block until one more request has finished.
+ */
+static void diskio_wait_any(void)
+{
+	SDL_SemWait(pCompleteSem);
+	diskio_collect();
+}
+
+/**
+ * Finish all requests and call their done functions, including those of
+ * requests the done functions submit.
+ */
+static void diskio_drain(void)
+{
+	while (pPending)
+	{
+		while (nInFlight > 0)
+			diskio_wait_any();
+		diskio_deliver(true);
+	}
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Start or stop the worker thread as configured. All outstanding requests
+ * are finished before the thread is stopped.
+ */
+static void diskio_start(void)
+{
+	SDL_AtomicSet(&bQuit, 0);
+	SDL_AtomicSet(&submitted.head, 0);
+	SDL_AtomicSet(&submitted.tail, 0);
+	SDL_AtomicSet(&completed.head, 0);
+	SDL_AtomicSet(&completed.tail, 0);
+
+	pSubmitSem = SDL_CreateSemaphore(0);
+	pCompleteSem = SDL_CreateSemaphore(0);
+	if (pSubmitSem && pCompleteSem)
+		pThread = SDL_CreateThread(diskio_thread, "DiskIO", NULL);
+
+	if (!pThread)
+	{
+		Log_Printf(LOG_WARN, "Disk I/O: Cannot start thread, using synchronous I/O.\n");
+		if (pSubmitSem)
+			SDL_DestroySemaphore(pSubmitSem);
+		if (pCompleteSem)
+			SDL_DestroySemaphore(pCompleteSem);
+		pSubmitSem = pCompleteSem = NULL;
+	}
+}
+
+static void diskio_stop(void)
+{
+	diskio_drain();
+
+	SDL_AtomicSet(&bQuit, 1);
+	SDL_SemPost(pSubmitSem);
+	SDL_WaitThread(pThread, NULL);
+	pThread = NULL;
+
+	SDL_DestroySemaphore(pSubmitSem);
+	SDL_DestroySemaphore(pCompleteSem);
+	pSubmitSem = pCompleteSem = NULL;
+}
+
+void DiskIO_Reset(void)
+{
+	CycInt_RegisterHandler(INTERRUPT_DISKIO, DiskIO_InterruptHandler);
+
+	if (pThread)
+	{
+		/* The interrupt for requests still in flight is gone */
+		diskio_drain();
+		if (!ConfigureParams.System.bAsyncDiskIO)
+			diskio_stop();
+	}
+	else if (ConfigureParams.System.bAsyncDiskIO)
+	{
+		diskio_start();
+	}
+}
+
+void DiskIO_UnInit(void)
+{
+	if (pThread)
+		diskio_stop();
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Submit a request. The done function is called after latency CPU cycles
+ * at the earliest. Without thread the request is performed right away and
+ * done is called before this function returns.
+ */
+void DiskIO_Submit(DISKIO_REQUEST *req, int latency)
+{
+	DISKIO_REQUEST **link = &pPending;
+
+	req->busy = true;
+
+	if (!pThread)
+	{
+		req->result = req->work(req);
+		req->busy = false;
+		if (req->done)
+			req->done(req);
+		return;
+	}
+
+	req->finished = false;
+	req->deadline = CycInt_GetTime() + INT_CONVERT_TO_INTERNAL((Sint64)latency, INT_CPU_CYCLE);
+	req->next = NULL;
+	while (*link)
+		link = &(*link)->next;
+	*link = req;
+
+	/* Keep the number of requests in flight below the ring size, so that
+	 * neither ring can overflow */
+	while (nInFlight >= DISKIO_RING_SIZE)
+		diskio_wait_any();
+	nInFlight++;
+	diskio_ring_put(&submitted, req);
+	SDL_SemPost(pSubmitSem);
+
+	diskio_schedule();
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Block until a request has finished, for devices that can not go on
+ * without its data. Its done function is called right away, other
+ * finished requests are delivered when their deadline has passed.
+ */
+void DiskIO_Wait(DISKIO_REQUEST *req)
+{
+	if (!req->busy)
+		return;
+
+	diskio_collect();
+	while (!req->finished)
+		diskio_wait_any();
+	diskio_finish(req);
+	diskio_deliver(false);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Return true if no request is outstanding. The requests are not part of
+ * memory snapshots, so they can only be taken then.
+ */
+bool DiskIO_Idle(void)
+{
+	return pPending == NULL;
+}
+
+/**
+ * Finish all outstanding requests now, without waiting for their deadline.
+ */
+void DiskIO_Sync(void)
+{
+	if (pThread)
+		diskio_drain();
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Cycle interrupt: deliver the requests whose deadline has passed and
+ * schedule the interrupt for the next one.
+ */
+void DiskIO_InterruptHandler(void)
+{
+	CycInt_AcknowledgeInterrupt();
+
+	diskio_deliver(false);
+}
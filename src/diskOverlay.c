@@ -0,0 +1,491 @@
+/*
+  Previous - diskOverlay.c
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+
+  Copy-on-write overlay for disk images
+
+  An overlay file collects all writes to a disk image, so that the image
+  itself can be shared read-only between several instances. The overlay
+  starts with a header that records the name and size of the base image,
+  followed by an index with one entry per cluster of the base image. An
+  index entry of 0 means that the cluster is unchanged and has to be read
+  from the base image, otherwise it is the number of the slot in the data
+  area of the overlay that holds the modified cluster. A cluster is copied
+  into a new slot at the end of the overlay the first time it is written.
+
+  All numbers in the header and the index are stored big endian.
+*/
+const char DiskOverlay_fileid[] = "Previous diskOverlay.c : " __DATE__ " " __TIME__;
+
+#include "main.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#if HAVE_PREAD || HAVE_FSYNC
+#include <unistd.h>
+#endif
+#include "diskOverlay.h"
+
+
+#define OVERLAY_MAGIC           "PREVOVL1"
+#define OVERLAY_VERSION         1
+#define OVERLAY_HEADER_SIZE     4096
+#define OVERLAY_NAME_OFFSET     32
+#define OVERLAY_CLUSTER_BLOCKS  8
+#define OVERLAY_CLUSTER_SIZE    (OVERLAY_BLOCKSIZE*OVERLAY_CLUSTER_BLOCKS)
+
+struct DISKOVERLAY {
+	FILE *base;
+	FILE *delta;
+	char *name;
+	char basename[OVERLAY_HEADER_SIZE-OVERLAY_NAME_OFFSET];
+	Uint32 blocks;          /* size of the base image in blocks */
+	Uint32 clusters;
+	Uint32 used;            /* number of slots in the data area */
+	Uint32 *index;
+	off_t dataoffset;
+};
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Helper functions for big endian numbers and positioned file I/O.
+ */
+static Uint32 overlay_get32(const Uint8 *p)
+{
+	return ((Uint32)p[0] << 24) | ((Uint32)p[1] << 16) | ((Uint32)p[2] << 8) | p[3];
+}
+
+static void overlay_put32(Uint8 *p, Uint32 val)
+{
+	p[0] = val >> 24;
+	p[1] = val >> 16;
+	p[2] = val >> 8;
+	p[3] = val;
+}
+
+static bool overlay_read_at(FILE *fp, void *buf, size_t len, off_t offset)
+{
+#if HAVE_PREAD
+	return pread(fileno(fp), buf, len, offset) == (ssize_t)len;
+#else
+	if (fseek(fp, (long)offset, SEEK_SET) != 0)
+		return false;
+	return fread(buf, 1, len, fp) == len;
+#endif
+}
+
+static bool overlay_write_at(FILE *fp, const void *buf, size_t len, off_t offset)
+{
+#if HAVE_PREAD
+	return pwrite(fileno(fp), buf, len, offset) == (ssize_t)len;
+#else
+	if (fseek(fp, (long)offset, SEEK_SET) != 0)
+		return false;
+	return fwrite(buf, 1, len, fp) == len;
+#endif
+}
+
+static off_t overlay_slot_offset(DISKOVERLAY *ovl, Uint32 slot)
+{
+	return ovl->dataoffset + (off_t)(slot-1)*OVERLAY_CLUSTER_SIZE;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Write the header and an empty index to a new overlay file.
+ */
+static bool overlay_init_file(DISKOVERLAY *ovl)
+{
+	Uint8 header[OVERLAY_HEADER_SIZE];
+	Uint8 *zero;
+	size_t indexsize = ovl->dataoffset - OVERLAY_HEADER_SIZE;
+	bool ok;
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, OVERLAY_MAGIC, 8);
+	overlay_put32(header+8, OVERLAY_VERSION);
+	overlay_put32(header+12, OVERLAY_CLUSTER_SIZE);
+	overlay_put32(header+16, ovl->blocks);
+	snprintf((char *)header+OVERLAY_NAME_OFFSET, sizeof(ovl->basename), "%s", ovl->basename);
+
+	zero = calloc(1, indexsize);
+	if (!zero)
+		return false;
+	ok = overlay_write_at(ovl->delta, header, sizeof(header), 0)
+	     && overlay_write_at(ovl->delta, zero, indexsize, OVERLAY_HEADER_SIZE);
+	free(zero);
+	fflush(ovl->delta);
+	return ok;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Read the header and the index of an existing overlay file.
+ */
+static bool overlay_load_file(DISKOVERLAY *ovl)
+{
+	Uint8 header[OVERLAY_HEADER_SIZE];
+	Uint8 *raw;
+	Uint32 i;
+
+	if (!overlay_read_at(ovl->delta, header, sizeof(header), 0))
+		return false;
+	if (memcmp(header, OVERLAY_MAGIC, 8) != 0
+	    || overlay_get32(header+8) != OVERLAY_VERSION
+	    || overlay_get32(header+12) != OVERLAY_CLUSTER_SIZE)
+		return false;
+	if (ovl->base && overlay_get32(header+16) != ovl->blocks)
+		return false;       /* base image has been changed */
+	ovl->blocks = overlay_get32(header+16);
+	ovl->clusters = (ovl->blocks + OVERLAY_CLUSTER_BLOCKS - 1) / OVERLAY_CLUSTER_BLOCKS;
+	memcpy(ovl->basename, header+OVERLAY_NAME_OFFSET, sizeof(ovl->basename));
+	ovl->basename[sizeof(ovl->basename)-1] = '\0';
+
+	raw = malloc((size_t)ovl->clusters*4);
+	if (!raw)
+		return false;
+	if (!overlay_read_at(ovl->delta, raw, (size_t)ovl->clusters*4, OVERLAY_HEADER_SIZE))
+	{
+		free(raw);
+		return false;
+	}
+	ovl->used = 0;
+	for (i = 0; i < ovl->clusters; i++)
+	{
+		ovl->index[i] = overlay_get32(raw+i*4);
+		if (ovl->index[i] > ovl->used)
+			ovl->used = ovl->index[i];
+	}
+	free(raw);
+	return true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Open the overlay file pszName for the base image 'base', which is only
+ * read from. If the overlay file does not exist, it is created. Returns
+ * NULL if the overlay can not be used, e.g. because it belongs to a base
+ * image of different size.
+ * For the commit tool, base may be NULL to only look at the overlay.
+ */
+DISKOVERLAY *DiskOverlay_Open(const char *pszName, FILE *base, const char *pszBaseName)
+{
+	DISKOVERLAY *ovl;
+	struct stat st;
+	bool ok;
+
+	ovl = calloc(1, sizeof(DISKOVERLAY));
+	if (!ovl)
+		return NULL;
+	ovl->base = base;
+	ovl->name = strdup(pszName);
+	if (pszBaseName)
+		snprintf(ovl->basename, sizeof(ovl->basename), "%s", pszBaseName);
+
+	if (base)
+	{
+		if (fstat(fileno(base), &st) != 0)
+		{
+			DiskOverlay_Close(ovl);
+			return NULL;
+		}
+		ovl->blocks = st.st_size / OVERLAY_BLOCKSIZE;
+	}
+	else
+	{
+		/* Get size from the overlay header */
+		Uint8 header[20];
+		FILE *fp = fopen(pszName, "rb");
+		if (!fp || !overlay_read_at(fp, header, sizeof(header), 0))
+		{
+			if (fp)
+				fclose(fp);
+			DiskOverlay_Close(ovl);
+			return NULL;
+		}
+		fclose(fp);
+		ovl->blocks = overlay_get32(header+16);
+	}
+	ovl->clusters = (ovl->blocks + OVERLAY_CLUSTER_BLOCKS - 1) / OVERLAY_CLUSTER_BLOCKS;
+	ovl->dataoffset = OVERLAY_HEADER_SIZE
+	                  + ((off_t)ovl->clusters*4 + OVERLAY_CLUSTER_SIZE - 1) / OVERLAY_CLUSTER_SIZE * OVERLAY_CLUSTER_SIZE;
+	ovl->index = calloc(ovl->clusters ? ovl->clusters : 1, sizeof(Uint32));
+	if (!ovl->name || !ovl->index)
+	{
+		DiskOverlay_Close(ovl);
+		return NULL;
+	}
+
+	ovl->delta = fopen(pszName, "rb+");
+	if (ovl->delta)
+	{
+		ok = overlay_load_file(ovl);
+	}
+	else if (base)
+	{
+		ovl->delta = fopen(pszName, "wb+");
+		ok = ovl->delta && overlay_init_file(ovl);
+	}
+	else
+	{
+		ok = false;
+	}
+	if (!ok)
+	{
+		DiskOverlay_Close(ovl);
+		return NULL;
+	}
+	return ovl;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Close the overlay file. The base image is left open.
+ */
+void DiskOverlay_Close(DISKOVERLAY *ovl)
+{
+	if (!ovl)
+		return;
+	if (ovl->delta)
+		fclose(ovl->delta);
+	free(ovl->index);
+	free(ovl->name);
+	free(ovl);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Read blocks, taking each cluster either from the overlay or from the
+ * base image. Runs of clusters that are stored one after another in the
+ * same file are read with one call. Returns the number of blocks read.
+ */
+Uint32 DiskOverlay_Read(DISKOVERLAY *ovl, Uint8 *buf, Uint32 lba, Uint32 blocks)
+{
+	Uint32 done = 0;
+
+	if (lba >= ovl->blocks)
+		return 0;
+	if (blocks > ovl->blocks - lba)
+		blocks = ovl->blocks - lba;
+
+	while (done < blocks)
+	{
+		Uint32 block = lba + done;
+		Uint32 cluster = block / OVERLAY_CLUSTER_BLOCKS;
+		Uint32 slot = ovl->index[cluster];
+		Uint32 n = OVERLAY_CLUSTER_BLOCKS - block % OVERLAY_CLUSTER_BLOCKS;
+		size_t len;
+		bool ok;
+
+		/* Extend the run as long as the next cluster continues it */
+		while (done + n < blocks && ovl->index[cluster+1] == (slot ? slot+1 : 0))
+		{
+			cluster++;
+			slot = ovl->index[cluster];
+			n += OVERLAY_CLUSTER_BLOCKS;
+		}
+		if (n > blocks - done)
+			n = blocks - done;
+		len = (size_t)n * OVERLAY_BLOCKSIZE;
+
+		if (slot)
+		{
+			/* Go back to the slot of the first cluster in the run */
+			Uint32 first = ovl->index[block / OVERLAY_CLUSTER_BLOCKS];
+			off_t offset = overlay_slot_offset(ovl, first)
+			               + (off_t)(block % OVERLAY_CLUSTER_BLOCKS) * OVERLAY_BLOCKSIZE;
+			ok = overlay_read_at(ovl->delta, buf, len, offset);
+		}
+		else
+		{
+			ok = overlay_read_at(ovl->base, buf, len, (off_t)block * OVERLAY_BLOCKSIZE);
+		}
+		if (!ok)
+			break;
+
+		buf += len;
+		done += n;
+	}
+	return done;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Write blocks to the overlay. A cluster that is written for the first
+ * time gets a new slot at the end of the overlay; if it is only written
+ * partially, the rest of it is copied from the base image. The index
+ * entries of new slots are written after the data. Returns the number
+ * of blocks written.
+ */
+Uint32 DiskOverlay_Write(DISKOVERLAY *ovl, const Uint8 *buf, Uint32 lba, Uint32 blocks)
+{
+	Uint8 cluster_buf[OVERLAY_CLUSTER_SIZE];
+	Uint8 entry[4];
+	Uint32 done = 0;
+
+	if (lba >= ovl->blocks)
+		return 0;
+	if (blocks > ovl->blocks - lba)
+		blocks = ovl->blocks - lba;
+
+	while (done < blocks)
+	{
+		Uint32 block = lba + done;
+		Uint32 cluster = block / OVERLAY_CLUSTER_BLOCKS;
+		Uint32 offset = block % OVERLAY_CLUSTER_BLOCKS;
+		Uint32 n = OVERLAY_CLUSTER_BLOCKS - offset;
+		Uint32 slot = ovl->index[cluster];
+		size_t len;
+
+		if (n > blocks - done)
+			n = blocks - done;
+		len = (size_t)n * OVERLAY_BLOCKSIZE;
+
+		if (slot)
+		{
+			if (!overlay_write_at(ovl->delta, buf, len,
+			                      overlay_slot_offset(ovl, slot) + (off_t)offset * OVERLAY_BLOCKSIZE))
+				break;
+		}
+		else
+		{
+			if (n < OVERLAY_CLUSTER_BLOCKS)
+			{
+				Uint32 start = cluster * OVERLAY_CLUSTER_BLOCKS;
+				Uint32 avail = ovl->blocks - start;
+				if (avail > OVERLAY_CLUSTER_BLOCKS)
+					avail = OVERLAY_CLUSTER_BLOCKS;
+				memset(cluster_buf, 0, sizeof(cluster_buf));
+				if (!overlay_read_at(ovl->base, cluster_buf, (size_t)avail * OVERLAY_BLOCKSIZE,
+				                     (off_t)start * OVERLAY_BLOCKSIZE))
+					break;
+			}
+			memcpy(cluster_buf + offset * OVERLAY_BLOCKSIZE, buf, len);
+
+			slot = ovl->used + 1;
+			overlay_put32(entry, slot);
+			if (!overlay_write_at(ovl->delta, cluster_buf, sizeof(cluster_buf), overlay_slot_offset(ovl, slot))
+			    || !overlay_write_at(ovl->delta, entry, 4, OVERLAY_HEADER_SIZE + (off_t)cluster * 4))
+				break;
+			ovl->index[cluster] = slot;
+			ovl->used = slot;
+		}
+
+		buf += len;
+		done += n;
+	}
+	return done;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Make sure that everything written to the overlay is on the disk.
+ */
+bool DiskOverlay_Sync(DISKOVERLAY *ovl)
+{
+	if (fflush(ovl->delta) != 0)
+		return false;
+#if HAVE_FSYNC
+	return fsync(fileno(ovl->delta)) == 0;
+#else
+	return true;
+#endif
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Write all modified clusters back into the base image, which has to be
+ * opened for writing. The overlay is not changed, use DiskOverlay_Discard
+ * afterwards to empty it. The base image is synced first, so the data is
+ * not lost if the host crashes after discarding.
+ */
+bool DiskOverlay_Commit(DISKOVERLAY *ovl)
+{
+	Uint8 cluster_buf[OVERLAY_CLUSTER_SIZE];
+	Uint32 cluster;
+
+	for (cluster = 0; cluster < ovl->clusters; cluster++)
+	{
+		Uint32 slot = ovl->index[cluster];
+		Uint32 start = cluster * OVERLAY_CLUSTER_BLOCKS;
+		Uint32 avail = ovl->blocks - start;
+
+		if (!slot)
+			continue;
+		if (avail > OVERLAY_CLUSTER_BLOCKS)
+			avail = OVERLAY_CLUSTER_BLOCKS;
+		if (!overlay_read_at(ovl->delta, cluster_buf, sizeof(cluster_buf), overlay_slot_offset(ovl, slot))
+		    || !overlay_write_at(ovl->base, cluster_buf, (size_t)avail * OVERLAY_BLOCKSIZE,
+		                         (off_t)start * OVERLAY_BLOCKSIZE))
+			return false;
+	}
+	if (fflush(ovl->base) != 0)
+		return false;
+#if HAVE_FSYNC
+	return fsync(fileno(ovl->base)) == 0;
+#else
+	return true;
+#endif
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Drop all changes collected in the overlay by recreating it empty.
+ */
+bool DiskOverlay_Discard(DISKOVERLAY *ovl)
+{
+	fclose(ovl->delta);
+	ovl->delta = fopen(ovl->name, "wb+");
+	if (!ovl->delta)
+		return false;
+	memset(ovl->index, 0, (size_t)ovl->clusters * sizeof(Uint32));
+	ovl->used = 0;
+	return overlay_init_file(ovl);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Return the number of base image blocks that are held in the overlay.
+ */
+Uint32 DiskOverlay_GetUsedBlocks(DISKOVERLAY *ovl)
+{
+	return ovl->used * OVERLAY_CLUSTER_BLOCKS;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Get the name of the base image recorded in an overlay file.
+ */
+bool DiskOverlay_GetBaseName(const char *pszName, char *pszBaseName, size_t len)
+{
+	Uint8 header[OVERLAY_HEADER_SIZE];
+	FILE *fp;
+	bool ok;
+
+	fp = fopen(pszName, "rb");
+	if (!fp)
+		return false;
+	ok = overlay_read_at(fp, header, sizeof(header), 0)
+	     && memcmp(header, OVERLAY_MAGIC, 8) == 0;
+	fclose(fp);
+	if (!ok || len == 0)
+		return false;
+
+	header[OVERLAY_HEADER_SIZE-1] = '\0';
+	strncpy(pszBaseName, (char *)header+OVERLAY_NAME_OFFSET, len-1);
+	pszBaseName[len-1] = '\0';
+	return true;
+}
@@ -19,6 +19,7 @@
 #include "configuration.h"
 #include "ethernet.h"
 #include "mmu_common.h"
+#include "memorySnapShot.h"
 
 
 
@@ -127,6 +128,26 @@ static inline void dma_putlong(Uint32 val, Uint8 *buf, Uint32 pos) {
 	buf[pos+3] = val;
 }
 
+/* Return a host pointer to the memory at addr if it can be accessed
+ * directly (i.e. plain RAM without side effects) or NULL if it has to go
+ * through the bank functions. *len is set to the number of bytes in
+ * whole bursts up to limit that lie inside the same memory bank. Memory
+ * is stored big endian, so bursts can be copied as plain bytes. */
+static Uint8 *dma_direct_memory(Uint32 addr, Uint32 limit, Uint32 *len, int flags) {
+    addrbank *ab = &get_mem_bank(addr);
+    Uint32 size;
+
+    if (addr>=limit || (addr%DMA_BURST_SIZE) || !(ab->flags&flags)) {
+        return NULL;
+    }
+    size = 0x10000-(addr&0xFFFF);
+    if (size>limit-addr) {
+        size = limit-addr;
+    }
+    *len = size&~(DMA_BURST_SIZE-1);
+    return ab->xlateaddr(addr);
+}
+
 
 int get_channel(Uint32 address) {
     int channel = address&IO_SEG_MASK;
@@ -441,6 +462,11 @@ void R2MDMA_InterruptHandler(void) {
     dma_interrupt(CHANNEL_R2M);
 }
 
+void DMA_Reset(void) {
+    CycInt_RegisterHandler(INTERRUPT_M2R, M2RDMA_InterruptHandler);
+    CycInt_RegisterHandler(INTERRUPT_R2M, R2MDMA_InterruptHandler);
+}
+
 
 /* DMA Read and Write Memory Functions */
 
@@ -489,6 +515,32 @@ void dma_esp_write_memory(void) {
             }
         }
 
+        /* Fast path: copy whole bursts from the SCSI buffer directly to RAM */
+        while (espdma_buf_size==0 && esp_counter>0 && SCSIbus.phase==PHASE_DI) {
+            Uint32 len;
+            Uint8 *dst = dma_direct_memory(dma[CHANNEL_SCSI].next, dma[CHANNEL_SCSI].limit, &len, ABFLAG_DIRECT);
+            if (!dst) {
+                break;
+            }
+            if (len>esp_counter) {
+                len = esp_counter;
+            }
+            if (len>scsi_buffer.size) {
+                len = scsi_buffer.size;
+            }
+            len &= ~(DMA_BURST_SIZE-1);
+            if (len==0) {
+                break;
+            }
+            NEXTmem_set_dirty_host(dst, len);
+            SCSIdisk_Send_Data_Block(dst, len);
+            esp_counter-=len;
+            dma[CHANNEL_SCSI].next+=len;
+            if ((len/DMA_BURST_SIZE)&1) { /* one toggle per burst */
+                ESP_DMA_set_status();
+            }
+        }
+
         while (dma[CHANNEL_SCSI].next<=dma[CHANNEL_SCSI].limit && !(espdma_buf_size%DMA_BURST_SIZE)) {
             /* Fill DMA internal buffer */
             while (espdma_buf_size<DMA_BURST_SIZE && esp_counter>0 && SCSIbus.phase==PHASE_DI) {
@@ -583,6 +635,31 @@ void dma_esp_read_memory(void) {
             }
         }
 
+        /* Fast path: copy whole bursts from RAM directly to the SCSI buffer */
+        while (espdma_buf_size==0 && esp_counter>0 && SCSIbus.phase==PHASE_DO) {
+            Uint32 len;
+            Uint8 *src = dma_direct_memory(dma[CHANNEL_SCSI].next, dma[CHANNEL_SCSI].limit, &len, ABFLAG_DIRECT|ABFLAG_DIRECTREAD);
+            if (!src) {
+                break;
+            }
+            if (len>esp_counter) {
+                len = esp_counter;
+            }
+            if (len>scsi_buffer.limit-scsi_buffer.size) {
+                len = scsi_buffer.limit-scsi_buffer.size;
+            }
+            len &= ~(DMA_BURST_SIZE-1);
+            if (len==0) {
+                break;
+            }
+            SCSIdisk_Receive_Data_Block(src, len);
+            esp_counter-=len;
+            dma[CHANNEL_SCSI].next+=len;
+            if ((len/DMA_BURST_SIZE)&1) { /* one toggle per burst */
+                ESP_DMA_set_status();
+            }
+        }
+
         while (dma[CHANNEL_SCSI].next<dma[CHANNEL_SCSI].limit && espdma_buf_size==0) {
             /* Read data from memory to internal DMA buffer */
             while (espdma_buf_size<DMA_BURST_SIZE) {
@@ -663,6 +740,26 @@ void dma_mo_write_memory(void) {
             }
         }
         
+        /* Fast path: copy whole bursts from the ECC buffer directly to RAM */
+        while (modma_buf_size==0 && ecc_buffer[eccout].size>0) {
+            Uint32 len;
+            Uint8 *dst = dma_direct_memory(dma[CHANNEL_DISK].next, dma[CHANNEL_DISK].limit, &len, ABFLAG_DIRECT);
+            if (!dst) {
+                break;
+            }
+            if (len>ecc_buffer[eccout].size) {
+                len = ecc_buffer[eccout].size;
+            }
+            len &= ~(DMA_BURST_SIZE-1);
+            if (len==0) {
+                break;
+            }
+            NEXTmem_set_dirty_host(dst, len);
+            memcpy(dst, ecc_buffer[eccout].data+ecc_buffer[eccout].limit-ecc_buffer[eccout].size, len);
+            ecc_buffer[eccout].size-=len;
+            dma[CHANNEL_DISK].next+=len;
+        }
+
         while (dma[CHANNEL_DISK].next<=dma[CHANNEL_DISK].limit && !(modma_buf_size%DMA_BURST_SIZE)) {
             /* Fill DMA internal buffer */
             while (modma_buf_size<DMA_BURST_SIZE && ecc_buffer[eccout].size>0) {
@@ -750,6 +847,25 @@ void dma_mo_read_memory(void) {
             }
         }
 
+        /* Fast path: copy whole bursts from RAM directly to the ECC buffer */
+        while (modma_buf_size==0 && ecc_buffer[eccin].size<ecc_buffer[eccin].limit) {
+            Uint32 len;
+            Uint8 *src = dma_direct_memory(dma[CHANNEL_DISK].next, dma[CHANNEL_DISK].limit, &len, ABFLAG_DIRECT|ABFLAG_DIRECTREAD);
+            if (!src) {
+                break;
+            }
+            if (len>ecc_buffer[eccin].limit-ecc_buffer[eccin].size) {
+                len = ecc_buffer[eccin].limit-ecc_buffer[eccin].size;
+            }
+            len &= ~(DMA_BURST_SIZE-1);
+            if (len==0) {
+                break;
+            }
+            memcpy(ecc_buffer[eccin].data+ecc_buffer[eccin].size, src, len);
+            ecc_buffer[eccin].size+=len;
+            dma[CHANNEL_DISK].next+=len;
+        }
+
         while (dma[CHANNEL_DISK].next<dma[CHANNEL_DISK].limit && modma_buf_size==0) {
             /* Read data from memory to internal DMA buffer */
             while (modma_buf_size<DMA_BURST_SIZE) {
@@ -885,6 +1001,7 @@ void dma_m2m_write_memory(void) {
     int i;
     int time = 0;
     Uint32 m2m_buffer[DMA_BURST_SIZE/4];
+    Uint8 m2m_bytes[DMA_BURST_SIZE];
     
     if (((dma[CHANNEL_R2M].limit-dma[CHANNEL_R2M].next)%DMA_BURST_SIZE) ||
         ((dma[CHANNEL_M2R].limit-dma[CHANNEL_M2R].next)%DMA_BURST_SIZE)) {
@@ -916,9 +1033,19 @@ void dma_m2m_write_memory(void) {
         }
         
         TRY(prb) {
-            /* Write the contents of the buffer to memory */
+            /* Write the contents of the buffer to memory, blend whole
+             * bursts at once if they go to the write function aliases */
             for (i=0; i<DMA_BURST_SIZE; i+=4) {
-                NEXTMemory_WriteLong(dma[CHANNEL_R2M].next+i, m2m_buffer[i/4]);
+                m2m_bytes[i]=m2m_buffer[i/4]>>24;
+                m2m_bytes[i+1]=m2m_buffer[i/4]>>16;
+                m2m_bytes[i+2]=m2m_buffer[i/4]>>8;
+                m2m_bytes[i+3]=m2m_buffer[i/4];
+            }
+            i=0;
+            if (!memory_write_func_put_block(dma[CHANNEL_R2M].next, m2m_bytes, DMA_BURST_SIZE)) {
+                for (i=0; i<DMA_BURST_SIZE; i+=4) {
+                    NEXTMemory_WriteLong(dma[CHANNEL_R2M].next+i, m2m_buffer[i/4]);
+                }
             }
             dma[CHANNEL_R2M].next+=DMA_BURST_SIZE;
         } CATCH(prb) {
@@ -974,3 +1101,18 @@ void dma_sndout_read_memory(void) {
     
     dma_interrupt(CHANNEL_SOUNDOUT);
 }
+
+
+/* Save/Restore snapshot of the DMA channels and their internal buffers */
+void DMA_MemorySnapShot_Capture(bool bSave) {
+    MemorySnapShot_Store(dma, sizeof(dma));
+    MemorySnapShot_Store(&espdma_buf_size, sizeof(espdma_buf_size));
+    MemorySnapShot_Store(&espdma_buf_limit, sizeof(espdma_buf_limit));
+    MemorySnapShot_Store(espdma_buf, sizeof(espdma_buf));
+    MemorySnapShot_Store(&modma_buf_size, sizeof(modma_buf_size));
+    MemorySnapShot_Store(&modma_buf_limit, sizeof(modma_buf_limit));
+    MemorySnapShot_Store(modma_buf, sizeof(modma_buf));
+    MemorySnapShot_Store(&enrxdma_buf_size, sizeof(enrxdma_buf_size));
+    MemorySnapShot_Store(&enrxdma_buf_limit, sizeof(enrxdma_buf_limit));
+    MemorySnapShot_Store(enrxdma_buf, sizeof(enrxdma_buf));
+}
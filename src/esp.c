@@ -10,6 +10,7 @@
 #include "sysReg.h"
 #include "dma.h"
 #include "scsi.h"
+#include "memorySnapShot.h"
 
 #define LOG_ESPDMA_LEVEL    LOG_DEBUG   /* Print debugging messages for ESP DMA registers */
 #define LOG_ESPCMD_LEVEL    LOG_DEBUG   /* Print debugging messages for ESP commands */
@@ -141,7 +142,15 @@ Uint8 mode_dma;
 
 /* Experimental */
 #define ESP_CLOCK_FREQ  20      /* ESP is clocked at 20 MHz */
-#define ESP_DELAY       20000   /* Standard wait time for ESP interrupt (except bus reset and selection timeout) */
+
+/* Delays in CPU cycles for each I/O timing mode (accurate, fast, instant).
+ * The ratio between them is kept, so that DMA flushing always happens
+ * before the interrupt of the command. */
+static const int esp_delay[3]    = { 20000, 5000, 200 }; /* Standard wait time for ESP interrupt (except bus reset and selection timeout) */
+static const int esp_io_delay[3] = { 10000, 2500, 100 }; /* Wait time between DMA transfer steps */
+
+#define ESP_DELAY       esp_delay[ConfigureParams.System.nSCSITiming]
+#define ESP_IO_DELAY    esp_io_delay[ConfigureParams.System.nSCSITiming]
 
 
 /* ESP DMA control and status registers */
@@ -560,6 +569,11 @@ void ESP_InterruptHandler(void) {
     esp_raise_irq();
 }
 
+void ESP_Reset(void) {
+    CycInt_RegisterHandler(INTERRUPT_ESP, ESP_InterruptHandler);
+    CycInt_RegisterHandler(INTERRUPT_ESP_IO, ESP_IO_Handler);
+}
+
 
 void esp_raise_irq(void) {
     if(!(status & STAT_INT)) {
@@ -697,6 +711,9 @@ void esp_select(bool atn) {
         esp_command_clear();
         esp_state = DISCONNECTED;
         int seltout = (selecttimeout * 8192 * clockconv) / ESP_CLOCK_FREQ; /* timeout in microseconds */
+        if (ConfigureParams.System.nSCSITiming!=IO_TIMING_ACCURATE && seltout>ESP_DELAY) {
+            seltout = ESP_DELAY; /* do not wait for targets that are not there */
+        }
         Log_Printf(LOG_ESPCMD_LEVEL, "[ESP] Select: Target %i, timeout after %i microseconds",target,seltout);
         CycInt_AddRelativeInterrupt(seltout/**ConfigureParams.System.nCpuFreq*/, INT_CPU_CYCLE, INTERRUPT_ESP);
         return;
@@ -771,7 +788,7 @@ bool esp_transfer_done(bool write) {
 void esp_transfer_info(void) {
     if(mode_dma) {
         esp_io_state=ESP_IO_STATE_TRANSFERING;
-        CycInt_AddRelativeInterrupt(10000, INT_CPU_CYCLE, INTERRUPT_ESP_IO);
+        CycInt_AddRelativeInterrupt(ESP_IO_DELAY, INT_CPU_CYCLE, INTERRUPT_ESP_IO);
     } else {
         Log_Printf(LOG_WARN, "[ESP] start PIO transfer (not implemented!)");
         abort();
@@ -784,6 +801,9 @@ void ESP_IO_Handler(void) {
         case ESP_IO_STATE_TRANSFERING:
             switch (SCSIbus.phase) {
                 case PHASE_DI:
+                    if (scsi_buffer.pending) {
+                        break; /* disk has not delivered the data yet */
+                    }
                     dma_esp_write_memory();
                     if (esp_transfer_done(true)) {
                         esp_io_state=ESP_IO_STATE_FLUSHING;
@@ -810,7 +830,7 @@ void ESP_IO_Handler(void) {
             return;
     }
     
-    CycInt_AddRelativeInterrupt(10000, INT_CPU_CYCLE, INTERRUPT_ESP_IO);
+    CycInt_AddRelativeInterrupt(ESP_IO_DELAY, INT_CPU_CYCLE, INTERRUPT_ESP_IO);
 }
 
 
@@ -897,3 +917,29 @@ if(scsi_command_group < 3 || scsi_command_group > 4) {
     status &= ~STAT_VGC;
 }
 #endif
+
+
+/* Save/Restore snapshot of the ESP and its DMA control registers */
+void ESP_MemorySnapShot_Capture(bool bSave) {
+    MemorySnapShot_Store(&esp_dma, sizeof(esp_dma));
+    MemorySnapShot_Store(&esp_state, sizeof(esp_state));
+    MemorySnapShot_Store(&esp_cmd_state, sizeof(esp_cmd_state));
+    MemorySnapShot_Store(&esp_io_state, sizeof(esp_io_state));
+    MemorySnapShot_Store(&writetranscountl, sizeof(writetranscountl));
+    MemorySnapShot_Store(&writetranscounth, sizeof(writetranscounth));
+    MemorySnapShot_Store(fifo, sizeof(fifo));
+    MemorySnapShot_Store(command, sizeof(command));
+    MemorySnapShot_Store(&status, sizeof(status));
+    MemorySnapShot_Store(&selectbusid, sizeof(selectbusid));
+    MemorySnapShot_Store(&intstatus, sizeof(intstatus));
+    MemorySnapShot_Store(&selecttimeout, sizeof(selecttimeout));
+    MemorySnapShot_Store(&seqstep, sizeof(seqstep));
+    MemorySnapShot_Store(&syncperiod, sizeof(syncperiod));
+    MemorySnapShot_Store(&fifoflags, sizeof(fifoflags));
+    MemorySnapShot_Store(&syncoffset, sizeof(syncoffset));
+    MemorySnapShot_Store(&configuration, sizeof(configuration));
+    MemorySnapShot_Store(&clockconv, sizeof(clockconv));
+    MemorySnapShot_Store(&esptest, sizeof(esptest));
+    MemorySnapShot_Store(&esp_counter, sizeof(esp_counter));
+    MemorySnapShot_Store(&mode_dma, sizeof(mode_dma));
+}
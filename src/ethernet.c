@@ -16,6 +16,7 @@
 #include "ethernet.h"
 #include "cycInt.h"
 #include "statusbar.h"
+#include "memorySnapShot.h"
 
 #define LOG_EN_LEVEL        LOG_WARN
 #define LOG_EN_REG_LEVEL    LOG_WARN
@@ -354,9 +355,13 @@ void print_buf(Uint8 *buf, Uint32 size) {
 #define ENET_FRAMESIZE_MIN  64      /* 46 byte data and 14 byte header, 4 byte CRC */
 #define ENET_FRAMESIZE_MAX  1518    /* 1500 byte data and 14 byte header, 4 byte CRC */
 
-/* Ethernet periodic check */
-#define ENET_IO_DELAY   50000
-#define ENET_IO_SHORT   250
+/* Ethernet periodic check, delays in CPU cycles for each I/O timing mode
+ * (accurate, fast, instant) */
+static const int enet_io_delay[3] = { 50000, 10000, 2500 };
+static const int enet_io_short[3] = { 250, 100, 20 };
+
+#define ENET_IO_DELAY   enet_io_delay[ConfigureParams.System.nEnetTiming]
+#define ENET_IO_SHORT   enet_io_short[ConfigureParams.System.nEnetTiming]
 
 enum {
     RECV_STATE_WAITING,
@@ -458,9 +463,22 @@ void enet_reset(void) {
 }
 
 void Ethernet_Reset(void) {
+    CycInt_RegisterHandler(INTERRUPT_ENET_IO, ENET_IO_Handler);
     enet.reset=EN_RESET;
     enet_stopped=true;
     
     enet_rx_buffer.size=enet_tx_buffer.size=0;
     enet_rx_buffer.limit=enet_tx_buffer.limit=2048;
 }
+
+
+/* Save/Restore snapshot of the ethernet controller. The connection to the
+ * host network is not part of it. */
+void Ethernet_MemorySnapShot_Capture(bool bSave) {
+    MemorySnapShot_Store(&enet, sizeof(enet));
+    MemorySnapShot_Store(&enet_stopped, sizeof(enet_stopped));
+    MemorySnapShot_Store(&receiver_state, sizeof(receiver_state));
+    MemorySnapShot_Store(&transmitter_state, sizeof(transmitter_state));
+    MemorySnapShot_Store(&enet_tx_buffer, sizeof(enet_tx_buffer));
+    MemorySnapShot_Store(&enet_rx_buffer, sizeof(enet_rx_buffer));
+}
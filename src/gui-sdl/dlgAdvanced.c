@@ -35,12 +35,24 @@ const char DlgAdvanced_fileid[] = "Hatari dlgAdvanced.c : " __DATE__ " " __TIME_
 
 #define DLGADV_ADB        29
 
-#define DLGADV_EXIT       30
+#define DLGADV_SCSI_ACCURATE  32
+#define DLGADV_SCSI_FAST      33
+#define DLGADV_SCSI_INSTANT   34
+
+#define DLGADV_MO_ACCURATE    37
+#define DLGADV_MO_FAST        38
+#define DLGADV_MO_INSTANT     39
+
+#define DLGADV_ENET_ACCURATE  42
+#define DLGADV_ENET_FAST      43
+#define DLGADV_ENET_INSTANT   44
+
+#define DLGADV_EXIT       45
 
 
 static SGOBJ advanceddlg[] =
 {
-    { SGBOX, 0, 0, 0,0, 57,29, NULL },
+    { SGBOX, 0, 0, 0,0, 57,37, NULL },
     { SGTEXT, 0, 0, 18,1, 14,1, "Advanced system options" },
     
     { SGBOX, 0, 0, 2,3, 14,13, NULL },
@@ -77,7 +89,25 @@ static SGOBJ advanceddlg[] =
     { SGTEXT, 0, 0, 39,18, 14,1, "ADB" },
     { SGCHECKBOX, 0, 0, 40,20, 13,1, "Emulate ADB" },
     
-    { SGBUTTON, SG_DEFAULT, 0, 18,26, 22,1, "Back to system menu" },
+    { SGBOX, 0, 0, 2,25, 18,9, NULL },
+    { SGTEXT, 0, 0, 3,26, 14,1, "SCSI timing" },
+    { SGRADIOBUT, 0, 0, 4,28, 10,1, "Accurate" },
+    { SGRADIOBUT, 0, 0, 4,30, 6,1, "Fast" },
+    { SGRADIOBUT, 0, 0, 4,32, 9,1, "Instant" },
+    
+    { SGBOX, 0, 0, 21,25, 16,9, NULL },
+    { SGTEXT, 0, 0, 22,26, 14,1, "MO timing" },
+    { SGRADIOBUT, 0, 0, 23,28, 10,1, "Accurate" },
+    { SGRADIOBUT, 0, 0, 23,30, 6,1, "Fast" },
+    { SGRADIOBUT, 0, 0, 23,32, 9,1, "Instant" },
+    
+    { SGBOX, 0, 0, 38,25, 17,9, NULL },
+    { SGTEXT, 0, 0, 39,26, 14,1, "Ethernet timing" },
+    { SGRADIOBUT, 0, 0, 40,28, 10,1, "Accurate" },
+    { SGRADIOBUT, 0, 0, 40,30, 6,1, "Fast" },
+    { SGRADIOBUT, 0, 0, 40,32, 9,1, "Instant" },
+    
+    { SGBUTTON, SG_DEFAULT, 0, 18,35, 22,1, "Back to system menu" },
     { -1, 0, 0, 0,0, 0,0, NULL }
 };
 
@@ -195,6 +225,24 @@ void Dialog_AdvancedDlg(void) {
         advanceddlg[DLGADV_ADB].state |= SG_SELECTED;
     else
         advanceddlg[DLGADV_ADB].state &= ~SG_SELECTED;
+    
+    for (i = DLGADV_SCSI_ACCURATE; i <= DLGADV_SCSI_INSTANT; i++)
+	{
+		advanceddlg[i].state &= ~SG_SELECTED;
+	}
+    advanceddlg[DLGADV_SCSI_ACCURATE+ConfigureParams.System.nSCSITiming].state |= SG_SELECTED;
+    
+    for (i = DLGADV_MO_ACCURATE; i <= DLGADV_MO_INSTANT; i++)
+	{
+		advanceddlg[i].state &= ~SG_SELECTED;
+	}
+    advanceddlg[DLGADV_MO_ACCURATE+ConfigureParams.System.nMOTiming].state |= SG_SELECTED;
+    
+    for (i = DLGADV_ENET_ACCURATE; i <= DLGADV_ENET_INSTANT; i++)
+	{
+		advanceddlg[i].state &= ~SG_SELECTED;
+	}
+    advanceddlg[DLGADV_ENET_ACCURATE+ConfigureParams.System.nEnetTiming].state |= SG_SELECTED;
 
  
  		
@@ -255,5 +303,26 @@ void Dialog_AdvancedDlg(void) {
         ConfigureParams.System.bADB = true;
     else
         ConfigureParams.System.bADB = false;
+    
+    if (advanceddlg[DLGADV_SCSI_INSTANT].state & SG_SELECTED)
+        ConfigureParams.System.nSCSITiming = IO_TIMING_INSTANT;
+    else if (advanceddlg[DLGADV_SCSI_FAST].state & SG_SELECTED)
+        ConfigureParams.System.nSCSITiming = IO_TIMING_FAST;
+    else
+        ConfigureParams.System.nSCSITiming = IO_TIMING_ACCURATE;
+    
+    if (advanceddlg[DLGADV_MO_INSTANT].state & SG_SELECTED)
+        ConfigureParams.System.nMOTiming = IO_TIMING_INSTANT;
+    else if (advanceddlg[DLGADV_MO_FAST].state & SG_SELECTED)
+        ConfigureParams.System.nMOTiming = IO_TIMING_FAST;
+    else
+        ConfigureParams.System.nMOTiming = IO_TIMING_ACCURATE;
+    
+    if (advanceddlg[DLGADV_ENET_INSTANT].state & SG_SELECTED)
+        ConfigureParams.System.nEnetTiming = IO_TIMING_INSTANT;
+    else if (advanceddlg[DLGADV_ENET_FAST].state & SG_SELECTED)
+        ConfigureParams.System.nEnetTiming = IO_TIMING_FAST;
+    else
+        ConfigureParams.System.nEnetTiming = IO_TIMING_ACCURATE;
 }
 
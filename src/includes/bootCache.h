@@ -0,0 +1,15 @@
+/*
+  Previous - bootCache.h
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_BOOTCACHE_H
+#define HATARI_BOOTCACHE_H
+
+extern void BootCache_Start(void);
+extern void BootCache_VBL(void);
+extern void BootCache_Save(void);
+
+#endif /* HATARI_BOOTCACHE_H */
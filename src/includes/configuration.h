@@ -101,6 +101,8 @@ typedef enum {
   SHORTCUT_LOADMEM,
   SHORTCUT_SAVEMEM,
   SHORTCUT_INSERTDISKA,
+  SHORTCUT_REWIND,
+  SHORTCUT_BOOTCACHE,
   SHORTCUT_KEYS,  /* number of shortcuts */
   SHORTCUT_NONE
 } SHORTCUTKEYIDX;
@@ -144,6 +146,14 @@ typedef struct
   bool bAutoSave;
   char szMemoryCaptureFileName[FILENAME_MAX];
   char szAutoSaveFileName[FILENAME_MAX];
+  bool bCompressSnapShots;
+  bool bRewind;
+  int nRewindInterval;      /* VBLs between rewind checkpoints */
+  int nRewindCheckpoints;   /* maximum number of rewind checkpoints */
+  int nRewindMemSize;       /* memory for rewind checkpoints in MB */
+  bool bBootCache;
+  char szBootCacheDir[FILENAME_MAX];
+  int nBootCacheVBLs;       /* VBLs until the boot state is saved, 0 = on request */
 } CNF_MEMORY;
 
 
@@ -197,16 +207,28 @@ typedef struct
 #define ESP_MAX_DEVS 7
 typedef struct {
   char szImageName[FILENAME_MAX];
+  char szOverlayName[FILENAME_MAX]; /* collects writes if set, image is read-only */
   bool bAttached;
   bool bCDROM;
 } SCSIDISK;
 
+typedef enum
+{
+  SCSI_CACHE_WRITETHROUGH,          /* write to the image right away */
+  SCSI_CACHE_WRITEBACK,             /* write to the image in the background */
+  SCSI_CACHE_UNSAFE                 /* write only if needed, never sync */
+} SCSICACHEPOLICY;
+
 typedef struct
 {
   SCSIDISK target[ESP_MAX_DEVS];    
   
   WRITEPROTECTION nWriteProtection;
   bool bBootFromHardDisk;
+  int nBufferSize;                  /* Max. size of one disk transfer in kB */
+  bool bMapImages;                  /* Access disk images through mmap() if possible */
+  int nCacheSize;                   /* Size of the block cache in kB, 0 = no cache */
+  SCSICACHEPOLICY nCachePolicy;
 } CNF_SCSI;
 
 
@@ -319,6 +341,13 @@ typedef enum
   FPU_CPU = 68040
 } FPUTYPE;
 
+typedef enum
+{
+  IO_TIMING_ACCURATE,             /* device delays as measured on real hardware */
+  IO_TIMING_FAST,                 /* shortest delays the guest drivers tolerate */
+  IO_TIMING_INSTANT               /* complete commands and transfers immediately */
+} IOTIMING;
+
 typedef struct
 {
   bool bColor;
@@ -340,6 +369,12 @@ typedef struct
   FPUTYPE n_FPUType;
   bool bCompatibleFPU;            /* More compatible FPU */
   bool bMMU;                      /* TRUE if MMU is enabled */
+  bool bIdleDetect;               /* Skip ahead to the next event while the CPU is idle */
+  int nIdleLoopPC;                /* Address of the guest idle loop, 0 = none */
+  IOTIMING nSCSITiming;           /* ESP command and DMA transfer delays */
+  IOTIMING nMOTiming;             /* MO drive, formatter and ECC delays */
+  IOTIMING nEnetTiming;           /* Ethernet transmitter/receiver delays */
+  bool bAsyncDiskIO;              /* Access SCSI and MO disk images from a separate thread */
 } CNF_SYSTEM;
 
 typedef struct
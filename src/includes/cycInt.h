@@ -22,6 +22,7 @@ typedef enum
   INTERRUPT_MO_IO,
   INTERRUPT_ECC_IO,
   INTERRUPT_ENET_IO,
+  INTERRUPT_DISKIO,
   MAX_INTERRUPTS
 } interrupt_id;
 
@@ -51,6 +52,7 @@ extern void (*PendingInterruptFunction)(void);
 extern int PendingInterruptCount;
 
 extern void CycInt_Reset(void);
+extern void CycInt_RegisterHandler(interrupt_id Handler, void (*pFunction)(void));
 extern void CycInt_MemorySnapShot_Capture(bool bSave);
 extern void CycInt_AcknowledgeInterrupt(void);
 extern void CycInt_AddAbsoluteInterrupt(int CycleTime, int CycleType, interrupt_id Handler);
@@ -61,5 +63,6 @@ extern void CycInt_RemovePendingInterrupt(interrupt_id Handler);
 extern void CycInt_ResumeStoppedInterrupt(interrupt_id Handler);
 extern bool CycInt_InterruptActive(interrupt_id Handler);
 extern int CycInt_FindCyclesPassed(interrupt_id Handler, int CycleType);
+extern Sint64 CycInt_GetTime(void);
 
 #endif /* ifndef HATARI_CYCINT_H */
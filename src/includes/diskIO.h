@@ -0,0 +1,35 @@
+/*
+  Previous - diskIO.h
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_DISKIO_H
+#define HATARI_DISKIO_H
+
+typedef struct DISKIO_REQUEST DISKIO_REQUEST;
+
+struct DISKIO_REQUEST {
+	Uint32 (*work)(DISKIO_REQUEST *req);  /* called on the I/O thread */
+	void (*done)(DISKIO_REQUEST *req);    /* called on the emulation thread */
+	int unit;                             /* drive or target number */
+	Uint8 *buf;
+	Uint32 lba;
+	Uint32 blocks;
+	Uint32 result;                        /* return value of work */
+	bool busy;                            /* submitted, done not called yet */
+	bool finished;                        /* work called, done not called yet */
+	Sint64 deadline;                      /* CycInt time done is called at the earliest */
+	DISKIO_REQUEST *next;                 /* pending list, internal */
+};
+
+extern void DiskIO_Reset(void);
+extern void DiskIO_UnInit(void);
+extern void DiskIO_Submit(DISKIO_REQUEST *req, int latency);
+extern void DiskIO_Wait(DISKIO_REQUEST *req);
+extern bool DiskIO_Idle(void);
+extern void DiskIO_Sync(void);
+extern void DiskIO_InterruptHandler(void);
+
+#endif /* HATARI_DISKIO_H */
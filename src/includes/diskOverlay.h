@@ -0,0 +1,25 @@
+/*
+  Previous - diskOverlay.h
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_DISKOVERLAY_H
+#define HATARI_DISKOVERLAY_H
+
+#define OVERLAY_BLOCKSIZE   512
+
+typedef struct DISKOVERLAY DISKOVERLAY;
+
+extern DISKOVERLAY *DiskOverlay_Open(const char *pszName, FILE *base, const char *pszBaseName);
+extern void DiskOverlay_Close(DISKOVERLAY *ovl);
+extern Uint32 DiskOverlay_Read(DISKOVERLAY *ovl, Uint8 *buf, Uint32 lba, Uint32 blocks);
+extern Uint32 DiskOverlay_Write(DISKOVERLAY *ovl, const Uint8 *buf, Uint32 lba, Uint32 blocks);
+extern bool DiskOverlay_Sync(DISKOVERLAY *ovl);
+extern bool DiskOverlay_Commit(DISKOVERLAY *ovl);
+extern bool DiskOverlay_Discard(DISKOVERLAY *ovl);
+extern Uint32 DiskOverlay_GetUsedBlocks(DISKOVERLAY *ovl);
+extern bool DiskOverlay_GetBaseName(const char *pszName, char *pszBaseName, size_t len);
+
+#endif /* HATARI_DISKOVERLAY_H */
@@ -42,6 +42,8 @@ void dma_scc_read_memory(void);
 void dma_sndout_read_memory(void);
 
 /* Delayed DMA interrupt handlers */
+void DMA_Reset(void);
+void DMA_MemorySnapShot_Capture(bool bSave);
 void M2RDMA_InterruptHandler(void);
 void R2MDMA_InterruptHandler(void);
 
@@ -77,5 +77,7 @@ bool esp_transfer_done(bool write);
 
 extern Uint32 esp_counter;
 
+void ESP_Reset(void);
+void ESP_MemorySnapShot_Capture(bool bSave);
 void ESP_InterruptHandler(void);
 void ESP_IO_Handler(void);
\ No newline at end of file
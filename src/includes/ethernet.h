@@ -41,3 +41,4 @@ struct {
 
 void ENET_IO_Handler(void);
 void Ethernet_Reset(void);
+void Ethernet_MemorySnapShot_Capture(bool bSave);
@@ -138,6 +138,10 @@ extern Uint32 BusErrorPC;
 extern bool bBusErrorReadWrite;
 extern int nCpuFreqShift;
 extern int nWaitStateCycles;
+extern int nCyclesBatched;
+extern bool bCpuIdleSkip;
+extern Uint32 nCpuIdleLoopPC;
+extern bool bCpuWasIdle;
 extern int BusMode;
 
 extern int	LastOpcodeFamily;
@@ -162,6 +166,53 @@ static inline void M68000_AddCycles(int cycles)
 }
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Add CPU cycles to the current block of instructions. The CPU loop only
+ * applies them to the cycle counters when the next interrupt event is due,
+ * or when a special condition has to be handled (see M68000_SyncCycles).
+ * NOTE: All times are rounded up to nearest 4 cycles.
+ */
+static inline void M68000_AddCyclesBatched(int cycles)
+{
+	cycles = (cycles + 3) & ~3;
+	nCyclesBatched += cycles >> nCpuFreqShift;
+}
+
+/**
+ * Return true if the next interrupt event is due after the batched cycles.
+ */
+static inline bool M68000_BatchDone(void)
+{
+	return INT_CONVERT_TO_INTERNAL(nCyclesBatched, INT_CPU_CYCLE) >= PendingInterruptCount;
+}
+
+/**
+ * Apply the batched cycles to PendingInterruptCount and nCyclesMainCounter.
+ * Must be called before these are read.
+ */
+static inline void M68000_SyncCycles(void)
+{
+	PendingInterruptCount -= INT_CONVERT_TO_INTERNAL(nCyclesBatched, INT_CPU_CYCLE);
+	nCyclesMainCounter += nCyclesBatched;
+	nCyclesBatched = 0;
+}
+
+/**
+ * Skip idle CPU time up to the next interrupt event.
+ * The cycle counters must be in sync (see M68000_SyncCycles).
+ */
+static inline void M68000_SkipIdleCycles(void)
+{
+	if (PendingInterruptCount > 0)
+	{
+		nCyclesMainCounter += INT_CONVERT_FROM_INTERNAL(PendingInterruptCount, INT_CPU_CYCLE);
+		PendingInterruptCount = 0;
+	}
+	bCpuWasIdle = true;
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Add CPU cycles, take cycles pairing into account. Pairing will make
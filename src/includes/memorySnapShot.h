@@ -7,5 +7,13 @@
 
 
 extern void MemorySnapShot_Store(void *pData, int Size);
-extern void MemorySnapShot_Capture(const char *pszFileName, bool bConfirm);
-extern void MemorySnapShot_Restore(const char *pszFileName, bool bConfirm);
+extern void MemorySnapShot_StoreBlock(const char *pszId, void *pData, Uint32 Size);
+extern void MemorySnapShot_SetError(void);
+extern const char *MemorySnapShot_GetParent(void);
+extern bool MemorySnapShot_RestoreParent(const char *pszFileName);
+extern void MemorySnapShot_ResetChain(void);
+extern bool MemorySnapShot_Capture(const char *pszFileName, bool bConfirm);
+extern bool MemorySnapShot_CaptureDelta(const char *pszFileName, bool bConfirm);
+extern bool MemorySnapShot_Restore(const char *pszFileName, bool bConfirm);
+extern Uint8 *MemorySnapShot_CaptureState(Uint32 *pnSize);
+extern bool MemorySnapShot_RestoreState(Uint8 *pBuf, Uint32 nSize);
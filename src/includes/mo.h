@@ -1,4 +1,5 @@
 void MO_Reset(void);
+void MO_MemorySnapShot_Capture(bool bSave);
 void MO_Insert(int disk);
 void MO_Eject(int disk);
 
@@ -6,10 +7,27 @@ void MO_InterruptHandler(void);
 void MO_IO_Handler(void);
 void ECC_IO_Handler(void);
 
+/* Disk layout */
+#define MO_SEC_PER_TRACK    16
+#define MO_TRACK_OFFSET     4096 /* offset to first logical sector of kernel driver is 4149 */
+#define MO_TRACK_LIMIT      19819-(MO_TRACK_OFFSET) /* no more tracks beyond this offset */
+
+#define MO_SECTORSIZE_DISK  1296 /* size of encoded sector, like stored on disk */
+#define MO_SECTORSIZE_DATA  1024 /* size of decoded sector, like handled by software */
+
+/* Disk images either store the encoded sectors like they are on the disk,
+ * or only the data of each sector followed by a bitmap of erased sectors
+ * (logical images). Logical images always have the size of a full disk. */
+#define MO_SECTORS          ((MO_TRACK_LIMIT)*MO_SEC_PER_TRACK)
+#define MO_LOGICAL_MAPSIZE  ((MO_SECTORS+7)/8)
+#define MO_LOGICAL_MAPSTART (MO_SECTORS*MO_SECTORSIZE_DATA)
+#define MO_LOGICAL_SIZE     (MO_LOGICAL_MAPSTART+MO_LOGICAL_MAPSIZE)
+
 struct {
     Uint8 data[1296];
     Uint32 size;
     Uint32 limit;
+    bool plain; /* holds the data of a sector without ECC, see mo.c */
 } ecc_buffer[2];
 extern int eccin;
 extern int eccout;
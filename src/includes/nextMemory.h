@@ -97,7 +97,17 @@ static inline Uint8 NEXTMemory_ReadByte(Uint32 Address)
 }
 
 
+/* Users of the dirty page bitmap, each one has its own copy to clear */
+enum {
+	NEXTRAM_DIRTY_SNAPSHOT,
+	NEXTRAM_DIRTY_REWIND,
+	NEXTRAM_DIRTY_USERS
+};
+#define NEXTRAM_DIRTY_WORDS (NEXT_RAM_MAX_PAGES/32+1)
+
 extern void NEXTMemory_Clear(Uint32 StartAddress, Uint32 EndAddress);
+extern Uint32 *NEXTMemory_GetDirtyPages(int user);
+extern void NEXTMemory_ClearDirtyPages(int user);
 extern bool NEXTMemory_SafeCopy(Uint32 addr, Uint8 *src, unsigned int len, const char *name);
 extern void NEXTMemory_MemorySnapShot_Capture(bool bSave);
 extern void NEXTMemory_SetDefaultConfig(void);
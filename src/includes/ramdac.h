@@ -1,3 +1,5 @@
 void RAMDAC_CMD_Write(void);
 
-void ramdac_video_interrupt(void);
\ No newline at end of file
+void ramdac_video_interrupt(void);
+
+void RAMDAC_MemorySnapShot_Capture(bool bSave);
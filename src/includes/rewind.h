@@ -0,0 +1,15 @@
+/*
+  Previous - rewind.h
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_REWIND_H
+#define HATARI_REWIND_H
+
+extern void Rewind_Reset(void);
+extern void Rewind_VBL(void);
+extern void Rewind_Step(void);
+
+#endif /* HATARI_REWIND_H */
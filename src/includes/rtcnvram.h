@@ -5,4 +5,5 @@ void rtc_request_power_down(void);
 void rtc_stop_pdown_request(void);
 
 void nvram_init(void);
+void RTC_MemorySnapShot_Capture(bool bSave);
 void nvram_checksum(int force);
\ No newline at end of file
@@ -226,6 +226,7 @@ void SCC_Read(void);
 void SCC_Write(void);
 
 void SCC_Reset(void);
+void SCC_MemorySnapShot_Capture(bool bSave);
 void SCC_Interrupt(void);
 void SCC_ResetChannel(int ch);
 void SCC_InitChannel(int ch);
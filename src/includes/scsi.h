@@ -21,20 +21,27 @@ struct {
 /* This buffer temporarily stores data to be written to memory or disk */
 
 struct {
-    Uint8 data[512]; /* FIXME: BLOCKSIZE */
+    Uint8 *data; /* staging buffer of the current target */
     Uint32 limit;
     Uint32 size;
     bool disk;
+    bool pending; /* waiting for data from the disk I/O thread */
 } scsi_buffer;
 
 
 void SCSI_Init(void);
 void SCSI_Uninit(void);
 void SCSI_Reset(void);
+void SCSI_MemorySnapShot_Capture(bool bSave);
+void SCSI_Flush(void);
+void SCSI_VBL(void);
+bool SCSI_GetCacheStats(Uint32 *hits, Uint32 *misses);
 
 Uint8 SCSIdisk_Send_Status(void);
 Uint8 SCSIdisk_Send_Message(void);
 Uint8 SCSIdisk_Send_Data(void);
 void SCSIdisk_Receive_Data(Uint8 val);
+Uint32 SCSIdisk_Send_Data_Block(Uint8 *dst, Uint32 len);
+Uint32 SCSIdisk_Receive_Data_Block(const Uint8 *src, Uint32 len);
 bool SCSIdisk_Select(Uint8 target);
 void SCSIdisk_Receive_Command(Uint8 *commandbuf, Uint8 identify);
@@ -52,6 +52,7 @@ int get_interrupt_level(void);
 void SID_Read(void);
 
 void SCR_Reset(void);
+void SysReg_MemorySnapShot_Capture(bool bSave);
 void SCR1_Read0(void);
 void SCR1_Read1(void);
 void SCR1_Read2(void);
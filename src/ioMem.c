@@ -103,6 +103,17 @@ void IoMem_UnInit(void)
 }
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Save/Restore snapshot of the IO memory. Many registers keep the value
+ * that was written last only here.
+ */
+void IoMem_MemorySnapShot_Capture(bool bSave)
+{
+	MemorySnapShot_Store(IoMem, sizeof(NEXTIo));
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Handle byte read access from IO memory.
@@ -51,6 +51,7 @@ Uint32 lasteventc; // debugging code
 
 void System_Timer_Read(void) { // tuned for power-on test
 //    lasteventc = eventcounter; // debugging code
+    M68000_SyncCycles();
     if (ConfigureParams.System.nCpuLevel == 3) {
 //        eventcounter = (nCyclesMainCounter/((128/ConfigureParams.System.nCpuFreq)*3))&0xFFFFF; // debugging code
         IoMem_WriteLong(IoAccessCurrentAddress&0x1FFFF, (nCyclesMainCounter/((128/ConfigureParams.System.nCpuFreq)*3))&0xFFFFF);
@@ -17,6 +17,7 @@
 #include "sysReg.h"
 #include "dma.h"
 #include "rtcnvram.h"
+#include "memorySnapShot.h"
 
 #define LOG_KMS_LEVEL LOG_WARN
 #define IO_SEG_MASK	0x1FFFF
@@ -498,3 +499,13 @@ void kms_response(void) {
     
     kms_interrupt();
 }
+
+
+/* Save/Restore snapshot of the keyboard, mouse and sound interface */
+void KMS_MemorySnapShot_Capture(bool bSave) {
+    MemorySnapShot_Store(&kms, sizeof(kms));
+    MemorySnapShot_Store(&km_address, sizeof(km_address));
+    MemorySnapShot_Store(&km_dev_msk, sizeof(km_dev_msk));
+    MemorySnapShot_Store(&m_right, sizeof(m_right));
+    MemorySnapShot_Store(&m_left, sizeof(m_left));
+}
@@ -11,6 +11,7 @@ const char M68000_fileid[] = "Hatari m68000.c : " __DATE__ " " __TIME__;
 
 #include "main.h"
 #include "configuration.h"
+#include "bootCache.h"
 #include "hatari-glue.h"
 #include "cycInt.h"
 #include "m68000.h"
@@ -20,12 +21,18 @@ const char M68000_fileid[] = "Hatari m68000.c : " __DATE__ " " __TIME__;
 #include "nextMemory.h"
 
 #include "mmu_common.h"
+#include "cpummu.h"
+#include "cpummu030.h"
 
 Uint32 BusErrorAddress;         /* Stores the offending address for bus-/address errors */
 Uint32 BusErrorPC;              /* Value of the PC when bus error occurs */
 bool bBusErrorReadWrite;        /* 0 for write error, 1 for read error */
 int nCpuFreqShift;              /* Used to emulate higher CPU frequencies: 0=8MHz, 1=16MHz, 2=32Mhz */
 int nWaitStateCycles;           /* Used to emulate the wait state cycles of certain IO registers */
+int nCyclesBatched;             /* CPU cycles not yet added to the cycle counters */
+bool bCpuIdleSkip;              /* Skip ahead to the next event while the CPU is stopped */
+Uint32 nCpuIdleLoopPC;          /* PC of the guest idle loop, 1 if none (never matches) */
+bool bCpuWasIdle;               /* Idle time has been skipped since the last VBL */
 int BusMode = BUS_MODE_CPU;	/* Used to tell which part is owning the bus (cpu, blitter, ...) */
 
 int LastOpcodeFamily = i_NOP;	/* see the enum in readcpu.h i_XXX */
@@ -190,6 +197,10 @@ void M68000_Start(void)
 	{
 		MemorySnapShot_Restore(ConfigureParams.Memory.szAutoSaveFileName, false);
 	}
+	else
+	{
+		BootCache_Start();
+	}
 
 	m68k_go(true);
 }
@@ -247,6 +258,12 @@ void M68000_CheckCpuSettings(void)
 	changed_prefs.fpu_strict = ConfigureParams.System.bCompatibleFPU;
 	changed_prefs.mmu_model = ConfigureParams.System.bMMU?changed_prefs.cpu_model:0;
 
+	bCpuIdleSkip = ConfigureParams.System.bIdleDetect;
+	if (bCpuIdleSkip && ConfigureParams.System.nIdleLoopPC)
+		nCpuIdleLoopPC = ConfigureParams.System.nIdleLoopPC & ~1;
+	else
+		nCpuIdleLoopPC = 1;
+
 	if (table68k)
 		check_prefs_changed_cpu();
 }
@@ -317,6 +334,23 @@ void M68000_MemorySnapShot_Capture(bool bSave)
 	MemorySnapShot_Store(&regs.cacr, sizeof(regs.cacr));          /* CACR */
 	MemorySnapShot_Store(&regs.msp, sizeof(regs.msp));            /* MSP */
 
+	/* 68030 MMU */
+	MemorySnapShot_Store(&crp_030, sizeof(crp_030));              /* CRP */
+	MemorySnapShot_Store(&srp_030, sizeof(srp_030));              /* SRP */
+	MemorySnapShot_Store(&tt0_030, sizeof(tt0_030));              /* TT0 */
+	MemorySnapShot_Store(&tt1_030, sizeof(tt1_030));              /* TT1 */
+	MemorySnapShot_Store(&tc_030, sizeof(tc_030));                /* TC */
+	MemorySnapShot_Store(&mmusr_030, sizeof(mmusr_030));          /* MMUSR */
+	/* 68040 MMU */
+	MemorySnapShot_Store(&regs.itt0, sizeof(regs.itt0));          /* ITT0 */
+	MemorySnapShot_Store(&regs.itt1, sizeof(regs.itt1));          /* ITT1 */
+	MemorySnapShot_Store(&regs.dtt0, sizeof(regs.dtt0));          /* DTT0 */
+	MemorySnapShot_Store(&regs.dtt1, sizeof(regs.dtt1));          /* DTT1 */
+	MemorySnapShot_Store(&regs.tcr, sizeof(regs.tcr));            /* TC */
+	MemorySnapShot_Store(&regs.urp, sizeof(regs.urp));            /* URP */
+	MemorySnapShot_Store(&regs.srp, sizeof(regs.srp));            /* SRP */
+	MemorySnapShot_Store(&regs.mmusr, sizeof(regs.mmusr));        /* MMUSR */
+
 	if (!bSave)
 	{
 		M68000_SetPC(regs.pc);
@@ -328,6 +362,21 @@ void M68000_MemorySnapShot_Capture(bool bSave)
 			m68k_areg(regs, 7) = regs.isp;
 		else
 			m68k_areg(regs, 7) = regs.usp;
+
+		/* The translation caches belong to the old state */
+		if (currprefs.mmu_model)
+		{
+			if (currprefs.cpu_model >= 68040)
+			{
+				mmu_set_tc(regs.tcr);
+				mmu_set_super(regs.s != 0);
+				mmu_tt_modified();
+			}
+			else
+			{
+				mmu030_restore_regs();
+			}
+		}
 	}
 
 	if (bSave)
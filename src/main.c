@@ -36,6 +36,9 @@ const char Main_fileid[] = "Hatari main.c : " __DATE__ " " __TIME__;
 #include "debugui.h"
 #include "clocks_timings.h"
 #include "file.h"
+#include "diskIO.h"
+#include "scsi.h"
+#include "rewind.h"
 
 #include "hatari-glue.h"
 
@@ -258,8 +261,9 @@ void Main_SetRunVBLs(Uint32 vbls)
  * wait for a multiple of 10ms due to the scheduler on these systems), so we have
  * to "busy wait" there to get an accurate timing.
  * All times are expressed as micro seconds, to avoid too much rounding error.
+ * If bSleep is false, the VBL is only counted and the frame runs at full speed.
  */
-void Main_WaitOnVbl(void)
+void Main_WaitOnVbl(bool bSleep)
 {
 	Sint64 CurrentTicks;
 	static Sint64 DestTicks = 0;
@@ -284,6 +288,13 @@ void Main_WaitOnVbl(void)
 		DestTicks = CurrentTicks + FrameDuration_micro;
     }
 
+	if (!bSleep)
+	{
+		/* Only update DestTicks for next VBL */
+		DestTicks = CurrentTicks + FrameDuration_micro;
+		return;
+	}
+
 	nDelay = DestTicks - CurrentTicks;
 
 	/* Do not wait if we are in fast forward mode or if we are totally out of sync */
@@ -621,6 +632,9 @@ static void Main_UnInit(void)
 	SDLGui_UnInit();
 	Screen_UnInit();
 	Exit680x0();
+	SCSI_Uninit();
+	DiskIO_UnInit();
+	Rewind_Reset();
 
 	/* SDL uninit: */
 	SDL_Quit();
@@ -15,10 +15,30 @@
   save/restore all variables that are local to it. We use one function to
   reduce redundancy and the function 'MemorySnapShot_Store' decides if it
   should save or restore the data.
+
+  A delta snapshot stores main memory only partially: it contains the pages
+  written since the previous snapshot was saved or restored, and the name
+  of that snapshot, which is restored first. Deltas can be based on other
+  deltas up to a limit, after that a full snapshot is saved again. All
+  snapshots of a chain have to be kept for restoring the last one.
+
+  For the rewind checkpoints the state of CPU and chips can also be saved
+  to and restored from a buffer in memory.
+
+  Not captured are the connection to the host network, the contents of the
+  disk images and disk I/O requests in flight. Pending requests are
+  completed before saving, the disk images have to be kept unchanged for
+  restoring a snapshot.
+
+  The file starts with a table of sections, one for each of the functions
+  above and one for each large block of memory like main and video memory,
+  each with a CRC-32 of its data. Sections are either stored uncompressed
+  at page aligned offsets, or split into chunks which are compressed and
+  decompressed by a thread per host CPU.
 */
 const char MemorySnapShot_fileid[] = "Hatari memorySnapShot.c : " __DATE__ " " __TIME__;
 
-#include <SDL_types.h>
+#include <SDL.h>
 #include <errno.h>
 
 #include "main.h"
@@ -27,254 +47,917 @@ const char MemorySnapShot_fileid[] = "Hatari memorySnapShot.c : " __DATE__ " " _
 #include "file.h"
 #include "cycInt.h"
 #include "cycles.h"
+#include "diskIO.h"
+#include "dma.h"
+#include "esp.h"
+#include "ethernet.h"
 #include "ioMem.h"
+#include "kms.h"
 #include "log.h"
 #include "m68000.h"
 #include "memorySnapShot.h"
+#include "mo.h"
+#include "ramdac.h"
 #include "reset.h"
+#include "rewind.h"
+#include "rtcnvram.h"
+#include "scc.h"
+#include "scsi.h"
 #include "str.h"
 #include "nextMemory.h"
+#include "sysReg.h"
 #include "screen.h"
 #include "video.h"
 #include "statusbar.h"
 
 
-#define VERSION_STRING      "0.0.1"   /* Version number of compatible memory snapshots - Always 6 bytes (inc' NULL) */
-
-#define COMPRESS_MEMORYSNAPSHOT       /* Compress snapshots to reduce disk space used */
-
-#ifdef COMPRESS_MEMORYSNAPSHOT
+#define VERSION_STRING      "0.0.5"   /* Version number of compatible memory snapshots - Always 6 bytes (inc' NULL) */
 
 /* Remove possible conflicting mkdir declaration from cpu/sysdeps.h */
 #undef mkdir
 #include <zlib.h>
-typedef gzFile MSS_File;
-
-#else
 
-typedef FILE* MSS_File;
 
-#endif
+#define MSS_MAGIC           "PREVSNAP"
+#define MSS_MAX_SECTIONS    32
+#define MSS_ALIGN           4096            /* of uncompressed sections */
+#define MSS_CHUNK_SIZE      (1024*1024)     /* compressed independently */
+#define MSS_MAX_THREADS     16
+#define MSS_BATCH_CHUNKS    (2*MSS_MAX_THREADS)
 
+#define MSS_COMPRESSED      0x01    /* chunk size table and deflated chunks */
 
-static MSS_File CaptureFile;
+typedef struct
+{
+	char   Id[4];
+	Uint32 Flags;
+	Uint32 Offset;      /* in the file */
+	Uint32 Size;        /* in the file */
+	Uint32 Length;      /* of the data */
+	Uint32 Crc;         /* CRC-32 of the data */
+} MSS_SECTION;
+
+typedef struct
+{
+	char   Magic[8];
+	char   Version[8];
+	Uint32 nSections;
+	Uint32 Reserved;
+	MSS_SECTION Sections[MSS_MAX_SECTIONS];
+} MSS_HEADER;
+
+typedef struct
+{
+	FILE *fp;
+	bool bSave;
+	bool bCompress;
+	Uint32 nEnd;        /* end of the last section written */
+	MSS_HEADER Header;
+} MSS_FILE;
+
+/* Sections in the order they are restored. The configuration has to come
+ * first since the emulator is reset after restoring it. Large blocks of
+ * memory are written to sections of their own (see MemorySnapShot_StoreBlock). */
+static const struct
+{
+	char Id[5];
+	void (*Capture)(bool bSave);
+} MemorySnapShot_Sections[] =
+{
+	{ "CONF", Configuration_MemorySnapShot_Capture },
+	{ "MEM ", NEXTMemory_MemorySnapShot_Capture },
+	{ "CINT", CycInt_MemorySnapShot_Capture },
+	{ "CYCL", Cycles_MemorySnapShot_Capture },
+	{ "CPU ", M68000_MemorySnapShot_Capture },
+	{ "VID ", Video_MemorySnapShot_Capture },
+	{ "IO  ", IoMem_MemorySnapShot_Capture },
+	{ "SCR ", SysReg_MemorySnapShot_Capture },
+	{ "DMA ", DMA_MemorySnapShot_Capture },
+	{ "ESP ", ESP_MemorySnapShot_Capture },
+	{ "SCSI", SCSI_MemorySnapShot_Capture },
+	{ "MO  ", MO_MemorySnapShot_Capture },
+	{ "SCC ", SCC_MemorySnapShot_Capture },
+	{ "ENET", Ethernet_MemorySnapShot_Capture },
+	{ "RTC ", RTC_MemorySnapShot_Capture },
+	{ "KMS ", KMS_MemorySnapShot_Capture },
+	{ "DAC ", RAMDAC_MemorySnapShot_Capture }
+};
+
+#define MSS_NUM_SECTIONS    (int)(sizeof(MemorySnapShot_Sections)/sizeof(MemorySnapShot_Sections[0]))
+#define MSS_SECTION_CONF    0
+#define MSS_SECTION_MEM     1
+#define MSS_SECTION_CHIPS   2       /* first section saved for rewind */
+
+static MSS_FILE *CaptureFile;
 static bool bCaptureSave, bCaptureError;
 
+/* Buffer the sections and the rewind checkpoints are captured to */
+static Uint8 *pCaptureBuf;
+static Uint32 nCaptureBufSize, nCaptureBufPos;
+
+#define MAX_DELTA_CHAIN     32      /* deltas based on a full snapshot */
+
+/* The full snapshot and the deltas the next delta is based on, in order */
+static char szChain[MAX_DELTA_CHAIN+1][FILENAME_MAX];
+static int nChain;
+static Uint32 nChainRamEnd;
+static bool bCaptureDelta;
+static int nRestoreDepth;
+
+/* Chunks of a section processed by the worker threads */
+typedef enum
+{
+	MSS_JOB_CRC,
+	MSS_JOB_COMPRESS,
+	MSS_JOB_DECOMPRESS
+} MSS_JOB;
+
+typedef struct
+{
+	Uint8 *pData;
+	Uint32 nLength;
+	Uint8 *pPacked;
+	Uint32 nPacked;
+	Uint32 Crc;
+	bool bOk;
+} MSS_CHUNK;
+
+static MSS_JOB Job;
+static MSS_CHUNK *pJobChunks;
+static int nJobChunks;
+static SDL_atomic_t nJobNext;
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Compress, decompress and checksum chunks until there are none left.
+ */
+static int MemorySnapShot_Worker(void *unused)
+{
+	MSS_CHUNK *c;
+	uLongf len;
+	int i;
+
+	while ((i = SDL_AtomicAdd(&nJobNext, 1)) < nJobChunks)
+	{
+		c = &pJobChunks[i];
+		c->bOk = true;
+		if (Job == MSS_JOB_COMPRESS)
+		{
+			len = compressBound(c->nLength);
+			c->bOk = compress2(c->pPacked, &len, c->pData, c->nLength,
+			                   Z_BEST_SPEED) == Z_OK;
+			c->nPacked = len;
+		}
+		else if (Job == MSS_JOB_DECOMPRESS)
+		{
+			len = c->nLength;
+			c->bOk = uncompress(c->pData, &len, c->pPacked, c->nPacked) == Z_OK &&
+			         len == c->nLength;
+		}
+		c->Crc = crc32(0, c->pData, c->nLength);
+	}
+	return 0;
+}
+
 
 /*-----------------------------------------------------------------------*/
 /**
- * Open file.
+ * Process chunks using all host CPUs, the calling thread is one of the
+ * workers. Returns false if any chunk failed.
  */
-static MSS_File MemorySnapShot_fopen(const char *pszFileName, const char *pszMode)
+static bool MemorySnapShot_RunJob(MSS_JOB job, MSS_CHUNK *pChunks, int nChunks)
 {
-#ifdef COMPRESS_MEMORYSNAPSHOT
-	return gzopen(pszFileName, pszMode);
-#else
-	return fopen(pszFileName, pszMode);
-#endif
+	SDL_Thread *threads[MSS_MAX_THREADS-1];
+	int nThreads = SDL_GetCPUCount();
+	bool bOk = true;
+	int i;
+
+	if (nThreads > MSS_MAX_THREADS)
+		nThreads = MSS_MAX_THREADS;
+	if (nThreads > nChunks)
+		nThreads = nChunks;
+
+	Job = job;
+	pJobChunks = pChunks;
+	nJobChunks = nChunks;
+	SDL_AtomicSet(&nJobNext, 0);
+
+	for (i = 0; i < nThreads-1; i++)
+		threads[i] = SDL_CreateThread(MemorySnapShot_Worker, "snapshot", NULL);
+	MemorySnapShot_Worker(NULL);
+	for (i = 0; i < nThreads-1; i++)
+	{
+		if (threads[i])
+			SDL_WaitThread(threads[i], NULL);
+	}
+
+	for (i = 0; i < nChunks; i++)
+		bOk = bOk && pChunks[i].bOk;
+	return bOk;
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
- * Close file.
+ * Split data into chunks and return their number.
  */
-static void MemorySnapShot_fclose(MSS_File fhndl)
+static int MemorySnapShot_SplitChunks(MSS_CHUNK *pChunks, Uint8 *pData, Uint32 nLength)
 {
-#ifdef COMPRESS_MEMORYSNAPSHOT
-	gzclose(fhndl);
-#else
-	fclose(fhndl);
-#endif
+	int n = 0;
+
+	while (nLength > 0)
+	{
+		pChunks[n].pData = pData;
+		pChunks[n].nLength = nLength < MSS_CHUNK_SIZE ? nLength : MSS_CHUNK_SIZE;
+		pData += pChunks[n].nLength;
+		nLength -= pChunks[n].nLength;
+		n++;
+	}
+	return n;
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
- * Read from file.
+ * Write data as chunks compressed in parallel, preceded by a table of the
+ * compressed chunk sizes. Returns the number of bytes written or 0 on error.
  */
-static int MemorySnapShot_fread(MSS_File fhndl, char *buf, int len)
+static Uint32 MemorySnapShot_WriteCompressed(MSS_SECTION *pSection, Uint8 *pData)
 {
-#ifdef COMPRESS_MEMORYSNAPSHOT
-	return gzread(fhndl, buf, len);
-#else
-	return fread(buf, 1, len, fhndl);
-#endif
+	FILE *fp = CaptureFile->fp;
+	int nChunks = (pSection->Length + MSS_CHUNK_SIZE - 1) / MSS_CHUNK_SIZE;
+	MSS_CHUNK chunks[MSS_BATCH_CHUNKS];
+	Uint8 *pPacked;
+	Uint32 *pSizes;
+	Uint32 nSize, nLength;
+	int i, n, first;
+	bool bOk;
+
+	pSizes = calloc(nChunks + 1, sizeof(Uint32));
+	pPacked = malloc(MSS_BATCH_CHUNKS * compressBound(MSS_CHUNK_SIZE));
+	bOk = pSizes && pPacked &&
+	      fwrite(pSizes, sizeof(Uint32), nChunks, fp) == (size_t)nChunks;
+	nSize = nChunks * sizeof(Uint32);
+
+	/* Compress a batch at a time to bound the memory needed */
+	for (first = 0; bOk && first < nChunks; first += n)
+	{
+		nLength = pSection->Length - first * MSS_CHUNK_SIZE;
+		if (nLength > MSS_BATCH_CHUNKS * MSS_CHUNK_SIZE)
+			nLength = MSS_BATCH_CHUNKS * MSS_CHUNK_SIZE;
+		n = MemorySnapShot_SplitChunks(chunks, pData + first * MSS_CHUNK_SIZE, nLength);
+		for (i = 0; i < n; i++)
+			chunks[i].pPacked = pPacked + i * compressBound(MSS_CHUNK_SIZE);
+
+		bOk = MemorySnapShot_RunJob(MSS_JOB_COMPRESS, chunks, n);
+		for (i = 0; bOk && i < n; i++)
+		{
+			bOk = fwrite(chunks[i].pPacked, 1, chunks[i].nPacked, fp) == chunks[i].nPacked;
+			pSizes[first+i] = chunks[i].nPacked;
+			pSection->Crc = crc32_combine(pSection->Crc, chunks[i].Crc, chunks[i].nLength);
+			nSize += chunks[i].nPacked;
+		}
+	}
+
+	/* Now the chunk sizes are known */
+	bOk = bOk && fseek(fp, pSection->Offset, SEEK_SET) == 0 &&
+	      fwrite(pSizes, sizeof(Uint32), nChunks, fp) == (size_t)nChunks;
+
+	free(pPacked);
+	free(pSizes);
+	return bOk ? nSize : 0;
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
- * Write data to file.
+ * Write data to a new section of the snapshot file.
  */
-static int MemorySnapShot_fwrite(MSS_File fhndl, const char *buf, int len)
+static void MemorySnapShot_WriteSection(const char *pszId, Uint8 *pData, Uint32 nLength)
 {
-#ifdef COMPRESS_MEMORYSNAPSHOT
-	return gzwrite(fhndl, buf, len);
-#else
-	return fwrite(buf, 1, len, fhndl);
-#endif
+	MSS_HEADER *pHeader = &CaptureFile->Header;
+	MSS_SECTION *pSection;
+	MSS_CHUNK *pChunks;
+	int i, nChunks;
+
+	if (bCaptureError)
+		return;
+	if (pHeader->nSections == MSS_MAX_SECTIONS)
+	{
+		bCaptureError = true;
+		return;
+	}
+	pSection = &pHeader->Sections[pHeader->nSections++];
+	memcpy(pSection->Id, pszId, sizeof(pSection->Id));
+	pSection->Length = nLength;
+	pSection->Crc = crc32(0, Z_NULL, 0);
+
+	if (CaptureFile->bCompress)
+	{
+		pSection->Flags = MSS_COMPRESSED;
+		pSection->Offset = CaptureFile->nEnd;
+		if (fseek(CaptureFile->fp, pSection->Offset, SEEK_SET) == 0)
+			pSection->Size = MemorySnapShot_WriteCompressed(pSection, pData);
+		if (pSection->Size == 0 && nLength > 0)
+			bCaptureError = true;
+	}
+	else
+	{
+		/* Page aligned, so the data could be mapped from the file */
+		pSection->Flags = 0;
+		pSection->Offset = (CaptureFile->nEnd + MSS_ALIGN - 1) & ~(MSS_ALIGN - 1);
+		pSection->Size = nLength;
+		nChunks = (nLength + MSS_CHUNK_SIZE - 1) / MSS_CHUNK_SIZE;
+		pChunks = malloc((nChunks + 1) * sizeof(MSS_CHUNK));
+		if (!pChunks || fseek(CaptureFile->fp, pSection->Offset, SEEK_SET) != 0 ||
+		    fwrite(pData, 1, nLength, CaptureFile->fp) != nLength)
+		{
+			bCaptureError = true;
+		}
+		else
+		{
+			MemorySnapShot_SplitChunks(pChunks, pData, nLength);
+			MemorySnapShot_RunJob(MSS_JOB_CRC, pChunks, nChunks);
+			for (i = 0; i < nChunks; i++)
+				pSection->Crc = crc32_combine(pSection->Crc, pChunks[i].Crc, pChunks[i].nLength);
+		}
+		free(pChunks);
+	}
+	CaptureFile->nEnd = pSection->Offset + pSection->Size;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Find a section in the snapshot file, returns NULL if it is missing.
+ */
+static MSS_SECTION *MemorySnapShot_FindSection(const char *pszId)
+{
+	MSS_HEADER *pHeader = &CaptureFile->Header;
+	Uint32 i;
+
+	for (i = 0; i < pHeader->nSections; i++)
+	{
+		if (memcmp(pHeader->Sections[i].Id, pszId, sizeof(pHeader->Sections[i].Id)) == 0)
+			return &pHeader->Sections[i];
+	}
+	return NULL;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Read a section of the snapshot file, which has to contain exactly
+ * nLength bytes, and verify its checksum.
+ */
+static void MemorySnapShot_ReadSection(MSS_SECTION *pSection, Uint8 *pData, Uint32 nLength)
+{
+	FILE *fp = CaptureFile->fp;
+	MSS_CHUNK *pChunks;
+	Uint8 *pPacked = NULL;
+	Uint32 *pSizes = NULL;
+	Uint32 nTable, nPacked, Crc = crc32(0, Z_NULL, 0);
+	int i, nChunks;
+	bool bOk;
+
+	nChunks = (nLength + MSS_CHUNK_SIZE - 1) / MSS_CHUNK_SIZE;
+	pChunks = malloc((nChunks + 1) * sizeof(MSS_CHUNK));
+	bOk = pChunks && pSection->Length == nLength &&
+	      fseek(fp, pSection->Offset, SEEK_SET) == 0;
+	if (bOk)
+		MemorySnapShot_SplitChunks(pChunks, pData, nLength);
+
+	if (bOk && (pSection->Flags & MSS_COMPRESSED))
+	{
+		nTable = nChunks * sizeof(Uint32);
+		pSizes = malloc(nTable + sizeof(Uint32));
+		pPacked = malloc(pSection->Size + 1);
+		bOk = pSizes && pPacked && pSection->Size >= nTable &&
+		      fread(pPacked, 1, pSection->Size, fp) == pSection->Size;
+		if (bOk)
+			memcpy(pSizes, pPacked, nTable);
+		nPacked = nTable;
+		for (i = 0; bOk && i < nChunks; i++)
+		{
+			bOk = pSizes[i] <= pSection->Size - nPacked;
+			pChunks[i].pPacked = pPacked + nPacked;
+			pChunks[i].nPacked = pSizes[i];
+			nPacked += pSizes[i];
+		}
+		bOk = bOk && MemorySnapShot_RunJob(MSS_JOB_DECOMPRESS, pChunks, nChunks);
+	}
+	else if (bOk)
+	{
+		bOk = fread(pData, 1, nLength, fp) == nLength;
+		bOk = bOk && MemorySnapShot_RunJob(MSS_JOB_CRC, pChunks, nChunks);
+	}
+
+	for (i = 0; bOk && i < nChunks; i++)
+		Crc = crc32_combine(Crc, pChunks[i].Crc, pChunks[i].nLength);
+	if (bOk && Crc != pSection->Crc)
+	{
+		Log_Printf(LOG_WARN, "Memory snapshot section '%.4s' is corrupted.\n", pSection->Id);
+		bOk = false;
+	}
+	if (!bOk)
+		bCaptureError = true;
+
+	free(pPacked);
+	free(pSizes);
+	free(pChunks);
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
  * Open/Create snapshot file, and set flag so 'MemorySnapShot_Store' knows
- * how to handle data.
+ * how to handle data. The previous file is returned, files are nested
+ * while the snapshots a delta is based on are restored.
  */
-static bool MemorySnapShot_OpenFile(const char *pszFileName, bool bSave)
+static MSS_FILE *MemorySnapShot_OpenFile(const char *pszFileName, bool bSave)
 {
-	char VersionString[] = VERSION_STRING;
+	MSS_FILE *pPrevFile = CaptureFile;
+	MSS_FILE *pFile;
+	MSS_HEADER *pHeader;
 
 	/* Set error */
 	bCaptureError = false;
+	CaptureFile = NULL;
+
+	if (bSave && !File_QueryOverwrite(pszFileName))
+		return pPrevFile;
+
+	pFile = calloc(1, sizeof(*pFile));
+	if (!pFile)
+	{
+		bCaptureError = true;
+		return pPrevFile;
+	}
+	pHeader = &pFile->Header;
 
 	/* after opening file, set bCaptureSave to indicate whether
 	 * 'MemorySnapShot_Store' should load from or save to a file
 	 */
 	if (bSave)
 	{
-		if (!File_QueryOverwrite(pszFileName))
-			return false;
-
 		/* Save */
-		CaptureFile = MemorySnapShot_fopen(pszFileName, "wb");
-		if (!CaptureFile)
+		pFile->fp = fopen(pszFileName, "wb");
+		if (!pFile->fp)
 		{
 			fprintf(stderr, "Failed to open save file '%s': %s\n",
 			        pszFileName, strerror(errno));
+			free(pFile);
 			bCaptureError = true;
-			return false;
+			return pPrevFile;
 		}
-		bCaptureSave = true;
-		/* Store version string */
-		MemorySnapShot_Store(VersionString, sizeof(VersionString));
+		memcpy(pHeader->Magic, MSS_MAGIC, sizeof(pHeader->Magic));
+		strcpy(pHeader->Version, VERSION_STRING);
+		pFile->bCompress = ConfigureParams.Memory.bCompressSnapShots;
+		pFile->nEnd = MSS_ALIGN;
 	}
 	else
 	{
 		/* Restore */
-		CaptureFile = MemorySnapShot_fopen(pszFileName, "rb");
-		if (!CaptureFile)
+		pFile->fp = fopen(pszFileName, "rb");
+		if (!pFile->fp)
 		{
 			fprintf(stderr, "Failed to open file '%s': %s\n",
 			        pszFileName, strerror(errno));
+			free(pFile);
 			bCaptureError = true;
-			return false;
+			return pPrevFile;
 		}
-		bCaptureSave = false;
-		/* Restore version string */
-		MemorySnapShot_Store(VersionString, sizeof(VersionString));
 		/* Does match current version? */
-		if (strcasecmp(VersionString, VERSION_STRING))
+		if (fread(pHeader, sizeof(*pHeader), 1, pFile->fp) != 1 ||
+		    memcmp(pHeader->Magic, MSS_MAGIC, sizeof(pHeader->Magic)) ||
+		    pHeader->nSections > MSS_MAX_SECTIONS ||
+		    strncasecmp(pHeader->Version, VERSION_STRING, sizeof(pHeader->Version)))
 		{
 			/* No, inform user and error */
+			pHeader->Version[sizeof(pHeader->Version)-1] = '\0';
+			if (memcmp(pHeader->Magic, MSS_MAGIC, sizeof(pHeader->Magic)))
+				strcpy(pHeader->Version, "?");
 			Log_AlertDlg(LOG_ERROR, "Unable to restore Hatari memory state. File\n"
 			                       "is compatible only with Hatari version %s.",
-				     VersionString);
+				     pHeader->Version);
+			fclose(pFile->fp);
+			free(pFile);
 			bCaptureError = true;
-			return false;
+			return pPrevFile;
 		}
 	}
+	pFile->bSave = bSave;
+	bCaptureSave = bSave;
+	CaptureFile = pFile;
 
 	/* All OK */
-	return true;
+	return pPrevFile;
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
- * Close snapshot file.
+ * Close snapshot file, a saved file gets its section table now.
  */
-static void MemorySnapShot_CloseFile(void)
+static void MemorySnapShot_CloseFile(MSS_FILE *pPrevFile)
 {
-	MemorySnapShot_fclose(CaptureFile);
+	if (CaptureFile)
+	{
+		if (CaptureFile->bSave &&
+		    (fseek(CaptureFile->fp, 0, SEEK_SET) != 0 ||
+		     fwrite(&CaptureFile->Header, sizeof(CaptureFile->Header), 1,
+		            CaptureFile->fp) != 1))
+		{
+			bCaptureError = true;
+		}
+		if (fclose(CaptureFile->fp) != 0)
+			bCaptureError = true;
+		free(CaptureFile);
+	}
+	CaptureFile = pPrevFile;
+	if (CaptureFile)
+		bCaptureSave = CaptureFile->bSave;
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
- * Save/Restore data to/from file.
+ * Save/Restore data to/from buffer. The buffer grows while saving.
+ */
+static bool MemorySnapShot_StoreBuffer(void *pData, int Size)
+{
+	Uint8 *pNewBuf;
+
+	if (bCaptureSave)
+	{
+		if (nCaptureBufPos + Size > nCaptureBufSize)
+		{
+			pNewBuf = realloc(pCaptureBuf, 2 * (nCaptureBufPos + Size));
+			if (!pNewBuf)
+				return false;
+			pCaptureBuf = pNewBuf;
+			nCaptureBufSize = 2 * (nCaptureBufPos + Size);
+		}
+		memcpy(pCaptureBuf + nCaptureBufPos, pData, Size);
+	}
+	else
+	{
+		if (nCaptureBufPos + Size > nCaptureBufSize)
+			return false;
+		memcpy(pData, pCaptureBuf + nCaptureBufPos, Size);
+	}
+	nCaptureBufPos += Size;
+	return true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Save/Restore data to/from the section being captured.
  */
 void MemorySnapShot_Store(void *pData, int Size)
 {
-	long nBytes;
+	if (!MemorySnapShot_StoreBuffer(pData, Size))
+		bCaptureError = true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Save/Restore a large block of memory to/from a section of its own, which
+ * is not copied to the buffer of the section being captured and is
+ * compressed and checked in parallel. For the rewind checkpoints blocks
+ * are copied to the buffer like any other data.
+ */
+void MemorySnapShot_StoreBlock(const char *pszId, void *pData, Uint32 Size)
+{
+	MSS_SECTION *pSection;
 
-	/* Check no file errors */
-	if (CaptureFile != NULL)
+	if (bCaptureError)
+		return;
+
+	if (!CaptureFile)
 	{
-		/* Saving or Restoring? */
-		if (bCaptureSave)
-			nBytes = MemorySnapShot_fwrite(CaptureFile, (char *)pData, Size);
-		else
-			nBytes = MemorySnapShot_fread(CaptureFile, (char *)pData, Size);
+		MemorySnapShot_Store(pData, Size);
+		return;
+	}
+
+	if (bCaptureSave)
+	{
+		MemorySnapShot_WriteSection(pszId, pData, Size);
+		return;
+	}
+	pSection = MemorySnapShot_FindSection(pszId);
+	if (pSection)
+		MemorySnapShot_ReadSection(pSection, pData, Size);
+	else
+		bCaptureError = true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Save/Restore one section of the snapshot file.
+ */
+static void MemorySnapShot_CaptureSection(int nSection)
+{
+	const char *pszId = MemorySnapShot_Sections[nSection].Id;
+	MSS_SECTION *pSection;
+
+	if (bCaptureError)
+		return;
+
+	pCaptureBuf = NULL;
+	nCaptureBufSize = nCaptureBufPos = 0;
 
-		/* Did save OK? */
-		if (nBytes != Size)
+	if (bCaptureSave)
+	{
+		MemorySnapShot_Sections[nSection].Capture(true);
+		MemorySnapShot_WriteSection(pszId, pCaptureBuf, nCaptureBufPos);
+	}
+	else
+	{
+		pSection = MemorySnapShot_FindSection(pszId);
+		if (pSection)
+			pCaptureBuf = malloc(pSection->Length + 1);
+		if (!pCaptureBuf)
+		{
 			bCaptureError = true;
+			return;
+		}
+		nCaptureBufSize = pSection->Length;
+		MemorySnapShot_ReadSection(pSection, pCaptureBuf, nCaptureBufSize);
+		if (!bCaptureError)
+			MemorySnapShot_Sections[nSection].Capture(false);
+	}
+
+	free(pCaptureBuf);
+	pCaptureBuf = NULL;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Save the state of CPU and chips including video memory, without
+ * configuration and main memory, to a newly allocated buffer. Returns
+ * NULL on error.
+ */
+Uint8 *MemorySnapShot_CaptureState(Uint32 *pnSize)
+{
+	Uint8 *pBuf;
+	int i;
+
+	bCaptureSave = true;
+	bCaptureError = false;
+	pCaptureBuf = NULL;
+	nCaptureBufSize = nCaptureBufPos = 0;
+
+	for (i = MSS_SECTION_CHIPS; i < MSS_NUM_SECTIONS; i++)
+		MemorySnapShot_Sections[i].Capture(true);
+
+	pBuf = pCaptureBuf;
+	*pnSize = nCaptureBufPos;
+	if (bCaptureError)
+	{
+		free(pBuf);
+		pBuf = NULL;
+	}
+	pCaptureBuf = NULL;
+	return pBuf;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Restore the state of CPU and chips from a buffer filled by
+ * MemorySnapShot_CaptureState.
+ */
+bool MemorySnapShot_RestoreState(Uint8 *pBuf, Uint32 nSize)
+{
+	int i;
+
+	bCaptureSave = bCaptureError = false;
+	pCaptureBuf = pBuf;
+	nCaptureBufSize = nSize;
+	nCaptureBufPos = 0;
+
+	/* No reset here, main memory is already back at the checkpoint and
+	 * the sections below restore the complete state of CPU and chips */
+	for (i = MSS_SECTION_CHIPS; i < MSS_NUM_SECTIONS; i++)
+		MemorySnapShot_Sections[i].Capture(false);
+
+	pCaptureBuf = NULL;
+	return !bCaptureError;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Flag an inconsistency in the data being restored.
+ */
+void MemorySnapShot_SetError(void)
+{
+	bCaptureError = true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Return the name of the snapshot a delta snapshot being saved is based
+ * on, or NULL if a full snapshot is saved.
+ */
+const char *MemorySnapShot_GetParent(void)
+{
+	return bCaptureDelta ? szChain[nChain-1] : NULL;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Remember a snapshot that was saved or restored as the base of the next
+ * delta and start tracking memory changes from here.
+ */
+static void MemorySnapShot_AddToChain(const char *pszFileName)
+{
+	if (nChain > MAX_DELTA_CHAIN)
+	{
+		nChain = 0;
+		return;
+	}
+	strncpy(szChain[nChain], pszFileName, FILENAME_MAX-1);
+	szChain[nChain][FILENAME_MAX-1] = '\0';
+	nChain++;
+	nChainRamEnd = NEXTRamEnd;
+	NEXTMemory_ClearDirtyPages(NEXTRAM_DIRTY_SNAPSHOT);
+}
+
+/**
+ * Forget the snapshots saved or restored so far, for snapshots that are
+ * renamed or removed afterwards. The next delta is saved in full.
+ */
+void MemorySnapShot_ResetChain(void)
+{
+	nChain = 0;
+}
+
+/**
+ * Check if a delta snapshot can be saved to the given file.
+ */
+static bool MemorySnapShot_CanSaveDelta(const char *pszFileName)
+{
+	int i;
+
+	if (nChain == 0 || nChain > MAX_DELTA_CHAIN || nChainRamEnd != NEXTRamEnd)
+		return false;
+	/* Do not overwrite a snapshot the delta depends on */
+	for (i = 0; i < nChain; i++)
+	{
+		if (strcmp(szChain[i], pszFileName) == 0)
+			return false;
 	}
+	return true;
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
- * Save 'snapshot' of memory/chips/emulation variables
+ * Restore the memory of the snapshot a delta snapshot is based on. Only
+ * the memory sections are read from it, the configuration has to match
+ * the one of the delta anyway.
  */
-void MemorySnapShot_Capture(const char *pszFileName, bool bConfirm)
+bool MemorySnapShot_RestoreParent(const char *pszFileName)
 {
+	MSS_FILE *pDeltaFile;
+	Uint8 *pDeltaBuf = pCaptureBuf;
+	Uint32 nDeltaBufSize = nCaptureBufSize, nDeltaBufPos = nCaptureBufPos;
+	bool bDeltaError = bCaptureError;
+
+	if (++nRestoreDepth > MAX_DELTA_CHAIN)
+	{
+		Log_Printf(LOG_WARN, "Memory snapshot '%s' is based on too many deltas.\n", pszFileName);
+		nRestoreDepth--;
+		bCaptureError = true;
+		return false;
+	}
+
+	pDeltaFile = MemorySnapShot_OpenFile(pszFileName, false);
+	MemorySnapShot_CaptureSection(MSS_SECTION_MEM);
+	MemorySnapShot_CloseFile(pDeltaFile);
+
+	if (bCaptureError)
+		Log_Printf(LOG_WARN, "Failed to restore memory from '%s'.\n", pszFileName);
+	else
+		MemorySnapShot_AddToChain(pszFileName);
+
+	nRestoreDepth--;
+	pCaptureBuf = pDeltaBuf;
+	nCaptureBufSize = nDeltaBufSize;
+	nCaptureBufPos = nDeltaBufPos;
+	bCaptureSave = false;
+	bCaptureError |= bDeltaError;
+	return !bCaptureError;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Save 'snapshot' of memory/chips/emulation variables, either in full or
+ * as a delta to the previous one. Returns false on error or if canceled.
+ */
+static bool MemorySnapShot_Save(const char *pszFileName, bool bConfirm, bool bDelta)
+{
+	int i;
+
+	/* Make sure the disk images match the saved state and no request
+	 * is in flight, those are not part of the snapshot */
+	DiskIO_Sync();
+	SCSI_Flush();
+
+	bCaptureDelta = bDelta && MemorySnapShot_CanSaveDelta(pszFileName);
+
 	/* Set to 'saving' */
-	if (MemorySnapShot_OpenFile(pszFileName, true))
+	MemorySnapShot_OpenFile(pszFileName, true);
+	if (CaptureFile)
 	{
 		/* Capture each files details */
-		Configuration_MemorySnapShot_Capture(true);
-//		STMemory_MemorySnapShot_Capture(true);
-		CycInt_MemorySnapShot_Capture(true);
-		Cycles_MemorySnapShot_Capture(true);
-		M68000_MemorySnapShot_Capture(true);
-		Video_MemorySnapShot_Capture(true);
+		for (i = 0; i < MSS_NUM_SECTIONS; i++)
+			MemorySnapShot_CaptureSection(i);
 		DebugUI_MemorySnapShot_Capture(pszFileName, true);
-//		IoMem_MemorySnapShot_Capture(true);
 		/* And close */
-		MemorySnapShot_CloseFile();
+		MemorySnapShot_CloseFile(NULL);
 	} else {
 		/* just canceled? */
 		if (!bCaptureError)
-			return;
+			return false;
 	}
 
+	/* A full snapshot starts a new chain */
+	if (!bCaptureDelta)
+		nChain = 0;
+	bCaptureDelta = false;
+
 	/* Did error */
 	if (bCaptureError)
+	{
+		nChain = 0;
 		Log_AlertDlg(LOG_ERROR, "Unable to save memory state to file.");
-	else if (bConfirm)
+		return false;
+	}
+	MemorySnapShot_AddToChain(pszFileName);
+	if (bConfirm)
 		Log_AlertDlg(LOG_INFO, "Memory state file saved.");
+	return true;
+}
+
+bool MemorySnapShot_Capture(const char *pszFileName, bool bConfirm)
+{
+	return MemorySnapShot_Save(pszFileName, bConfirm, false);
+}
+
+/**
+ * Save a delta snapshot based on the snapshot that was saved or restored
+ * last. If there is none, or the delta would overwrite a snapshot it
+ * depends on, a full snapshot is saved.
+ */
+bool MemorySnapShot_CaptureDelta(const char *pszFileName, bool bConfirm)
+{
+	return MemorySnapShot_Save(pszFileName, bConfirm, true);
 }
 
 
 /*-----------------------------------------------------------------------*/
 /**
- * Restore 'snapshot' of memory/chips/emulation variables
+ * Restore 'snapshot' of memory/chips/emulation variables. Returns false
+ * on error.
  */
-void MemorySnapShot_Restore(const char *pszFileName, bool bConfirm)
+bool MemorySnapShot_Restore(const char *pszFileName, bool bConfirm)
 {
+	int i;
+
+	nChain = 0;
+	nRestoreDepth = 0;
+
+	/* The checkpoints do not belong to the restored state */
+	Rewind_Reset();
+
 	/* Set to 'restore' */
-	if (MemorySnapShot_OpenFile(pszFileName, false))
+	MemorySnapShot_OpenFile(pszFileName, false);
+	if (CaptureFile)
 	{
-		Configuration_MemorySnapShot_Capture(false);
+		MemorySnapShot_CaptureSection(MSS_SECTION_CONF);
 
 		/* Reset emulator to get things running */
 		IoMem_UnInit();  IoMem_Init();
 		Reset_Cold();
 
 		/* Capture each files details */
-//		STMemory_MemorySnapShot_Capture(false);
-		CycInt_MemorySnapShot_Capture(false);
-		Cycles_MemorySnapShot_Capture(false);
-		M68000_MemorySnapShot_Capture(false);
-		Video_MemorySnapShot_Capture(false);
+		for (i = MSS_SECTION_CONF+1; i < MSS_NUM_SECTIONS; i++)
+			MemorySnapShot_CaptureSection(i);
 		DebugUI_MemorySnapShot_Capture(pszFileName, false);
-//		IoMem_MemorySnapShot_Capture(false);
 
 		/* And close */
-		MemorySnapShot_CloseFile();
+		MemorySnapShot_CloseFile(NULL);
 
 		/* changes may affect also info shown in statusbar */
 		Statusbar_UpdateInfo();
@@ -282,9 +965,15 @@ void MemorySnapShot_Restore(const char *pszFileName, bool bConfirm)
 
 	/* Did error? */
 	if (bCaptureError)
+	{
+		nChain = 0;
 		Log_AlertDlg(LOG_ERROR, "Unable to restore memory state from file.");
-	else if (bConfirm)
+		return false;
+	}
+	MemorySnapShot_AddToChain(pszFileName);
+	if (bConfirm)
 		Log_AlertDlg(LOG_INFO, "Memory state file restored.");
+	return true;
 }
 
 
@@ -27,6 +27,11 @@
 #include "file.h"
 #include "rs.h"
 #include "statusbar.h"
+#include "diskIO.h"
+#include "memorySnapShot.h"
+#if HAVE_PREAD
+#include <unistd.h>
+#endif
 
 
 #define LOG_MO_REG_LEVEL    LOG_DEBUG
@@ -72,6 +77,8 @@ struct {
     Uint32 sec_offset;
     
     FILE* dsk;
+    bool logical;   /* image without ECC, see mo.h */
+    Uint8 *erased;  /* bitmap of erased sectors of logical images */
     
     bool spinning;
     bool spiraling;
@@ -160,15 +167,6 @@ int dnum;
 #define MOFORM_RD_GATE_MASK 0x0F
 
 
-/* Disk layout */
-#define MO_SEC_PER_TRACK    16
-#define MO_TRACK_OFFSET     4096 /* offset to first logical sector of kernel driver is 4149 */
-#define MO_TRACK_LIMIT      19819-(MO_TRACK_OFFSET) /* no more tracks beyond this offset */
-
-#define MO_SECTORSIZE_DISK  1296 /* size of encoded sector, like stored on disk */
-#define MO_SECTORSIZE_DATA  1024 /* size of decoded sector, like handled by software */
-
-
 Uint32 get_logical_sector(Uint32 sector_id) {
     Sint32 tracknum = (sector_id&0xFFFF00)>>8;
     Uint8 sectornum = sector_id&0x0F;
@@ -197,8 +195,12 @@ void MO_Init(void);
 void MO_Uninit(void);
 
 /* Experimental */
-#define SECTOR_IO_DELAY 2500
-#define CMD_DELAY       1000
+/* Delays in CPU cycles for each I/O timing mode (accurate, fast, instant) */
+static const int mo_sector_delay[3] = { 2500, 1250, 250 };
+static const int mo_cmd_delay[3]    = { 1000, 500, 100 };
+
+#define SECTOR_IO_DELAY mo_sector_delay[ConfigureParams.System.nMOTiming]
+#define CMD_DELAY       mo_cmd_delay[ConfigureParams.System.nMOTiming]
 
 void mo_set_signals(bool complete, bool attn, int delay);
 void mo_push_signals(bool complete, bool attn, int drive);
@@ -212,6 +214,7 @@ void mo_read_sector(Uint32 sector_id);
 void mo_write_sector(Uint32 sector_id);
 void mo_erase_sector(Uint32 sector_id);
 void mo_verify_sector(Uint32 sector_id);
+void fmt_read_ahead(Uint32 sector_id);
 
 void mo_seek(Uint16 command);
 void mo_high_order_seek(Uint16 command);
@@ -741,6 +744,7 @@ void ecc_toggle_buffer(void) {
 }
 
 void ecc_clear_buffer(void) {
+    ecc_buffer[eccin].plain=ecc_buffer[eccout].plain=false;
     ecc_buffer[eccin].size=ecc_buffer[eccout].size=0;
     ecc_buffer[eccin].limit=ecc_buffer[eccout].limit=MO_SECTORSIZE_DATA;
 }
@@ -811,7 +815,9 @@ void ecc_decode(void) {
         Log_Printf(LOG_MO_ECC_LEVEL, "[OSP] ECC decoding buffer.");
         ecc_buffer[eccin].limit=ecc_buffer[eccin].size=MO_SECTORSIZE_DATA;
         
-        int num_errors = rs_decode(ecc_buffer[eccin].data);
+        /* Sectors of logical images are error free and already decoded */
+        int num_errors = ecc_buffer[eccin].plain ? 0 : rs_decode(ecc_buffer[eccin].data);
+        ecc_buffer[eccin].plain=false;
         
         if (num_errors<0) {
             Log_Printf(LOG_WARN, "[OSP] ECC: Sector has uncorrectable errors!");
@@ -832,6 +838,16 @@ void ecc_decode(void) {
         abort();
     }
 }
+/* Add the ECC to a sector that was read from a logical image, so that
+ * the buffer looks like the sector was read from the disk. This is only
+ * needed if the ECC is disabled and the guest reads the raw sector. */
+static void ecc_make_raw(int buf) {
+    if (ecc_buffer[buf].plain) {
+        Log_Printf(LOG_MO_ECC_LEVEL, "[OSP] ECC creating raw sector.");
+        rs_encode(ecc_buffer[buf].data);
+        ecc_buffer[buf].plain=false;
+    }
+}
 void ecc_encode(void) {
     if (mo.ctrlr_csr2&MOCSR2_ECC_DIS && mo.ctrlr_csr2&MOCSR2_ECC_MODE) {
         Log_Printf(LOG_MO_ECC_LEVEL, "[OSP] ECC encoding disabled.");
@@ -842,7 +858,12 @@ void ecc_encode(void) {
         Log_Printf(LOG_MO_ECC_LEVEL, "[OSP] ECC encoding buffer.");
         ecc_buffer[eccin].limit=ecc_buffer[eccin].size=MO_SECTORSIZE_DISK;
 
-        rs_encode(ecc_buffer[eccin].data);
+        /* Logical images store no ECC, leave the data as it is */
+        if (ecc_mode==ECC_MODE_WRITE && modrv[dnum].logical) {
+            ecc_buffer[eccin].plain=true;
+        } else {
+            rs_encode(ecc_buffer[eccin].data);
+        }
 
         ecc_toggle_buffer();
     } else {
@@ -863,6 +884,7 @@ void ecc_write(void) {
     }
     ecc_buffer[eccin].size=0; /* FIXME: find a better place for this */
     ecc_buffer[eccin].limit=MO_SECTORSIZE_DATA; /* and this */
+    ecc_buffer[eccin].plain=false;
     CycInt_AddRelativeInterrupt(ECC_DELAY, INT_CPU_CYCLE, INTERRUPT_ECC_IO);
 }
 void ecc_read(void) {
@@ -945,6 +967,8 @@ void ECC_IO_Handler(void) {
                 }
             } else { /* mode is read or verify */
                 if (mo.ctrlr_csr2&MOCSR2_ECC_DIS) {
+                    ecc_make_raw(eccin);
+                    ecc_make_raw(eccout);
                     if (mo.ctrlr_csr2&MOCSR2_ECC_BLOCKS) {
                         ecc_buffer[eccin].limit=ecc_buffer[eccin].size=MO_SECTORSIZE_DATA;
                     }
@@ -1005,15 +1029,282 @@ void ECC_IO_Handler(void) {
 
 /* I/O functions */
 
+/* Sector accesses are done by the disk I/O thread. Reads fetch whole
+ * tracks, each drive keeps the last two tracks it read. When the formatter
+ * is going to read from a track, the following track is fetched as well,
+ * so that spiraling over the disk does not wait for the host. Seeks fetch
+ * the track they go to. Writes are queued and drop the cached track. */
+#define MO_WRITE_SLOTS  8
+#define MO_TRACK_SLOTS  2
+
+typedef struct {
+    DISKIO_REQUEST req; /* must be first, work functions get a pointer to it */
+    Uint8 buf[MO_SECTORSIZE_DISK];
+    bool data;      /* write buf, else only the erase bitmap is written */
+    bool mapdirty;  /* write map to the erase bitmap of a logical image */
+    Uint8 map;
+} MOIOSLOT;
+
+typedef struct {
+    DISKIO_REQUEST req; /* req.lba is the number of the track */
+    Uint8 buf[MO_SEC_PER_TRACK*MO_SECTORSIZE_DISK];
+    bool valid;     /* buf holds or fetches track req.lba */
+} MOTRACK;
+
+static MOTRACK mo_track[2][MO_TRACK_SLOTS];
+static int mo_track_used[2]; /* slot of the track that is read from */
+static MOIOSLOT mo_write_slot[MO_WRITE_SLOTS];
+static int mo_write_next = 0;
+
+/* Functions called on the disk I/O thread */
+static bool mo_file_read(FILE *dsk, Uint8 *buf, size_t len, off_t offset) {
+#if HAVE_PREAD
+    return pread(fileno(dsk), buf, len, offset)==(ssize_t)len;
+#else
+    if (fseek(dsk, offset, SEEK_SET) != 0)
+        return false;
+    return fread(buf, len, 1, dsk)==1;
+#endif
+}
+
+static bool mo_file_write(FILE *dsk, const Uint8 *buf, size_t len, off_t offset) {
+#if HAVE_PREAD
+    return pwrite(fileno(dsk), buf, len, offset)==(ssize_t)len;
+#else
+    if (fseek(dsk, offset, SEEK_SET) != 0)
+        return false;
+    return fwrite(buf, len, 1, dsk)==1;
+#endif
+}
+
+static Uint32 mo_io_read_track(DISKIO_REQUEST *req) {
+    FILE *dsk = modrv[req->unit].dsk;
+    size_t len = MO_SEC_PER_TRACK*(modrv[req->unit].logical ? MO_SECTORSIZE_DATA : MO_SECTORSIZE_DISK);
+    
+    if (dsk==NULL) {
+        return 0;
+    }
+    return mo_file_read(dsk, req->buf, len, (off_t)req->lba*len);
+}
+
+static Uint32 mo_io_write(DISKIO_REQUEST *req) {
+    MOIOSLOT *wr = (MOIOSLOT*)req;
+    FILE *dsk = modrv[req->unit].dsk;
+    
+    if (modrv[req->unit].logical) {
+        if (wr->data && !mo_file_write(dsk, req->buf, MO_SECTORSIZE_DATA, (off_t)req->lba*MO_SECTORSIZE_DATA)) {
+            return 0;
+        }
+        if (wr->mapdirty && !mo_file_write(dsk, &wr->map, 1, MO_LOGICAL_MAPSTART+req->lba/8)) {
+            return 0;
+        }
+        return 1;
+    }
+    return mo_file_write(dsk, req->buf, MO_SECTORSIZE_DISK, (off_t)req->lba*MO_SECTORSIZE_DISK);
+}
+
+static bool mo_sector_erased(int drv, Uint32 sector_num) {
+    return modrv[drv].erased[sector_num/8]&(1<<(sector_num%8));
+}
+
+/* Return the slot that holds or fetches a track, -1 if none */
+static int mo_find_track(int drv, Uint32 track) {
+    int i;
+    for (i = 0; i < MO_TRACK_SLOTS; i++) {
+        if (mo_track[drv][i].valid && mo_track[drv][i].req.lba==track) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Start reading a track, unless it is already read. The track that is
+ * currently read from is kept. Returns the slot of the track. */
+static int mo_fetch_track(int drv, Uint32 track) {
+    int slot = mo_find_track(drv, track);
+    MOTRACK *t;
+    
+    if (slot>=0) {
+        return slot;
+    }
+    slot = (mo_track_used[drv]+1)%MO_TRACK_SLOTS;
+    t = &mo_track[drv][slot];
+    DiskIO_Wait(&t->req);
+    t->req.work = mo_io_read_track;
+    t->req.done = NULL;
+    t->req.unit = drv;
+    t->req.buf = t->buf;
+    t->req.lba = track;
+    t->valid = true;
+    DiskIO_Submit(&t->req, SECTOR_IO_DELAY);
+    return slot;
+}
+
+/* Forget all cached tracks of a drive */
+static void mo_invalidate_tracks(int drv) {
+    int i;
+    for (i = 0; i < MO_TRACK_SLOTS; i++) {
+        mo_track[drv][i].valid = false;
+    }
+}
+
+/* Fetch the track with a sector that is going to be read and the track
+ * after it */
+static void mo_read_ahead(int drv, Uint32 sector_num) {
+    Uint32 track = sector_num/MO_SEC_PER_TRACK;
+    
+    mo_track_used[drv] = mo_fetch_track(drv, track);
+    if (track+1 < (MO_TRACK_LIMIT)) {
+        mo_fetch_track(drv, track+1);
+    }
+}
+
+/* Read a sector, return true if buf only holds the data of the sector
+ * because it comes from a logical image */
+static bool mo_read_block(Uint32 sector_num, Uint8 *buf) {
+    size_t size = modrv[dnum].logical ? MO_SECTORSIZE_DATA : MO_SECTORSIZE_DISK;
+    MOTRACK *t;
+    
+    if (modrv[dnum].logical && mo_sector_erased(dnum, sector_num)) {
+        memset(buf, 0xFF, MO_SECTORSIZE_DISK);
+        return false;
+    }
+    mo_track_used[dnum] = mo_fetch_track(dnum, sector_num/MO_SEC_PER_TRACK);
+    t = &mo_track[dnum][mo_track_used[dnum]];
+    DiskIO_Wait(&t->req);
+    memcpy(buf, t->buf+(sector_num%MO_SEC_PER_TRACK)*size, size);
+    return modrv[dnum].logical;
+}
+
+/* Queue a write, erase if buf is NULL. If plain is set, buf only holds
+ * the data of the sector. */
+static void mo_write_block(Uint32 sector_num, const Uint8 *buf, bool plain) {
+    MOIOSLOT *wr = &mo_write_slot[mo_write_next];
+    
+    mo_write_next = (mo_write_next+1)%MO_WRITE_SLOTS;
+    DiskIO_Wait(&wr->req);
+    wr->data = true;
+    wr->mapdirty = false;
+    if (modrv[dnum].logical) {
+        Uint8 *map = &modrv[dnum].erased[sector_num/8];
+        Uint8 old = *map;
+        if (buf) {
+            memcpy(wr->buf, buf, plain ? MO_SECTORSIZE_DATA : MO_SECTORSIZE_DISK);
+            if (!plain && rs_decode(wr->buf)<0) {
+                Log_Printf(LOG_WARN, "MO disk %i: Writing sector %i with uncorrectable errors!", dnum, sector_num);
+            }
+            *map &= ~(1<<(sector_num%8));
+        } else {
+            wr->data = false;
+            *map |= 1<<(sector_num%8);
+        }
+        wr->mapdirty = (*map!=old);
+        wr->map = *map;
+        if (!wr->data && !wr->mapdirty) {
+            return; /* already erased */
+        }
+    } else if (buf) {
+        memcpy(wr->buf, buf, plain ? MO_SECTORSIZE_DATA : MO_SECTORSIZE_DISK);
+        if (plain) {
+            rs_encode(wr->buf);
+        }
+    } else {
+        memset(wr->buf, 0xFF, MO_SECTORSIZE_DISK);
+    }
+    int slot = mo_find_track(dnum, sector_num/MO_SEC_PER_TRACK);
+    if (slot>=0) {
+        mo_track[dnum][slot].valid = false;
+    }
+    wr->req.work = mo_io_write;
+    wr->req.done = NULL;
+    wr->req.unit = dnum;
+    wr->req.buf = wr->buf;
+    wr->req.lba = sector_num;
+    DiskIO_Submit(&wr->req, SECTOR_IO_DELAY);
+}
+
+/* Open the image of a disk, logical images are recognized by their size */
+static void mo_open_image(int drv) {
+    if (ConfigureParams.MO.drive[drv].bWriteProtected) {
+        modrv[drv].dsk = File_Open(ConfigureParams.MO.drive[drv].szImageName, "rb");
+        modrv[drv].protected=true;
+    } else {
+        modrv[drv].dsk = File_Open(ConfigureParams.MO.drive[drv].szImageName, "rb+");
+        modrv[drv].protected=false;
+    }
+    modrv[drv].logical=false;
+    modrv[drv].erased=NULL;
+    
+    if (modrv[drv].dsk && File_Length(ConfigureParams.MO.drive[drv].szImageName)==MO_LOGICAL_SIZE) {
+        modrv[drv].erased = malloc(MO_LOGICAL_MAPSIZE);
+        if (modrv[drv].erased && fseek(modrv[drv].dsk, MO_LOGICAL_MAPSTART, SEEK_SET)==0 &&
+            fread(modrv[drv].erased, MO_LOGICAL_MAPSIZE, 1, modrv[drv].dsk)==1) {
+            Log_Printf(LOG_WARN, "MO disk %i: Logical image, ECC is created on demand.", drv);
+            modrv[drv].logical=true;
+        } else {
+            Log_Printf(LOG_WARN, "MO disk %i: Cannot read erase map of logical image!", drv);
+            free(modrv[drv].erased);
+            modrv[drv].erased=NULL;
+            File_Close(modrv[drv].dsk);
+            modrv[drv].dsk=NULL;
+        }
+    }
+}
+
+static void mo_close_image(int drv) {
+    if (modrv[drv].dsk) {
+        File_Close(modrv[drv].dsk);
+    }
+    free(modrv[drv].erased);
+    modrv[drv].dsk=NULL;
+    modrv[drv].erased=NULL;
+    modrv[drv].logical=false;
+}
+
+/* Finish all accesses to a disk before it is closed */
+static void mo_wait_io(int drv) {
+    int i;
+    
+    for (i = 0; i < MO_TRACK_SLOTS; i++) {
+        DiskIO_Wait(&mo_track[drv][i].req);
+    }
+    mo_invalidate_tracks(drv);
+    for (i = 0; i < MO_WRITE_SLOTS; i++) {
+        if (mo_write_slot[i].req.unit==drv) {
+            DiskIO_Wait(&mo_write_slot[i].req);
+        }
+    }
+}
+
+/* Called for the sector that comes under the head next */
+void fmt_read_ahead(Uint32 sector_id) {
+    Sint32 tracknum = (sector_id&0xFFFF00)>>8;
+    Uint32 fmt_id = (mo.tracknumh<<16)|(mo.tracknuml<<8)|mo.sector_num;
+    
+    if (fmt_mode!=FMT_MODE_READ && fmt_mode!=FMT_MODE_VERIFY) {
+        return;
+    }
+    if (mo.init&MOINIT_ID_CMP_TRK) {
+        if ((sector_id&0xFFFF00)!=(fmt_id&0xFFFF00)) {
+            return;
+        }
+    } else if (sector_id!=fmt_id) {
+        return;
+    }
+    tracknum-=MO_TRACK_OFFSET;
+    if (tracknum<0 || tracknum>=MO_TRACK_LIMIT) {
+        return;
+    }
+    mo_read_ahead(dnum, (tracknum*MO_SEC_PER_TRACK)+(sector_id&0x0F));
+}
+
 void mo_read_sector(Uint32 sector_id) {
     Uint32 sector_num = get_logical_sector(sector_id);
     
     Log_Printf(LOG_MO_IO_LEVEL, "MO disk %i: Read sector at offset %i (%i sectors remaining)",
                dnum, sector_num, sector_counter-1);
     
-    /* seek to the position */
-	fseek(modrv[dnum].dsk, sector_num*MO_SECTORSIZE_DISK, SEEK_SET);
-    fread(ecc_buffer[eccin].data, MO_SECTORSIZE_DISK, 1, modrv[dnum].dsk);
+    ecc_buffer[eccin].plain = mo_read_block(sector_num, ecc_buffer[eccin].data);
     
     ecc_buffer[eccin].limit = ecc_buffer[eccin].size = MO_SECTORSIZE_DISK;
 }
@@ -1025,9 +1316,8 @@ void mo_write_sector(Uint32 sector_id) {
                dnum, sector_num, sector_counter-1);
     
     if (ecc_buffer[eccout].limit==MO_SECTORSIZE_DISK) {
-        /* seek to the position */
-        fseek(modrv[dnum].dsk, sector_num*MO_SECTORSIZE_DISK, SEEK_SET);
-        fwrite(ecc_buffer[eccout].data, MO_SECTORSIZE_DISK, 1, modrv[dnum].dsk);
+        mo_write_block(sector_num, ecc_buffer[eccout].data, ecc_buffer[eccout].plain);
+        ecc_buffer[eccout].plain = false;
 
         ecc_buffer[eccout].size = 0;
         ecc_buffer[eccout].limit = MO_SECTORSIZE_DATA;
@@ -1044,12 +1334,7 @@ void mo_erase_sector(Uint32 sector_id) {
     Log_Printf(LOG_MO_IO_LEVEL, "MO disk %i: Erase sector at offset %i (%i sectors remaining)",
                dnum, sector_num, sector_counter-1);
     
-    Uint8 erase_buf[MO_SECTORSIZE_DISK];
-    memset(erase_buf, 0xFF, MO_SECTORSIZE_DISK);
-    
-    /* seek to the position */
-    fseek(modrv[dnum].dsk, sector_num*MO_SECTORSIZE_DISK, SEEK_SET);
-    fwrite(erase_buf, MO_SECTORSIZE_DISK, 1, modrv[dnum].dsk);
+    mo_write_block(sector_num, NULL, false);
 }
 
 void mo_verify_sector(Uint32 sector_id) {
@@ -1058,14 +1343,11 @@ void mo_verify_sector(Uint32 sector_id) {
     Log_Printf(LOG_MO_IO_LEVEL, "MO disk %i: Verify sector at offset %i (%i sectors remaining)",
                dnum, sector_num, sector_counter-1);
     
-    /* seek to the position */
-	fseek(modrv[dnum].dsk, sector_num*MO_SECTORSIZE_DISK, SEEK_SET);
-    fread(ecc_buffer[eccin].data, MO_SECTORSIZE_DISK, 1, modrv[dnum].dsk);
+    ecc_buffer[eccin].plain = mo_read_block(sector_num, ecc_buffer[eccin].data);
     
     ecc_buffer[eccin].limit = ecc_buffer[eccin].size = MO_SECTORSIZE_DISK;
 }
 
-
 /* Drive commands */
 
 #define DRV_SEK     0x0000 /* seek (last 12 bits are track position) */
@@ -1309,6 +1591,10 @@ void mo_seek(Uint16 command) {
     }
     modrv[dnum].seeking = true;
     modrv[dnum].head_pos = (modrv[dnum].ho_head_pos&0xF000) | (command&0x0FFF);
+    /* Reading usually starts on the track the head goes to */
+    if (modrv[dnum].head_pos>=MO_TRACK_OFFSET && modrv[dnum].head_pos-MO_TRACK_OFFSET<(MO_TRACK_LIMIT)) {
+        mo_fetch_track(dnum, modrv[dnum].head_pos-MO_TRACK_OFFSET);
+    }
 #if SEEK_TIMING
     if (seek_time>modrv[dnum].head_pos) {
         seek_time=seek_time-modrv[dnum].head_pos;
@@ -1476,8 +1762,8 @@ void mo_eject_disk(int drv) {
 
     Log_Printf(LOG_WARN, "MO disk %i: Eject",drv);
     
-    File_Close(modrv[drv].dsk);
-    modrv[drv].dsk=NULL;
+    mo_wait_io(drv);
+    mo_close_image(drv);
     modrv[drv].inserted=false;
     modrv[drv].spinning=false;
     modrv[drv].spiraling=false;
@@ -1489,13 +1775,9 @@ void mo_eject_disk(int drv) {
 void mo_insert_disk(int drv) {
     Log_Printf(LOG_WARN, "MO disk %i: Insert",drv);
     
-    if (ConfigureParams.MO.drive[drv].bWriteProtected) {
-        modrv[drv].dsk = File_Open(ConfigureParams.MO.drive[drv].szImageName, "rb");
-        modrv[drv].protected=true;
-    } else {
-        modrv[drv].dsk = File_Open(ConfigureParams.MO.drive[drv].szImageName, "rb+");
-        modrv[drv].protected=false;
-    }
+    mo_invalidate_tracks(drv);
+    
+    mo_open_image(drv);
     
     modrv[drv].inserted=true;
     modrv[drv].dstat&=~DS_EMPTY;
@@ -1549,6 +1831,10 @@ void mo_spiraling_operation(void) {
             modrv[i].sec_offset++;
             modrv[i].head_pos+=modrv[i].sec_offset/MO_SEC_PER_TRACK;
             modrv[i].sec_offset%=MO_SEC_PER_TRACK;
+            
+            if (i==dnum) {
+                fmt_read_ahead((modrv[i].head_pos<<8)|modrv[i].sec_offset);
+            }
         }
     }
     CycInt_AddRelativeInterrupt(SECTOR_IO_DELAY, INT_CPU_CYCLE, INTERRUPT_MO_IO);
@@ -1683,13 +1969,7 @@ void MO_Init(void) {
             if (ConfigureParams.MO.drive[i].bDiskInserted &&
                 File_Exists(ConfigureParams.MO.drive[i].szImageName)) {
                 modrv[i].inserted=true;
-                if (ConfigureParams.MO.drive[i].bWriteProtected) {
-                    modrv[i].dsk = File_Open(ConfigureParams.MO.drive[i].szImageName, "rb");
-                    modrv[i].protected=true;
-                } else {
-                    modrv[i].dsk = File_Open(ConfigureParams.MO.drive[i].szImageName, "rb+");
-                    modrv[i].protected=false;
-                }
+                mo_open_image(i);
             } else {
                 modrv[i].dsk = NULL;
                 modrv[i].inserted=false;
@@ -1708,12 +1988,10 @@ void MO_Init(void) {
 }
 
 void MO_Uninit(void) {
-    if (modrv[0].dsk)
-        File_Close(modrv[0].dsk);
-    if (modrv[1].dsk) {
-        File_Close(modrv[1].dsk);
-    }
-    modrv[0].dsk = modrv[1].dsk = NULL;
+    mo_wait_io(0);
+    mo_wait_io(1);
+    mo_close_image(0);
+    mo_close_image(1);
     modrv[0].inserted = modrv[1].inserted = false;
 }
 
@@ -1731,6 +2009,53 @@ void MO_Eject(int drive) {
 }
 
 void MO_Reset(void) {
+    CycInt_RegisterHandler(INTERRUPT_MO, MO_InterruptHandler);
+    CycInt_RegisterHandler(INTERRUPT_MO_IO, MO_IO_Handler);
+    CycInt_RegisterHandler(INTERRUPT_ECC_IO, ECC_IO_Handler);
     MO_Uninit();
     MO_Init();
 }
+
+
+/* Save/Restore snapshot of the optical storage processor and the drives.
+ * Which disks are inserted is part of the configuration, snapshots are
+ * only taken while no disk I/O is in flight. */
+void MO_MemorySnapShot_Capture(bool bSave) {
+    int i;
+    
+    MemorySnapShot_Store(&mo, sizeof(mo));
+    MemorySnapShot_Store(&sector_counter, sizeof(sector_counter));
+    for (i = 0; i < 2; i++) {
+        MemorySnapShot_Store(&modrv[i].status, sizeof(modrv[i].status));
+        MemorySnapShot_Store(&modrv[i].dstat, sizeof(modrv[i].dstat));
+        MemorySnapShot_Store(&modrv[i].estat, sizeof(modrv[i].estat));
+        MemorySnapShot_Store(&modrv[i].hstat, sizeof(modrv[i].hstat));
+        MemorySnapShot_Store(&modrv[i].head, sizeof(modrv[i].head));
+        MemorySnapShot_Store(&modrv[i].head_pos, sizeof(modrv[i].head_pos));
+        MemorySnapShot_Store(&modrv[i].ho_head_pos, sizeof(modrv[i].ho_head_pos));
+        MemorySnapShot_Store(&modrv[i].sec_offset, sizeof(modrv[i].sec_offset));
+        MemorySnapShot_Store(&modrv[i].spinning, sizeof(modrv[i].spinning));
+        MemorySnapShot_Store(&modrv[i].spiraling, sizeof(modrv[i].spiraling));
+        MemorySnapShot_Store(&modrv[i].seeking, sizeof(modrv[i].seeking));
+        MemorySnapShot_Store(&modrv[i].attn, sizeof(modrv[i].attn));
+        MemorySnapShot_Store(&modrv[i].complete, sizeof(modrv[i].complete));
+        if (!bSave) {
+            mo_invalidate_tracks(i);
+        }
+    }
+    MemorySnapShot_Store(&dnum, sizeof(dnum));
+    MemorySnapShot_Store(&sector_increment, sizeof(sector_increment));
+    MemorySnapShot_Store(&write_timing, sizeof(write_timing));
+    MemorySnapShot_Store(&sector_timer, sizeof(sector_timer));
+    MemorySnapShot_Store(&ecc_mode, sizeof(ecc_mode));
+    MemorySnapShot_Store(&ecc_state, sizeof(ecc_state));
+    MemorySnapShot_Store(&fmt_mode, sizeof(fmt_mode));
+    MemorySnapShot_Store(&ecc_repeat, sizeof(ecc_repeat));
+    MemorySnapShot_Store(&eccin, sizeof(eccin));
+    MemorySnapShot_Store(&eccout, sizeof(eccout));
+    MemorySnapShot_Store(ecc_buffer, sizeof(ecc_buffer));
+    MemorySnapShot_Store(&old_size, sizeof(old_size));
+    MemorySnapShot_Store(&delayed_compl, sizeof(delayed_compl));
+    MemorySnapShot_Store(&delayed_attn, sizeof(delayed_attn));
+    MemorySnapShot_Store(&delayed_drive, sizeof(delayed_drive));
+}
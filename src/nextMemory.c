@@ -27,14 +27,55 @@ Uint8 NEXTRom[0x20000];
 
 Uint8 NEXTIo[0x20000];
 
+/* Pages written since each user of the dirty page bitmap cleared it */
+static Uint32 NEXTRam_UserDirtyPages[NEXTRAM_DIRTY_USERS][NEXTRAM_DIRTY_WORDS];
+
 /**
  * Clear section of NEXT's memory space.
  */
 void NEXTMemory_Clear(Uint32 StartAddress, Uint32 EndAddress)
 {
 	memset(&NEXTRam[StartAddress], 0, EndAddress-StartAddress);
+	NEXTmem_set_dirty_host(&NEXTRam[StartAddress], EndAddress-StartAddress);
+}
+
+/**
+ * Hand the pages marked by the memory write functions over to all users
+ * of the dirty page bitmap.
+ */
+static void NEXTMemory_CollectDirtyPages(void)
+{
+	Uint32 i, bits;
+	int user;
+
+	for (i = 0; i < NEXTRAM_DIRTY_WORDS; i++)
+	{
+		bits = NEXTRam_DirtyPages[i];
+		if (!bits)
+			continue;
+		NEXTRam_DirtyPages[i] = 0;
+		for (user = 0; user < NEXTRAM_DIRTY_USERS; user++)
+			NEXTRam_UserDirtyPages[user][i] |= bits;
+	}
+}
+
+/**
+ * Return the bitmap of pages written since the given user last cleared it.
+ * The user may also set bits in it.
+ */
+Uint32 *NEXTMemory_GetDirtyPages(int user)
+{
+	NEXTMemory_CollectDirtyPages();
+	return NEXTRam_UserDirtyPages[user];
+}
+
+void NEXTMemory_ClearDirtyPages(int user)
+{
+	NEXTMemory_CollectDirtyPages();
+	memset(NEXTRam_UserDirtyPages[user], 0, sizeof(NEXTRam_UserDirtyPages[user]));
 }
 
+
 /** --useful for next?
  * Copy given memory area safely to Atari RAM.
  * If the memory area isn't fully within RAM, only the valid parts are written.
@@ -55,6 +96,7 @@ bool NEXTMemory_SafeCopy(Uint32 addr, Uint8 *src, unsigned int len, const char *
     if (NEXTMemory_ValidArea(addr, len))
     {
         memcpy(&NEXTRam[addr], src, len);
+        NEXTmem_set_dirty_host(&NEXTRam[addr], len);
         return true;
     }
     Log_Printf(LOG_WARN, "Invalid '%s' RAM range 0x%x+%i!\n", name, addr, len);
@@ -62,7 +104,10 @@ bool NEXTMemory_SafeCopy(Uint32 addr, Uint8 *src, unsigned int len, const char *
     for (end = addr + len; addr < end; addr++, src++)
     {
         if (NEXTMemory_ValidArea(addr, 1))
+        {
             NEXTRam[addr] = *src;
+            NEXTmem_set_dirty_host(&NEXTRam[addr], 1);
+        }
     }
     return false;
 }
@@ -70,14 +115,50 @@ bool NEXTMemory_SafeCopy(Uint32 addr, Uint8 *src, unsigned int len, const char *
 
 
 /**
- * TODO 
+ * Save/Restore main memory. A delta snapshot only contains the pages that
+ * were written since the snapshot it is based on, which is restored first.
  */
 void NEXTMemory_MemorySnapShot_Capture(bool bSave)
 {
-	MemorySnapShot_Store(&NEXTRamEnd, sizeof(NEXTRamEnd));
-
-	/* Only save/restore area of memory machine is set to, eg 1Mb */
-	MemorySnapShot_Store(NEXTRam, NEXTRamEnd);
+	static Uint32 RestoredPages[NEXTRAM_DIRTY_WORDS];
+	char szParent[FILENAME_MAX];
+	Uint32 nRamEnd = NEXTRamEnd;
+	Uint32 page, pages;
+	Uint32 *pDirty;
+
+	/* The memory size follows from the configuration restored before */
+	MemorySnapShot_Store(&nRamEnd, sizeof(nRamEnd));
+	if (nRamEnd != NEXTRamEnd)
+	{
+		MemorySnapShot_SetError();
+		return;
+	}
+
+	memset(szParent, 0, sizeof(szParent));
+	if (bSave && MemorySnapShot_GetParent())
+		strncpy(szParent, MemorySnapShot_GetParent(), sizeof(szParent)-1);
+	MemorySnapShot_Store(szParent, sizeof(szParent));
+	szParent[sizeof(szParent)-1] = '\0';
+
+	if (szParent[0] == '\0')
+	{
+		/* Only save/restore area of memory machine is set to */
+		MemorySnapShot_StoreBlock("RAM ", NEXTRam, NEXTRamEnd);
+		return;
+	}
+
+	if (!bSave && !MemorySnapShot_RestoreParent(szParent))
+		return;
+
+	/* Bitmap of the pages in the delta, followed by their contents */
+	pages = NEXTRamEnd >> NEXT_RAM_PAGE_SHIFT;
+	pDirty = bSave ? NEXTMemory_GetDirtyPages(NEXTRAM_DIRTY_SNAPSHOT) : RestoredPages;
+	MemorySnapShot_Store(pDirty, pages/32*sizeof(Uint32));
+	for (page = 0; page < pages; page++)
+	{
+		if (pDirty[page>>5] & (1u << (page&31)))
+			MemorySnapShot_Store(&NEXTRam[page<<NEXT_RAM_PAGE_SHIFT], NEXT_RAM_PAGE_SIZE);
+	}
 }
 
 
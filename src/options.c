@@ -101,6 +101,7 @@ enum {
 	OPT_TOS,
 	OPT_CARTRIDGE,
 	OPT_MEMSTATE,
+	OPT_BOOTCACHE,
 	OPT_CPULEVEL,		/* CPU options */
 	OPT_CPUCLOCK,
 	OPT_COMPATIBLE,
@@ -281,6 +282,8 @@ static const opt_t HatariOptions[] = {
 	  "<file>", "Use ROM cartridge image <file>" },
 	{ OPT_MEMSTATE,   NULL, "--memstate",
 	  "<file>", "Load memory snap-shot <file>" },
+	{ OPT_BOOTCACHE,  NULL, "--boot-cache",
+	  "<dir>", "Start from boot states cached in <dir> ('none' to disable)" },
 	
 	{ OPT_HEADER, NULL, NULL, NULL, "CPU" },
 	{ OPT_CPULEVEL,  NULL, "--cpulevel",
@@ -1289,6 +1292,13 @@ bool Opt_ParseParameters(int argc, const char * const argv[])
 				bLoadAutoSave = false;
 			}
 			break;
+
+		case OPT_BOOTCACHE:
+			i += 1;
+			ok = Opt_StrCpy(OPT_BOOTCACHE, false, ConfigureParams.Memory.szBootCacheDir,
+					argv[i], sizeof(ConfigureParams.Memory.szBootCacheDir),
+					&ConfigureParams.Memory.bBootCache);
+			break;
 			
 			/* CPU options */
 		case OPT_CPULEVEL:
@@ -15,6 +15,7 @@
 #include "configuration.h"
 #include "ramdac.h"
 #include "sysReg.h"
+#include "memorySnapShot.h"
 
 #define IO_SEG_MASK 0x1FFFF
 
@@ -47,3 +48,9 @@ void ramdac_video_interrupt(void) {
         ramdac.cmd &= ~RAMDAC_CMD_ENABLE_INT;
     }
 }
+
+
+/* Save/Restore snapshot of the RAMDAC registers */
+void RAMDAC_MemorySnapShot_Capture(bool bSave) {
+    MemorySnapShot_Store(&ramdac, sizeof(ramdac));
+}
@@ -19,10 +19,13 @@ const char Reset_fileid[] = "Hatari reset.c : " __DATE__ " " __TIME__;
 #include "debugcpu.h"
 #include "scsi.h"
 #include "mo.h"
+#include "diskIO.h"
 #include "sysReg.h"
 #include "rtcnvram.h"
 #include "scc.h"
 #include "ethernet.h"
+#include "esp.h"
+#include "dma.h"
 
 
 /*-----------------------------------------------------------------------*/
@@ -44,10 +47,13 @@ static const char* Reset_ST(bool bCold)
 	Video_Reset();                /* Reset video */
     SCR_Reset();                  /* Reset System Control Registers */
     nvram_init();                 /* Reset NVRAM */
+    ESP_Reset();                  /* Reset SCSI controller */
     SCSI_Reset();                 /* Reset SCSI disks */
     MO_Reset();                   /* Reset MO disks */
+    DiskIO_Reset();               /* Reset disk I/O thread */
     SCC_Reset();                  /* Reset SCC */
     Ethernet_Reset();             /* Reset Ethernet */
+    DMA_Reset();                  /* Reset DMA */
 	Screen_Reset();               /* Reset screen */
 	M68000_Reset(bCold);          /* Reset CPU */
     	DebugCpu_SetDebugging();      /* Re-set debugging flag if needed */
@@ -0,0 +1,478 @@
+/*
+  Previous - rewind.c
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+
+  Rewind
+
+  Every few VBLs a checkpoint of the emulation state is taken and kept in
+  memory, so that the emulation can be stepped back in time.
+
+  A copy of main memory as of the newest checkpoint is kept. When the next
+  checkpoint is taken, the pages written since then are XORed with the
+  copy, which gives the difference to the previous checkpoint. It is
+  compressed with zlib at its fastest setting and attached to the previous
+  checkpoint, and the copy is updated. Stepping back restores the pages
+  written since the newest checkpoint from the copy and the CPU and chip
+  state of that checkpoint. Then the checkpoint is dropped and the copy
+  goes back to the one before it by applying its difference, so that the
+  next step goes further back in time.
+
+  The state of CPU and chips includes video memory, so it is compressed
+  the same way. Disk I/O requests in flight are not part of it, checkpoints
+  are postponed until there are none. The contents of the disk images are
+  not rewound.
+
+  The oldest checkpoints are dropped to stay within the configured number
+  of checkpoints and memory size. The copy of main memory is not included
+  in the memory size.
+*/
+const char Rewind_fileid[] = "Previous rewind.c : " __DATE__ " " __TIME__;
+
+#include "main.h"
+#include "configuration.h"
+#include "diskIO.h"
+#include "log.h"
+#include "memorySnapShot.h"
+#include "nextMemory.h"
+#include "reset.h"
+#include "rewind.h"
+#include "statusbar.h"
+
+/* Remove possible conflicting mkdir declaration from cpu/sysdeps.h */
+#undef mkdir
+#include <zlib.h>
+
+
+typedef struct {
+	Uint8 *state;       /* compressed CPU and chips, see MemorySnapShot_CaptureState */
+	Uint32 statesize;
+	Uint32 rawsize;     /* size of the state before compression */
+	Uint8 *diff;        /* compressed pages changed until the next checkpoint */
+	Uint32 diffsize;
+} REWIND_CHECKPOINT;
+
+static REWIND_CHECKPOINT *checkpoints;  /* ring buffer */
+static int nSlots, nFirst, nCount;
+static Uint32 nUsed;                    /* bytes used by the checkpoints */
+
+static Uint8 *pShadow;                  /* main memory at newest checkpoint */
+static Uint32 nShadowSize;
+
+static int nVBLs;
+
+/* Pages are stored in the difference with their index in front */
+static Uint8 DiffRecord[4+NEXT_RAM_PAGE_SIZE];
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Drop the oldest checkpoint.
+ */
+static void Rewind_DropOldest(void)
+{
+	REWIND_CHECKPOINT *c = &checkpoints[nFirst];
+
+	nUsed -= c->statesize + c->diffsize;
+	free(c->state);
+	free(c->diff);
+	memset(c, 0, sizeof(*c));
+	nFirst = (nFirst + 1) % nSlots;
+	nCount--;
+}
+
+static REWIND_CHECKPOINT *Rewind_Newest(int back)
+{
+	return &checkpoints[(nFirst + nCount - 1 - back) % nSlots];
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Drop all checkpoints and free the memory used for rewinding.
+ */
+void Rewind_Reset(void)
+{
+	while (nCount > 0)
+		Rewind_DropOldest();
+
+	free(checkpoints);
+	checkpoints = NULL;
+	nSlots = nFirst = 0;
+	free(pShadow);
+	pShadow = NULL;
+	nShadowSize = 0;
+	nVBLs = 0;
+}
+
+/**
+ * Set up the ring buffer and the copy of main memory for the first
+ * checkpoint.
+ */
+static bool Rewind_Start(void)
+{
+	nSlots = ConfigureParams.Memory.nRewindCheckpoints;
+	checkpoints = calloc(nSlots, sizeof(*checkpoints));
+	nShadowSize = NEXTRamEnd;
+	pShadow = malloc(nShadowSize);
+	if (!checkpoints || !pShadow)
+	{
+		Log_Printf(LOG_WARN, "Rewind: Not enough memory, disabling rewind.\n");
+		ConfigureParams.Memory.bRewind = false;
+		Rewind_Reset();
+		return false;
+	}
+
+	memcpy(pShadow, NEXTRam, nShadowSize);
+	NEXTMemory_ClearDirtyPages(NEXTRAM_DIRTY_REWIND);
+	return true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Feed data into the compressor, growing the output buffer as needed.
+ */
+static bool Rewind_Deflate(z_stream *z, Uint8 *data, Uint32 len, int flush,
+                           Uint8 **ppOut, Uint32 *pnOutSize)
+{
+	Uint8 *pNewOut;
+	Uint32 nNewSize;
+	int ret;
+
+	z->next_in = data;
+	z->avail_in = len;
+	do
+	{
+		if (z->total_out == *pnOutSize)
+		{
+			nNewSize = *pnOutSize ? 2 * *pnOutSize : 0x10000;
+			pNewOut = realloc(*ppOut, nNewSize);
+			if (!pNewOut)
+				return false;
+			*ppOut = pNewOut;
+			*pnOutSize = nNewSize;
+		}
+		z->next_out = *ppOut + z->total_out;
+		z->avail_out = *pnOutSize - z->total_out;
+		ret = deflate(z, flush);
+		if (ret == Z_STREAM_ERROR)
+			return false;
+	} while (z->avail_in > 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+
+	return true;
+}
+
+/**
+ * Compress a buffer to a newly allocated one. Returns NULL on error.
+ */
+static Uint8 *Rewind_Compress(Uint8 *data, Uint32 len, Uint32 *pnSize)
+{
+	Uint8 *pOut = NULL, *pShrunk;
+	Uint32 nOutSize = 0;
+	bool ok;
+	z_stream z;
+
+	memset(&z, 0, sizeof(z));
+	if (deflateInit(&z, Z_BEST_SPEED) != Z_OK)
+		return NULL;
+	ok = Rewind_Deflate(&z, data, len, Z_FINISH, &pOut, &nOutSize);
+	*pnSize = z.total_out;
+	deflateEnd(&z);
+
+	if (!ok)
+	{
+		free(pOut);
+		return NULL;
+	}
+	pShrunk = realloc(pOut, *pnSize);
+	return pShrunk ? pShrunk : pOut;
+}
+
+/**
+ * Uncompress the state of a checkpoint to a newly allocated buffer.
+ * Returns NULL on error.
+ */
+static Uint8 *Rewind_UncompressState(REWIND_CHECKPOINT *c)
+{
+	Uint8 *pOut;
+	z_stream z;
+	int ret;
+
+	pOut = malloc(c->rawsize);
+	if (!pOut)
+		return NULL;
+
+	memset(&z, 0, sizeof(z));
+	if (inflateInit(&z) != Z_OK)
+	{
+		free(pOut);
+		return NULL;
+	}
+	z.next_in = c->state;
+	z.avail_in = c->statesize;
+	z.next_out = pOut;
+	z.avail_out = c->rawsize;
+	ret = inflate(&z, Z_FINISH);
+	inflateEnd(&z);
+
+	if (ret != Z_STREAM_END || z.avail_out != 0)
+	{
+		free(pOut);
+		return NULL;
+	}
+	return pOut;
+}
+
+/**
+ * Compress the difference of the pages written since the newest checkpoint
+ * and update the copy of main memory. Returns NULL on error.
+ */
+static Uint8 *Rewind_MakeDiff(Uint32 *pnSize)
+{
+	Uint32 *pDirty = NEXTMemory_GetDirtyPages(NEXTRAM_DIRTY_REWIND);
+	Uint32 pages = nShadowSize >> NEXT_RAM_PAGE_SHIFT;
+	Uint32 page, i, offset;
+	Uint8 *pOut = NULL, *pShrunk;
+	Uint32 nOutSize = 0;
+	bool ok = true;
+	z_stream z;
+
+	memset(&z, 0, sizeof(z));
+	if (deflateInit(&z, Z_BEST_SPEED) != Z_OK)
+		return NULL;
+
+	for (page = 0; page < pages && ok; page++)
+	{
+		if (!(pDirty[page>>5] & (1u << (page&31))))
+			continue;
+		offset = page << NEXT_RAM_PAGE_SHIFT;
+		if (memcmp(pShadow + offset, NEXTRam + offset, NEXT_RAM_PAGE_SIZE) == 0)
+			continue;
+
+		memcpy(DiffRecord, &page, 4);
+		for (i = 0; i < NEXT_RAM_PAGE_SIZE; i++)
+			DiffRecord[4+i] = pShadow[offset+i] ^ NEXTRam[offset+i];
+		memcpy(pShadow + offset, NEXTRam + offset, NEXT_RAM_PAGE_SIZE);
+
+		ok = Rewind_Deflate(&z, DiffRecord, sizeof(DiffRecord), Z_NO_FLUSH, &pOut, &nOutSize);
+	}
+	if (ok)
+		ok = Rewind_Deflate(&z, NULL, 0, Z_FINISH, &pOut, &nOutSize);
+	*pnSize = z.total_out;
+	deflateEnd(&z);
+
+	NEXTMemory_ClearDirtyPages(NEXTRAM_DIRTY_REWIND);
+	if (!ok)
+	{
+		free(pOut);
+		return NULL;
+	}
+	pShrunk = realloc(pOut, *pnSize);
+	return pShrunk ? pShrunk : pOut;
+}
+
+/**
+ * Apply the difference of a checkpoint to the copy of main memory, which
+ * turns it back into main memory at that checkpoint. The changed pages
+ * are marked, as main memory no longer matches the copy there.
+ */
+static bool Rewind_ApplyDiff(REWIND_CHECKPOINT *c)
+{
+	Uint32 *pDirty = NEXTMemory_GetDirtyPages(NEXTRAM_DIRTY_REWIND);
+	Uint32 pages = nShadowSize >> NEXT_RAM_PAGE_SHIFT;
+	Uint32 page, i, offset;
+	z_stream z;
+	int ret;
+
+	memset(&z, 0, sizeof(z));
+	if (inflateInit(&z) != Z_OK)
+		return false;
+	z.next_in = c->diff;
+	z.avail_in = c->diffsize;
+
+	do
+	{
+		z.next_out = DiffRecord;
+		z.avail_out = sizeof(DiffRecord);
+		do
+		{
+			ret = inflate(&z, Z_NO_FLUSH);
+		} while (ret == Z_OK && z.avail_out > 0);
+
+		if (z.avail_out == 0)
+		{
+			memcpy(&page, DiffRecord, 4);
+			if (page >= pages)
+			{
+				ret = Z_DATA_ERROR;
+				break;
+			}
+			offset = page << NEXT_RAM_PAGE_SHIFT;
+			for (i = 0; i < NEXT_RAM_PAGE_SIZE; i++)
+				pShadow[offset+i] ^= DiffRecord[4+i];
+			pDirty[page>>5] |= 1u << (page&31);
+		}
+	} while (ret == Z_OK);
+
+	inflateEnd(&z);
+	return ret == Z_STREAM_END;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Take a checkpoint of the current state.
+ */
+static void Rewind_Checkpoint(void)
+{
+	REWIND_CHECKPOINT *c;
+	Uint8 *pState;
+
+	/* Main memory size changed with the configuration */
+	if (pShadow && nShadowSize != NEXTRamEnd)
+		Rewind_Reset();
+
+	if (!pShadow)
+	{
+		if (!Rewind_Start())
+			return;
+	}
+	else if (nCount > 0)
+	{
+		c = Rewind_Newest(0);
+		c->diff = Rewind_MakeDiff(&c->diffsize);
+		if (!c->diff)
+		{
+			Log_Printf(LOG_WARN, "Rewind: Can not compress checkpoint.\n");
+			Rewind_Reset();
+			return;
+		}
+		nUsed += c->diffsize;
+	}
+
+	if (nCount == nSlots)
+		Rewind_DropOldest();
+
+	c = &checkpoints[(nFirst + nCount) % nSlots];
+	pState = MemorySnapShot_CaptureState(&c->rawsize);
+	if (pState)
+	{
+		c->state = Rewind_Compress(pState, c->rawsize, &c->statesize);
+		free(pState);
+	}
+	if (!c->state)
+	{
+		Log_Printf(LOG_WARN, "Rewind: Can not save checkpoint.\n");
+		Rewind_Reset();
+		return;
+	}
+	nCount++;
+	nUsed += c->statesize;
+
+	while (nCount > 1 && nUsed > (Uint32)ConfigureParams.Memory.nRewindMemSize << 20)
+		Rewind_DropOldest();
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Called on every VBL, takes a checkpoint when it is due.
+ */
+void Rewind_VBL(void)
+{
+	if (!ConfigureParams.Memory.bRewind)
+	{
+		if (pShadow)
+			Rewind_Reset();
+		return;
+	}
+
+	if (nVBLs > 0)
+	{
+		nVBLs--;
+		return;
+	}
+
+	/* Try again on the next VBL */
+	if (!DiskIO_Idle())
+		return;
+
+	nVBLs = ConfigureParams.Memory.nRewindInterval - 1;
+
+	Rewind_Checkpoint();
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Go back to the newest checkpoint. Once there, it is dropped, so that
+ * the next step goes back to the one before it.
+ */
+void Rewind_Step(void)
+{
+	REWIND_CHECKPOINT *c;
+	Uint32 *pDirty;
+	Uint8 *pState;
+	Uint32 pages, page, offset;
+	bool ok;
+	char msg[64];
+
+	if (nCount == 0 || nShadowSize != NEXTRamEnd)
+	{
+		Statusbar_AddMessage("No rewind checkpoint", 2000);
+		return;
+	}
+
+	/* The requests in flight belong to the state being left */
+	DiskIO_Sync();
+
+	/* Restore the pages written since the newest checkpoint */
+	pDirty = NEXTMemory_GetDirtyPages(NEXTRAM_DIRTY_REWIND);
+	pages = nShadowSize >> NEXT_RAM_PAGE_SHIFT;
+	for (page = 0; page < pages; page++)
+	{
+		if (!(pDirty[page>>5] & (1u << (page&31))))
+			continue;
+		offset = page << NEXT_RAM_PAGE_SHIFT;
+		memcpy(NEXTRam + offset, pShadow + offset, NEXT_RAM_PAGE_SIZE);
+		NEXTmem_set_dirty_host(NEXTRam + offset, NEXT_RAM_PAGE_SIZE);
+	}
+	NEXTMemory_ClearDirtyPages(NEXTRAM_DIRTY_REWIND);
+
+	c = Rewind_Newest(0);
+	pState = Rewind_UncompressState(c);
+	ok = pState && MemorySnapShot_RestoreState(pState, c->rawsize);
+	free(pState);
+	if (!ok)
+	{
+		/* The state may be partly restored, start over */
+		Log_AlertDlg(LOG_ERROR, "Unable to restore rewind checkpoint, resetting.");
+		Rewind_Reset();
+		Reset_Cold();
+		return;
+	}
+
+	if (nCount > 1)
+	{
+		if (!Rewind_ApplyDiff(Rewind_Newest(1)))
+		{
+			Log_Printf(LOG_WARN, "Rewind: Can not decompress checkpoint.\n");
+			Rewind_Reset();
+			return;
+		}
+		nUsed -= c->statesize + Rewind_Newest(1)->diffsize;
+		free(c->state);
+		memset(c, 0, sizeof(*c));
+		c = Rewind_Newest(1);
+		free(c->diff);
+		c->diff = NULL;
+		c->diffsize = 0;
+		nCount--;
+	}
+	nVBLs = ConfigureParams.Memory.nRewindInterval - 1;
+
+	snprintf(msg, sizeof(msg), "Rewind: %i checkpoints left", nCount);
+	Statusbar_AddMessage(msg, 2000);
+}
@@ -15,6 +15,7 @@
 #include "configuration.h"
 #include "sysReg.h"
 #include "rtcnvram.h"
+#include "memorySnapShot.h"
 
 #include <time.h>
 
@@ -850,6 +851,18 @@ void nvram_checksum(int force) {
 }
 
 
+/* Save/Restore snapshot of the real time clock, its RAM and serial interface */
+void RTC_MemorySnapShot_Capture(bool bSave) {
+    MemorySnapShot_Store(&rtc, sizeof(rtc));
+    MemorySnapShot_Store(&newrtc, sizeof(newrtc));
+    MemorySnapShot_Store(&rtc_addr, sizeof(rtc_addr));
+    MemorySnapShot_Store(&rtc_val, sizeof(rtc_val));
+    MemorySnapShot_Store(&phase, sizeof(phase));
+    MemorySnapShot_Store(&freeze, sizeof(freeze));
+    MemorySnapShot_Store(&time_offset, sizeof(time_offset));
+}
+
+
 #if 1
 static char rtc_ram_info[1024];
 char * get_rtc_ram_info(void) {
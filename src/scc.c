@@ -18,6 +18,7 @@
 #include "scc.h"
 #include "sysReg.h"
 #include "dma.h"
+#include "memorySnapShot.h"
 
 
 #define SCC_ENABLE_INTERRUPT 1
@@ -310,4 +311,16 @@ void SCC_Reset(void) {
     /*--- Hack to pass power-on test ---*/
     channel[0].rreg[R_STATUS] = 0xFF;
     channel[1].rreg[R_STATUS] = 0xFF;
-}
\ No newline at end of file
+}
+
+
+/* Save/Restore snapshot of the SCC registers */
+void SCC_MemorySnapShot_Capture(bool bSave) {
+    MemorySnapShot_Store(&MasterIRQEnable, sizeof(MasterIRQEnable));
+    MemorySnapShot_Store(&lastIRQStat, sizeof(lastIRQStat));
+    MemorySnapShot_Store(&IRQType, sizeof(IRQType));
+    MemorySnapShot_Store(channel, sizeof(channel));
+    MemorySnapShot_Store(&IRQV, sizeof(IRQV));
+    MemorySnapShot_Store(&write_reg_pointer, sizeof(write_reg_pointer));
+    MemorySnapShot_Store(&regnumber, sizeof(regnumber));
+}
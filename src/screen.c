@@ -49,6 +49,8 @@ static int NEXTScreenEndHorizLine;                   /* End lines to be converte
 static int PCScreenBytesPerLine;
 static int NEXTScreenWidthBytes;
 static SDL_Rect NEXTScreenRect;                      /* screen size without statusbar */
+static SDL_Rect DirtyRects[NEXT_VIDEO_MAX_LINES];    /* converted screen areas to pass to SDL */
+static int nDirtyRects;
 
 static int NEXTScreenLineOffset[910];  /* Offsets for ST screen lines eg, 0,160,320... */
 
@@ -64,8 +66,23 @@ static bool Screen_DrawFrame(bool bForceFlip);
 #if 1 /* Translating to SDL2 */
 void SDL_UpdateRects(SDL_Surface *screen, int numrects, SDL_Rect *rects)
 {
+	int i;
+	Uint8 *pixels;
+
 	//fprintf(stderr,"rendering %i %i %i %i %i\n", numrects, rects->x, rects->w, rects->w, rects->h);
-	SDL_UpdateTexture(sdlTexture, NULL, screen->pixels, screen->pitch);
+	/* Only upload the changed areas to the texture */
+	for (i = 0; i < numrects; i++)
+	{
+		/* Like in SDL 1.2, an all zero rectangle means the whole screen */
+		if (rects[i].x == 0 && rects[i].y == 0 && rects[i].w == 0 && rects[i].h == 0)
+		{
+			SDL_UpdateTexture(sdlTexture, NULL, screen->pixels, screen->pitch);
+			continue;
+		}
+		pixels = (Uint8 *)screen->pixels + rects[i].y * screen->pitch
+		         + rects[i].x * screen->format->BytesPerPixel;
+		SDL_UpdateTexture(sdlTexture, &rects[i], pixels, screen->pitch);
+	}
 	SDL_RenderClear(sdlRenderer);
 	SDL_RenderCopy(sdlRenderer, sdlTexture, NULL, NULL);
 	SDL_RenderPresent(sdlRenderer);
@@ -122,6 +139,12 @@ static void Screen_Handle8BitPalettes(void)
  */
 static void Screen_SetDrawFunctions(int nBitCount, bool bDoubleLowRes)
 {
+	ConvertHighRes_SetupTables();
+
+	/* Use the line based converters if possible */
+	if (nBitCount == 32)
+		ScreenDrawFunctionsNormal[ST_HIGH_RES] = ConvertHighRes_640x32Bit;
+	else
 		ScreenDrawFunctionsNormal[ST_HIGH_RES] = ConvertHighRes_640x8Bit;
 }
 
@@ -572,8 +595,11 @@ static void Screen_Blit(void)
 {
 	unsigned char *pTmpScreen;
 
+	/* Only update the scanlines that have been converted */
+	if (nDirtyRects > 0)
 	{
-		SDL_UpdateRects(sdlscrn, 1, &NEXTScreenRect);
+		SDL_UpdateRects(sdlscrn, nDirtyRects, DirtyRects);
+		nDirtyRects = 0;
 	}
 
 	/* Swap copy/raster buffers in screen. */
@@ -596,9 +622,18 @@ static bool Screen_DrawFrame(bool bForceFlip)
 		
 		pDrawFunction = ScreenDrawFunctionsNormal[ST_HIGH_RES];
 
+		/* Redraw all scanlines after a mode change */
+		if (pFrameBuffer->bFullUpdate)
+		{
+			memset(NEXTVideo_DirtyLines, 0xff, sizeof(NEXTVideo_DirtyLines));
+			pFrameBuffer->bFullUpdate = false;
+		}
+
 		if (pDrawFunction)
 			CALL_VAR(pDrawFunction);
 
+		memset(NEXTVideo_DirtyLines, 0, sizeof(NEXTVideo_DirtyLines));
+
 		/* Unlock screen */
 		Screen_UnLock();
 
@@ -652,6 +687,45 @@ static void Convert_StartFrame(void)
 {
 }
 
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Return true if scanline 'y' has been written since the last update
+ */
+static inline bool Screen_LineDirty(int y)
+{
+	return NEXTVideo_DirtyLines[y>>5] & (1u << (y&31));
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Add a converted scanline to the areas passed to SDL, adjacent lines are
+ * merged into one rectangle
+ */
+static void Screen_AddDirtyLine(int y)
+{
+	SDL_Rect *rect;
+
+	if (y >= NEXTScreenRect.h)
+		return;
+	if (nDirtyRects > 0)
+	{
+		rect = &DirtyRects[nDirtyRects-1];
+		if (rect->y + rect->h == y)
+		{
+			rect->h++;
+			return;
+		}
+	}
+
+	rect = &DirtyRects[nDirtyRects++];
+	rect->x = 0;
+	rect->y = y;
+	rect->w = NEXTScreenRect.w;
+	rect->h = 1;
+}
+
 /* lookup tables and conversion macros */
 #include "convert/macros.h"
 
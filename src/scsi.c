@@ -1,5 +1,11 @@
 /* SCSI Bus and Disk emulation */
 #include "main.h"
+#if HAVE_PREAD || HAVE_MMAP
+#include <unistd.h>
+#endif
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include "ioMem.h"
 #include "ioMemTables.h"
 #include "configuration.h"
@@ -8,6 +14,9 @@
 #include "statusbar.h"
 #include "scsi.h"
 #include "file.h"
+#include "diskOverlay.h"
+#include "diskIO.h"
+#include "memorySnapShot.h"
 
 #define LOG_SCSI_LEVEL  LOG_DEBUG    /* Print debugging messages */
 
@@ -18,6 +27,8 @@
 
 
 #define BLOCKSIZE 512
+#define BUFFER_MIN_SIZE 1024 /* large enough for all non-disk data */
+#define READAHEAD_MAX_SIZE (1024*1024) /* prefetch limit for mapped images */
 
 #define LUN_DISK 0 // for now only LUN 0 is valid for our phys drives
 
@@ -116,6 +127,19 @@ void scsi_read_sector(void);
 void scsi_write_sector(void);
 
 
+/* Disk transfers are done by the disk I/O thread. Each target has two
+ * slots, so that the next part of a read can be fetched while the data
+ * of the current part is transferred. */
+#define SCSI_IO_SLOTS 2
+
+typedef struct {
+    DISKIO_REQUEST req;
+    Uint8 *buffer;      /* req.buf points into the image if it is mapped */
+    Uint32 buffersize;
+    bool valid;         /* req holds or fetches the blocks at req.lba */
+} SCSIIOSLOT;
+
+
 /* SCSI disk */
 struct {
     FILE* dsk;
@@ -134,6 +158,19 @@ struct {
     
     Uint32 lba;
     Uint32 blockcounter;
+    
+    Uint8 *buffer;      /* buffer for data that does not come from the disk */
+    
+    SCSIIOSLOT io[SCSI_IO_SLOTS];
+    int ioslot;         /* slot of the current transfer */
+    Uint32 endlba;      /* first block after the current or last read command */
+    bool readahead;     /* reads follow each other, fetch beyond the command */
+    bool writeerror;    /* a write of the current command failed */
+    
+    DISKOVERLAY *overlay; /* collects writes if the image is shared */
+    Uint8 *map;         /* image mapped into memory, NULL if not mapped */
+    Uint32 nextlba;     /* first block after the last read, for read-ahead */
+    bool sequential;
 } SCSIdisk[ESP_MAX_DEVS];
 
 
@@ -151,34 +188,140 @@ typedef struct {
 MODEPAGE SCSI_GetModePage(Uint8 pagecode);
 
 
+static int scsi_wait_slot = -1; /* slot the current transfer waits for */
+
+static void scsi_wait_writes(Uint8 target);
+static void scsi_invalidate_slots(Uint8 target);
+static void scsi_cache_init(void);
+static void scsi_cache_uninit(void);
+
+
+/* Map the image of a disk into memory. Read-write disks use a shared
+ * mapping, so that writes go to the image file; CD-ROMs are mapped
+ * private. If mapping fails, the image is accessed with file I/O. */
+static void scsi_map_image(Uint8 target) {
+    SCSIdisk[target].map = NULL;
+    SCSIdisk[target].nextlba = 0;
+    SCSIdisk[target].sequential = false;
+#if HAVE_MMAP
+    if (!ConfigureParams.SCSI.bMapImages || SCSIdisk[target].dsk==NULL || SCSIdisk[target].size==0 ||
+        SCSIdisk[target].overlay) {
+        return;
+    }
+    void *map;
+    if (SCSIdisk[target].cdrom) {
+        map = mmap(NULL, SCSIdisk[target].size, PROT_READ, MAP_PRIVATE, fileno(SCSIdisk[target].dsk), 0);
+    } else {
+        map = mmap(NULL, SCSIdisk[target].size, PROT_READ|PROT_WRITE, MAP_SHARED, fileno(SCSIdisk[target].dsk), 0);
+    }
+    if (map==MAP_FAILED) {
+        Log_Printf(LOG_WARN, "SCSI Disk%i: Cannot map image, using file I/O.\n", target);
+        return;
+    }
+    SCSIdisk[target].map = map;
+#endif
+}
+
+static void scsi_unmap_image(Uint8 target) {
+#if HAVE_MMAP
+    if (SCSIdisk[target].map) {
+        munmap(SCSIdisk[target].map, SCSIdisk[target].size);
+    }
+#endif
+    SCSIdisk[target].map = NULL;
+}
+
+
+/* Use an overlay file for writes, the image itself is only read. If the
+ * overlay can not be used, the disk is not attached to protect the image. */
+static void scsi_open_overlay(Uint8 target) {
+    SCSIdisk[target].overlay = NULL;
+    if (SCSIdisk[target].dsk==NULL || SCSIdisk[target].cdrom ||
+        ConfigureParams.SCSI.target[target].szOverlayName[0]=='\0') {
+        return;
+    }
+    SCSIdisk[target].overlay = DiskOverlay_Open(ConfigureParams.SCSI.target[target].szOverlayName,
+                                                SCSIdisk[target].dsk,
+                                                ConfigureParams.SCSI.target[target].szImageName);
+    if (SCSIdisk[target].overlay==NULL) {
+        Log_Printf(LOG_WARN, "SCSI Disk%i: Cannot use overlay %s, disk not attached!\n",
+                   target, ConfigureParams.SCSI.target[target].szOverlayName);
+        File_Close(SCSIdisk[target].dsk);
+        SCSIdisk[target].dsk = NULL;
+    } else {
+        Log_Printf(LOG_WARN, "SCSI Disk%i: Using overlay %s (%i blocks changed)\n", target,
+                   ConfigureParams.SCSI.target[target].szOverlayName,
+                   DiskOverlay_GetUsedBlocks(SCSIdisk[target].overlay));
+    }
+}
+
+
 /* Initialize/Uninitialize SCSI disks */
 void SCSI_Init(void) {
     Log_Printf(LOG_WARN, "Loading SCSI disks:\n");
     
     /* Check if files exist. Present dialog to re-select missing files. */        
-    int target;
+    int target, i;
     for (target = 0; target < ESP_MAX_DEVS; target++) {
         if (File_Exists(ConfigureParams.SCSI.target[target].szImageName) && ConfigureParams.SCSI.target[target].bAttached) {
             SCSIdisk[target].size = File_Length(ConfigureParams.SCSI.target[target].szImageName);
-            SCSIdisk[target].dsk = ConfigureParams.SCSI.target[target].bCDROM == true ? File_Open(ConfigureParams.SCSI.target[target].szImageName, "rb") : File_Open(ConfigureParams.SCSI.target[target].szImageName, "rb+");
+            if (ConfigureParams.SCSI.target[target].bCDROM || ConfigureParams.SCSI.target[target].szOverlayName[0]) {
+                SCSIdisk[target].dsk = File_Open(ConfigureParams.SCSI.target[target].szImageName, "rb");
+            } else {
+                SCSIdisk[target].dsk = File_Open(ConfigureParams.SCSI.target[target].szImageName, "rb+");
+            }
         } else {
             SCSIdisk[target].size = 0;
             SCSIdisk[target].dsk = NULL;
         }
         SCSIdisk[target].cdrom = ConfigureParams.SCSI.target[target].bCDROM;
+        scsi_open_overlay(target);
+        scsi_map_image(target);
         
         SCSIdisk[target].lun = SCSIdisk[target].status = SCSIdisk[target].message = 0;
         SCSIdisk[target].sense.code = SCSIdisk[target].sense.key = SCSIdisk[target].sense.info = 0;
         SCSIdisk[target].sense.valid = false;
         SCSIdisk[target].lba = SCSIdisk[target].blockcounter = 0;
+        
+        SCSIdisk[target].endlba = 0;
+        SCSIdisk[target].readahead = SCSIdisk[target].writeerror = false;
+        
+        if (SCSIdisk[target].buffer==NULL) {
+            SCSIdisk[target].buffer = malloc(BUFFER_MIN_SIZE);
+        }
+        for (i = 0; i < SCSI_IO_SLOTS; i++) {
+            if (SCSIdisk[target].io[i].buffer==NULL) {
+                SCSIdisk[target].io[i].buffersize = BUFFER_MIN_SIZE;
+                SCSIdisk[target].io[i].buffer = malloc(BUFFER_MIN_SIZE);
+            }
+            SCSIdisk[target].io[i].req.unit = target;
+            SCSIdisk[target].io[i].valid = false;
+        }
 
         Log_Printf(LOG_WARN, "SCSI Disk%i: %s\n",target,ConfigureParams.SCSI.target[target].szImageName);
     }
+    scsi_cache_init();
 }
 
 void SCSI_Uninit(void) {
-    int target;
+    int target, i;
+    
+    scsi_buffer.pending = false;
+    scsi_wait_slot = -1;
     for (target = 0; target < ESP_MAX_DEVS; target++) {
+        for (i = 0; i < SCSI_IO_SLOTS; i++) {
+            DiskIO_Wait(&SCSIdisk[target].io[i].req);
+            SCSIdisk[target].io[i].valid = false;
+        }
+    }
+    SCSI_Flush();
+    scsi_cache_uninit();
+    for (target = 0; target < ESP_MAX_DEVS; target++) {
+        scsi_unmap_image(target);
+        if (SCSIdisk[target].overlay) {
+            DiskOverlay_Close(SCSIdisk[target].overlay);
+            SCSIdisk[target].overlay = NULL;
+        }
         if (SCSIdisk[target].dsk) {
     		File_Close(SCSIdisk[target].dsk);
             SCSIdisk[target].dsk = NULL;
@@ -191,6 +334,73 @@ void SCSI_Reset(void) {
     SCSI_Init();
 }
 
+/* Save/Restore snapshot of the SCSI bus and the disks. Snapshots are only
+ * taken while no disk I/O is in flight, so the staging buffer holds all
+ * data of the current transfer. Data read ahead is fetched again. */
+void SCSI_MemorySnapShot_Capture(bool bSave) {
+    SCSIIOSLOT *io;
+    Uint8 *buffer;
+    int target;
+    
+    MemorySnapShot_Store(&SCSIbus, sizeof(SCSIbus));
+    for (target = 0; target < ESP_MAX_DEVS; target++) {
+        MemorySnapShot_Store(&SCSIdisk[target].lun, sizeof(SCSIdisk[target].lun));
+        MemorySnapShot_Store(&SCSIdisk[target].status, sizeof(SCSIdisk[target].status));
+        MemorySnapShot_Store(&SCSIdisk[target].message, sizeof(SCSIdisk[target].message));
+        MemorySnapShot_Store(&SCSIdisk[target].sense, sizeof(SCSIdisk[target].sense));
+        MemorySnapShot_Store(&SCSIdisk[target].lba, sizeof(SCSIdisk[target].lba));
+        MemorySnapShot_Store(&SCSIdisk[target].blockcounter, sizeof(SCSIdisk[target].blockcounter));
+        MemorySnapShot_Store(&SCSIdisk[target].ioslot, sizeof(SCSIdisk[target].ioslot));
+        MemorySnapShot_Store(&SCSIdisk[target].endlba, sizeof(SCSIdisk[target].endlba));
+        MemorySnapShot_Store(&SCSIdisk[target].readahead, sizeof(SCSIdisk[target].readahead));
+        MemorySnapShot_Store(&SCSIdisk[target].writeerror, sizeof(SCSIdisk[target].writeerror));
+        if (!bSave) {
+            scsi_invalidate_slots(target);
+        }
+    }
+    MemorySnapShot_Store(&scsi_buffer.limit, sizeof(scsi_buffer.limit));
+    MemorySnapShot_Store(&scsi_buffer.size, sizeof(scsi_buffer.size));
+    MemorySnapShot_Store(&scsi_buffer.disk, sizeof(scsi_buffer.disk));
+    
+    if (!bSave) {
+        scsi_buffer.pending = false;
+        scsi_wait_slot = -1;
+        scsi_buffer.data = NULL;
+        if (scsi_buffer.limit == 0) {
+            return;
+        }
+        target = SCSIbus.target;
+        if (target >= ESP_MAX_DEVS || SCSIdisk[target].ioslot < 0 ||
+            SCSIdisk[target].ioslot >= SCSI_IO_SLOTS) {
+            MemorySnapShot_SetError();
+            return;
+        }
+        if (scsi_buffer.disk) {
+            /* Disk data goes to the slot of the transfer again */
+            io = &SCSIdisk[target].io[SCSIdisk[target].ioslot];
+            if (scsi_buffer.limit > io->buffersize) {
+                buffer = realloc(io->buffer, scsi_buffer.limit);
+                if (buffer) {
+                    io->buffer = buffer;
+                    io->buffersize = scsi_buffer.limit;
+                }
+            }
+            if (scsi_buffer.limit <= io->buffersize) {
+                scsi_buffer.data = io->buffer;
+            }
+        } else if (scsi_buffer.limit <= BUFFER_MIN_SIZE) {
+            scsi_buffer.data = SCSIdisk[target].buffer;
+        }
+        if (scsi_buffer.data == NULL) {
+            MemorySnapShot_SetError();
+            return;
+        }
+    }
+    if (scsi_buffer.limit > 0) {
+        MemorySnapShot_Store(scsi_buffer.data, scsi_buffer.limit);
+    }
+}
+
 
 
 /* INQUIRY response data */
@@ -222,6 +432,7 @@ static unsigned char inquiry_bytes[] =
 
 
 Uint8 SCSIdisk_Send_Status(void) {
+    scsi_wait_writes(SCSIbus.target); /* errors are reported with the status */
     SCSIbus.phase = PHASE_MI;
     return SCSIdisk[SCSIbus.target].status;
 }
@@ -256,6 +467,9 @@ void SCSIdisk_Receive_Command(Uint8 *cdb, Uint8 identify) {
     }
 
     SCSIdisk[SCSIbus.target].lun = lun;
+    scsi_buffer.data = SCSIdisk[SCSIbus.target].buffer;
+    scsi_buffer.pending = false;
+    scsi_wait_slot = -1;
 
     Log_Printf(LOG_SCSI_LEVEL, "SCSI command: Opcode = $%02x, target = %i, lun = %i\n", cdb[0], SCSIbus.target,lun);
     
@@ -543,6 +757,555 @@ void SCSI_ReadCapacity(Uint8 *cdb) {
     SCSIdisk[target].sense.valid = false;
 }
 
+/* Disk transfer helpers */
+
+/* Return the number of blocks for the next part of the transfer and make
+ * sure the buffer of the slot is large enough for them */
+static Uint32 scsi_prepare_buffer(Uint8 target, int slot, Uint32 blocks) {
+    SCSIIOSLOT *io = &SCSIdisk[target].io[slot];
+    Uint32 maxblocks = ConfigureParams.SCSI.nBufferSize*1024/BLOCKSIZE;
+    Uint8 *buffer;
+    
+    if (maxblocks < 1)
+        maxblocks = 1;
+    if (blocks > maxblocks)
+        blocks = maxblocks;
+    
+    if (blocks*BLOCKSIZE > io->buffersize) {
+        buffer = realloc(io->buffer, blocks*BLOCKSIZE);
+        if (buffer) {
+            io->buffer = buffer;
+            io->buffersize = blocks*BLOCKSIZE;
+        } else {
+            blocks = io->buffersize/BLOCKSIZE;
+        }
+    }
+    io->req.buf = io->buffer;
+    return blocks;
+}
+/* Return the number of blocks from lba to the end of a mapped image,
+ * but not more than blocks */
+static Uint32 scsi_mapped_blocks(Uint8 target, Uint32 lba, Uint32 blocks) {
+    Uint32 total = SCSIdisk[target].size/BLOCKSIZE;
+    
+    if (lba >= total)
+        return 0;
+    if (blocks > total-lba)
+        blocks = total-lba;
+    return blocks;
+}
+
+/* Tell the kernel which part of a mapped image will be read. If the guest
+ * reads sequentially, the following blocks are prefetched as well. */
+static void scsi_advise_read(Uint8 target, Uint32 lba, Uint32 blocks) {
+#if HAVE_MMAP && defined(MADV_WILLNEED)
+    bool sequential = (lba==SCSIdisk[target].nextlba);
+    size_t pagemask = sysconf(_SC_PAGESIZE)-1;
+    size_t start = (size_t)lba*BLOCKSIZE;
+    size_t len = (size_t)blocks*BLOCKSIZE;
+    
+    SCSIdisk[target].nextlba = lba+blocks;
+    
+    if (sequential != SCSIdisk[target].sequential) {
+        madvise(SCSIdisk[target].map, SCSIdisk[target].size, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+        SCSIdisk[target].sequential = sequential;
+    }
+    if (sequential) {
+        len += len < READAHEAD_MAX_SIZE ? len : READAHEAD_MAX_SIZE;
+    }
+    if (start+len > SCSIdisk[target].size) {
+        len = SCSIdisk[target].size-start;
+    }
+    len += start&pagemask;
+    start &= ~pagemask;
+    madvise(SCSIdisk[target].map+start, len, MADV_WILLNEED);
+#endif
+}
+
+/* Read or write a number of blocks of the image with one call, return
+ * the number of blocks transferred */
+static Uint32 scsi_read_image(Uint8 target, Uint8 *buf, Uint32 lba, Uint32 blocks) {
+    FILE *dsk = SCSIdisk[target].dsk;
+    
+    if (SCSIdisk[target].overlay) {
+        return DiskOverlay_Read(SCSIdisk[target].overlay, buf, lba, blocks);
+    }
+#if HAVE_PREAD
+    ssize_t n = pread(fileno(dsk), buf, (size_t)blocks*BLOCKSIZE, (off_t)lba*BLOCKSIZE);
+    return n > 0 ? n/BLOCKSIZE : 0;
+#else
+    if (fseek(dsk, (long)lba*BLOCKSIZE, SEEK_SET) != 0)
+        return 0;
+    return fread(buf, BLOCKSIZE, blocks, dsk);
+#endif
+}
+
+static Uint32 scsi_write_image(Uint8 target, Uint8 *buf, Uint32 lba, Uint32 blocks) {
+    FILE *dsk = SCSIdisk[target].dsk;
+    
+    if (SCSIdisk[target].overlay) {
+        return DiskOverlay_Write(SCSIdisk[target].overlay, buf, lba, blocks);
+    }
+    if (SCSIdisk[target].map) {
+        blocks = scsi_mapped_blocks(target, lba, blocks);
+        memcpy(SCSIdisk[target].map+(size_t)lba*BLOCKSIZE, buf, (size_t)blocks*BLOCKSIZE);
+        return blocks;
+    }
+#if HAVE_PREAD
+    ssize_t n = pwrite(fileno(dsk), buf, (size_t)blocks*BLOCKSIZE, (off_t)lba*BLOCKSIZE);
+    return n > 0 ? n/BLOCKSIZE : 0;
+#else
+    if (fseek(dsk, (long)lba*BLOCKSIZE, SEEK_SET) != 0)
+        return 0;
+    return fwrite(buf, BLOCKSIZE, blocks, dsk);
+#endif
+}
+
+/* Write everything that has been written to the image to the disk */
+static void scsi_sync_image(Uint8 target) {
+    if (SCSIdisk[target].overlay) {
+        DiskOverlay_Sync(SCSIdisk[target].overlay);
+        return;
+    }
+#if HAVE_MMAP
+    if (SCSIdisk[target].map) {
+        msync(SCSIdisk[target].map, SCSIdisk[target].size, MS_SYNC);
+        return;
+    }
+#endif
+    fflush(SCSIdisk[target].dsk);
+#if HAVE_FSYNC
+    fsync(fileno(SCSIdisk[target].dsk));
+#endif
+}
+
+
+/* Block cache
+ *
+ * Blocks of all disks that are not mapped into memory are kept in a cache
+ * with least recently used replacement. Depending on the policy, writes go
+ * to the image right away (writethrough), within a few seconds by a
+ * background flush (writeback) or only when the blocks are evicted or the
+ * disks are flushed (unsafe). The cache is only used by the disk I/O thread
+ * or while no disk requests are in flight. */
+#define CACHE_FLUSH_BLOCKS      128     /* largest write when flushing */
+#define CACHE_FLUSH_INTERVAL    2000    /* ms between background flushes */
+#define CACHE_STATUS_INTERVAL   1000    /* ms between statusbar updates */
+
+typedef struct CACHEBLOCK {
+    struct CACHEBLOCK *hnext;   /* next block in hash chain */
+    struct CACHEBLOCK *prev;    /* LRU list, most recently used first */
+    struct CACHEBLOCK *next;
+    Uint32 lba;
+    Uint8 target;
+    bool dirty;
+    Uint8 data[BLOCKSIZE];
+} CACHEBLOCK;
+
+static struct {
+    CACHEBLOCK *blocks;
+    Uint32 count;
+    CACHEBLOCK **hash;
+    Uint32 hashmask;
+    CACHEBLOCK lru;             /* list head */
+    CACHEBLOCK *free;
+    Uint32 dirty;               /* number of dirty blocks */
+    CACHEBLOCK **sorted;        /* dirty blocks in disk order when flushing */
+    Uint8 *flushbuf;
+    Uint32 hits;
+    Uint32 misses;
+} scsi_cache;
+
+static DISKIO_REQUEST scsi_flush_req;
+static Uint32 scsi_flush_time = 0;
+static Uint32 scsi_status_time = 0;
+static bool scsi_cache_written = false; /* dirty blocks since last flush */
+
+static void scsi_cache_init(void) {
+    Uint32 count = ConfigureParams.SCSI.nCacheSize*1024/BLOCKSIZE;
+    Uint32 i, hashsize;
+    
+    memset(&scsi_cache, 0, sizeof(scsi_cache));
+    scsi_cache.lru.prev = scsi_cache.lru.next = &scsi_cache.lru;
+    if (count==0) {
+        return;
+    }
+    for (hashsize = 1; hashsize < count; hashsize <<= 1) {}
+    
+    scsi_cache.blocks = malloc(count*sizeof(CACHEBLOCK));
+    scsi_cache.hash = calloc(hashsize, sizeof(CACHEBLOCK*));
+    scsi_cache.sorted = malloc(count*sizeof(CACHEBLOCK*));
+    scsi_cache.flushbuf = malloc(CACHE_FLUSH_BLOCKS*BLOCKSIZE);
+    if (!scsi_cache.blocks || !scsi_cache.hash || !scsi_cache.sorted || !scsi_cache.flushbuf) {
+        Log_Printf(LOG_WARN, "SCSI: Cannot allocate block cache, cache disabled.\n");
+        free(scsi_cache.blocks);
+        free(scsi_cache.hash);
+        free(scsi_cache.sorted);
+        free(scsi_cache.flushbuf);
+        memset(&scsi_cache, 0, sizeof(scsi_cache));
+        scsi_cache.lru.prev = scsi_cache.lru.next = &scsi_cache.lru;
+        return;
+    }
+    scsi_cache.count = count;
+    scsi_cache.hashmask = hashsize-1;
+    for (i = 0; i < count; i++) {
+        scsi_cache.blocks[i].next = scsi_cache.free;
+        scsi_cache.free = &scsi_cache.blocks[i];
+    }
+}
+
+static void scsi_cache_uninit(void) {
+    free(scsi_cache.blocks);
+    free(scsi_cache.hash);
+    free(scsi_cache.sorted);
+    free(scsi_cache.flushbuf);
+    memset(&scsi_cache, 0, sizeof(scsi_cache));
+    scsi_cache.lru.prev = scsi_cache.lru.next = &scsi_cache.lru;
+}
+
+static inline CACHEBLOCK **scsi_cache_chain(Uint8 target, Uint32 lba) {
+    return &scsi_cache.hash[(lba^((Uint32)target<<20))&scsi_cache.hashmask];
+}
+
+static CACHEBLOCK *scsi_cache_lookup(Uint8 target, Uint32 lba) {
+    CACHEBLOCK *b;
+    for (b = *scsi_cache_chain(target, lba); b; b = b->hnext) {
+        if (b->lba==lba && b->target==target) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+static void scsi_cache_unlink(CACHEBLOCK *b) {
+    b->prev->next = b->next;
+    b->next->prev = b->prev;
+}
+
+static void scsi_cache_touch(CACHEBLOCK *b) {
+    scsi_cache_unlink(b);
+    b->next = scsi_cache.lru.next;
+    b->prev = &scsi_cache.lru;
+    b->next->prev = b;
+    scsi_cache.lru.next = b;
+}
+
+static void scsi_cache_drop(CACHEBLOCK *b) {
+    CACHEBLOCK **p = scsi_cache_chain(b->target, b->lba);
+    
+    while (*p != b) {
+        p = &(*p)->hnext;
+    }
+    *p = b->hnext;
+    scsi_cache_unlink(b);
+    if (b->dirty) {
+        scsi_cache.dirty--;
+    }
+    b->next = scsi_cache.free;
+    scsi_cache.free = b;
+}
+
+/* Get a block for lba, the least recently used block is evicted if the
+ * cache is full */
+static CACHEBLOCK *scsi_cache_alloc(Uint8 target, Uint32 lba) {
+    CACHEBLOCK *b = scsi_cache.free;
+    CACHEBLOCK **p;
+    
+    if (b==NULL) {
+        b = scsi_cache.lru.prev;
+        if (b->dirty && scsi_write_image(b->target, b->data, b->lba, 1) != 1) {
+            Log_Printf(LOG_WARN, "SCSI Disk%i: Write error at block %i.\n", b->target, b->lba);
+        }
+        scsi_cache_drop(b);
+        b = scsi_cache.free;
+    }
+    scsi_cache.free = b->next;
+    
+    b->target = target;
+    b->lba = lba;
+    b->dirty = false;
+    p = scsi_cache_chain(target, lba);
+    b->hnext = *p;
+    *p = b;
+    b->prev = b->next = b;
+    scsi_cache_touch(b);
+    return b;
+}
+
+static int scsi_cache_compare(const void *a, const void *b) {
+    const CACHEBLOCK *x = *(CACHEBLOCK* const*)a;
+    const CACHEBLOCK *y = *(CACHEBLOCK* const*)b;
+    
+    if (x->target != y->target)
+        return x->target < y->target ? -1 : 1;
+    if (x->lba != y->lba)
+        return x->lba < y->lba ? -1 : 1;
+    return 0;
+}
+
+/* Write all dirty blocks to the images. Neighbouring blocks are written
+ * with one call. */
+static void scsi_cache_flush(void) {
+    Uint32 i, j, n = 0;
+    CACHEBLOCK *b;
+    
+    if (scsi_cache.dirty==0) {
+        return;
+    }
+    for (b = scsi_cache.lru.next; b != &scsi_cache.lru; b = b->next) {
+        if (b->dirty) {
+            scsi_cache.sorted[n++] = b;
+        }
+    }
+    qsort(scsi_cache.sorted, n, sizeof(CACHEBLOCK*), scsi_cache_compare);
+    
+    for (i = 0; i < n; i = j) {
+        b = scsi_cache.sorted[i];
+        for (j = i; j < n && j-i < CACHE_FLUSH_BLOCKS; j++) {
+            if (scsi_cache.sorted[j]->target != b->target || scsi_cache.sorted[j]->lba != b->lba+(j-i)) {
+                break;
+            }
+            memcpy(scsi_cache.flushbuf+(j-i)*BLOCKSIZE, scsi_cache.sorted[j]->data, BLOCKSIZE);
+            scsi_cache.sorted[j]->dirty = false;
+        }
+        if (scsi_write_image(b->target, scsi_cache.flushbuf, b->lba, j-i) != j-i) {
+            Log_Printf(LOG_WARN, "SCSI Disk%i: Write error at block %i.\n", b->target, b->lba);
+        }
+    }
+    scsi_cache.dirty = 0;
+}
+
+/* Read or write a number of blocks through the cache, return the number
+ * of blocks transferred. Mapped images are not cached, the host does that
+ * already. Transfers of more than a quarter of the cache go to the image,
+ * so that long sequential transfers do not push out everything else. */
+static Uint32 scsi_read_blocks(Uint8 target, Uint8 *buf, Uint32 lba, Uint32 blocks) {
+    Uint32 done = 0, run, n, i;
+    CACHEBLOCK *b;
+    
+    if (scsi_cache.count==0 || SCSIdisk[target].map) {
+        return scsi_read_image(target, buf, lba, blocks);
+    }
+    while (done < blocks) {
+        b = scsi_cache_lookup(target, lba+done);
+        if (b) {
+            memcpy(buf+done*BLOCKSIZE, b->data, BLOCKSIZE);
+            scsi_cache_touch(b);
+            scsi_cache.hits++;
+            done++;
+            continue;
+        }
+        /* Read all missing blocks up to the next cached one with one call */
+        for (run = 1; done+run < blocks; run++) {
+            if (scsi_cache_lookup(target, lba+done+run)) {
+                break;
+            }
+        }
+        n = scsi_read_image(target, buf+done*BLOCKSIZE, lba+done, run);
+        scsi_cache.misses += run;
+        if (run <= scsi_cache.count/4) {
+            for (i = 0; i < n; i++) {
+                b = scsi_cache_alloc(target, lba+done+i);
+                memcpy(b->data, buf+(done+i)*BLOCKSIZE, BLOCKSIZE);
+            }
+        }
+        done += n;
+        if (n < run) {
+            break;
+        }
+    }
+    return done;
+}
+
+static Uint32 scsi_write_blocks(Uint8 target, Uint8 *buf, Uint32 lba, Uint32 blocks) {
+    Uint32 n, i;
+    CACHEBLOCK *b;
+    
+    if (scsi_cache.count==0 || SCSIdisk[target].map) {
+        return scsi_write_image(target, buf, lba, blocks);
+    }
+    if (ConfigureParams.SCSI.nCachePolicy==SCSI_CACHE_WRITETHROUGH || blocks > scsi_cache.count/4) {
+        n = scsi_write_image(target, buf, lba, blocks);
+        /* Keep cached copies up to date, the image now has the newest data */
+        for (i = 0; i < blocks; i++) {
+            b = scsi_cache_lookup(target, lba+i);
+            if (b==NULL) {
+                continue;
+            }
+            if (i < n) {
+                memcpy(b->data, buf+i*BLOCKSIZE, BLOCKSIZE);
+                if (b->dirty) {
+                    b->dirty = false;
+                    scsi_cache.dirty--;
+                }
+            } else {
+                scsi_cache_drop(b);
+            }
+        }
+        return n;
+    }
+    for (i = 0; i < blocks; i++) {
+        b = scsi_cache_lookup(target, lba+i);
+        if (b) {
+            scsi_cache_touch(b);
+        } else {
+            b = scsi_cache_alloc(target, lba+i);
+        }
+        memcpy(b->data, buf+i*BLOCKSIZE, BLOCKSIZE);
+        if (!b->dirty) {
+            b->dirty = true;
+            scsi_cache.dirty++;
+        }
+    }
+    /* Do not let evictions write single blocks */
+    if (scsi_cache.dirty > scsi_cache.count/2) {
+        scsi_cache_flush();
+    }
+    return blocks;
+}
+
+
+/* Functions called on the disk I/O thread */
+static Uint32 scsi_io_read(DISKIO_REQUEST *req) {
+    Uint8 target = req->unit;
+    
+    if (SCSIdisk[target].map) {
+        /* Touch the pages, so that the emulation does not wait for them */
+        volatile Uint8 *p = req->buf;
+        size_t i, len = (size_t)req->blocks*BLOCKSIZE;
+        for (i = 0; i < len; i += 8*BLOCKSIZE) {
+            (void)p[i];
+        }
+        return req->blocks;
+    }
+    if (SCSIdisk[target].dsk==NULL) {
+        return 0;
+    }
+    return scsi_read_blocks(target, req->buf, req->lba, req->blocks);
+}
+
+static Uint32 scsi_io_write(DISKIO_REQUEST *req) {
+    if (SCSIdisk[req->unit].dsk==NULL) {
+        return 0;
+    }
+#if 1
+    return scsi_write_blocks(req->unit, req->buf, req->lba, req->blocks);
+#else
+    Log_Printf(LOG_SCSI_LEVEL, "[SCSI] WARNING: File write disabled!");
+    return req->blocks;
+#endif
+}
+
+static Uint32 scsi_io_flush(DISKIO_REQUEST *req) {
+    scsi_cache_flush();
+    return 0;
+}
+
+static Uint32 scsi_io_sync(DISKIO_REQUEST *req) {
+    int target;
+    
+    scsi_cache_flush();
+    for (target = 0; target < ESP_MAX_DEVS; target++) {
+        /* Overlays are always synced, the boot cache copies them */
+        if (SCSIdisk[target].dsk && !SCSIdisk[target].cdrom &&
+            (ConfigureParams.SCSI.nCachePolicy != SCSI_CACHE_UNSAFE || SCSIdisk[target].overlay)) {
+            scsi_sync_image(target);
+        }
+    }
+    return 0;
+}
+
+
+/* Write cached blocks to the images and make sure they reach the disk */
+void SCSI_Flush(void) {
+    DiskIO_Wait(&scsi_flush_req);
+    scsi_flush_req.work = scsi_io_sync;
+    scsi_flush_req.done = NULL;
+    DiskIO_Submit(&scsi_flush_req, 0);
+    DiskIO_Wait(&scsi_flush_req);
+    scsi_cache_written = false;
+    scsi_flush_time = SDL_GetTicks();
+}
+
+/* Called every VBL: start a background flush from time to time and show
+ * the cache hit rate, also while the guest does not access the disks */
+void SCSI_VBL(void) {
+    Uint32 now;
+    
+    if (scsi_cache.count==0) {
+        return;
+    }
+    now = SDL_GetTicks();
+    if (scsi_cache_written && ConfigureParams.SCSI.nCachePolicy==SCSI_CACHE_WRITEBACK &&
+        !scsi_flush_req.busy && now-scsi_flush_time >= CACHE_FLUSH_INTERVAL) {
+        scsi_flush_req.work = scsi_io_flush;
+        scsi_flush_req.done = NULL;
+        DiskIO_Submit(&scsi_flush_req, 0);
+        scsi_cache_written = false;
+        scsi_flush_time = now;
+    }
+    if (now-scsi_status_time >= CACHE_STATUS_INTERVAL) {
+        Statusbar_UpdateInfo();
+        scsi_status_time = now;
+    }
+}
+
+/* Return the cache statistics, false if no cache is used */
+bool SCSI_GetCacheStats(Uint32 *hits, Uint32 *misses) {
+    *hits = scsi_cache.hits;
+    *misses = scsi_cache.misses;
+    return scsi_cache.count > 0;
+}
+
+
+/* Slot handling */
+
+/* Return the slot that holds or fetches the block at lba, -1 if none */
+static int scsi_find_slot(Uint8 target, Uint32 lba) {
+    int i;
+    for (i = 0; i < SCSI_IO_SLOTS; i++) {
+        SCSIIOSLOT *io = &SCSIdisk[target].io[i];
+        if (io->valid && lba >= io->req.lba && lba < io->req.lba+io->req.blocks) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Return a slot that is not in use, wait for one if all are busy */
+static int scsi_get_slot(Uint8 target, int keep) {
+    int i;
+    for (i = 0; i < SCSI_IO_SLOTS; i++) {
+        if (i!=keep && !SCSIdisk[target].io[i].req.busy) {
+            break;
+        }
+    }
+    if (i==SCSI_IO_SLOTS) {
+        i = (keep==0) ? 1 : 0;
+        DiskIO_Wait(&SCSIdisk[target].io[i].req);
+    }
+    SCSIdisk[target].io[i].valid = false;
+    return i;
+}
+
+/* Forget all data that has been read ahead */
+static void scsi_invalidate_slots(Uint8 target) {
+    int i;
+    for (i = 0; i < SCSI_IO_SLOTS; i++) {
+        SCSIdisk[target].io[i].valid = false;
+    }
+}
+
+static void scsi_wait_writes(Uint8 target) {
+    int i;
+    for (i = 0; i < SCSI_IO_SLOTS; i++) {
+        if (SCSIdisk[target].io[i].req.work==scsi_io_write) {
+            DiskIO_Wait(&SCSIdisk[target].io[i].req);
+        }
+    }
+}
+
+
 void SCSI_WriteSector(Uint8 *cdb) {
     Uint8 target = SCSIbus.target;
     
@@ -557,50 +1320,74 @@ void SCSI_WriteSector(Uint8 *cdb) {
         SCSIbus.phase = PHASE_ST;
         return;
     }
+    if (SCSIdisk[target].blockcounter==0) {
+        SCSIdisk[target].status = STAT_GOOD;
+        SCSIbus.phase = PHASE_ST;
+        return;
+    }
+    /* Data read ahead may be overwritten */
+    scsi_invalidate_slots(target);
+    scsi_wait_writes(target);
+    SCSIdisk[target].writeerror = false;
+    SCSIdisk[target].status = STAT_GOOD;
+    SCSIdisk[target].sense.code = SC_NO_ERROR;
+    SCSIdisk[target].sense.valid = false;
+    
     scsi_buffer.disk=true;
     scsi_buffer.size=0;
-    scsi_buffer.limit=BLOCKSIZE;
+    SCSIdisk[target].ioslot = scsi_get_slot(target, -1);
+    scsi_buffer.limit=scsi_prepare_buffer(target, SCSIdisk[target].ioslot, SCSIdisk[target].blockcounter)*BLOCKSIZE;
+    scsi_buffer.data = SCSIdisk[target].io[SCSIdisk[target].ioslot].buffer;
     SCSIbus.phase = PHASE_DO;
     Log_Printf(LOG_SCSI_LEVEL, "[SCSI] Write sector: %i block(s) at offset %i (blocksize: %i byte)",
                SCSIdisk[target].blockcounter, SCSIdisk[target].lba, BLOCKSIZE);
 }
 
+/* Writes are only waited for before the status is sent. A failed write
+ * stops the transfer if it is still running. */
+static void scsi_io_write_done(DISKIO_REQUEST *req) {
+    Uint8 target = req->unit;
+    
+    if (req->result < req->blocks && !SCSIdisk[target].writeerror) {
+        SCSIdisk[target].writeerror = true;
+        SCSIdisk[target].status = STAT_CHECK_COND;
+        SCSIdisk[target].sense.code = SC_INVALID_LBA;
+        SCSIdisk[target].sense.valid = true;
+        SCSIdisk[target].sense.info = req->lba+req->result;
+        if (SCSIbus.target==target && SCSIbus.phase==PHASE_DO && scsi_buffer.disk) {
+            SCSIbus.phase = PHASE_ST;
+        }
+    }
+}
+
 void scsi_write_sector(void) {
     Uint8 target = SCSIbus.target;
-    int n=0;
+    SCSIIOSLOT *io = &SCSIdisk[target].io[SCSIdisk[target].ioslot];
+    Uint32 blocks = scsi_buffer.limit/BLOCKSIZE;
     
-    Log_Printf(LOG_SCSI_LEVEL, "[SCSI] Writing block at offset %i (%i blocks remaining).",
-               SCSIdisk[target].lba,SCSIdisk[target].blockcounter-1);
+    Log_Printf(LOG_SCSI_LEVEL, "[SCSI] Writing %i block(s) at offset %i (%i blocks remaining).",
+               blocks,SCSIdisk[target].lba,SCSIdisk[target].blockcounter-blocks);
     
-    /* seek to the position */
-	if ((SCSIdisk[target].dsk==NULL) || (fseek(SCSIdisk[target].dsk, SCSIdisk[target].lba*BLOCKSIZE, SEEK_SET) != 0)) {
-        n = 0;
-	} else {
-#if 1
-        n = fwrite(scsi_buffer.data, BLOCKSIZE, 1, SCSIdisk[target].dsk);
-#else
-        n=1;
-        Log_Printf(LOG_SCSI_LEVEL, "[SCSI] WARNING: File write disabled!");
-#endif
-        scsi_buffer.limit=BLOCKSIZE;
-        scsi_buffer.size=0;
-    }
+    io->req.work = scsi_io_write;
+    io->req.done = scsi_io_write_done;
+    io->req.buf = scsi_buffer.data;
+    io->req.lba = SCSIdisk[target].lba;
+    io->req.blocks = blocks;
     
-    if (n == 1) {
-        SCSIdisk[target].status = STAT_GOOD;
-        SCSIdisk[target].sense.code = SC_NO_ERROR;
-        SCSIdisk[target].sense.valid = false;
-        SCSIdisk[target].lba++;
-        SCSIdisk[target].blockcounter--;
-        if (SCSIdisk[target].blockcounter==0) {
-            SCSIbus.phase = PHASE_ST;
-        }
-    } else {
-        SCSIdisk[target].status = STAT_CHECK_COND;
-        SCSIdisk[target].sense.code = SC_INVALID_LBA;
-        SCSIdisk[target].sense.valid = true;
-        SCSIdisk[target].sense.info = SCSIdisk[target].lba;
+    SCSIdisk[target].lba+=blocks;
+    SCSIdisk[target].blockcounter-=blocks;
+    
+    DiskIO_Submit(&io->req, 0);
+    scsi_cache_written = true;
+    
+    if (SCSIdisk[target].writeerror || SCSIdisk[target].blockcounter==0) {
         SCSIbus.phase = PHASE_ST;
+    } else {
+        /* Take the next part while this one is written */
+        SCSIdisk[target].ioslot = scsi_get_slot(target, SCSIdisk[target].ioslot);
+        scsi_buffer.size=0;
+        scsi_buffer.limit=scsi_prepare_buffer(target, SCSIdisk[target].ioslot, SCSIdisk[target].blockcounter)*BLOCKSIZE;
+        scsi_buffer.data = SCSIdisk[target].io[SCSIdisk[target].ioslot].buffer;
     }
 }
 
@@ -619,11 +1406,32 @@ void SCSIdisk_Receive_Data(Uint8 val) {
 }
 
 
+/* Receive up to len bytes at once (used by DMA). Stops at the end of the
+ * current buffer. Returns the number of bytes received. */
+Uint32 SCSIdisk_Receive_Data_Block(const Uint8 *src, Uint32 len) {
+    if (len > scsi_buffer.limit-scsi_buffer.size) {
+        len = scsi_buffer.limit-scsi_buffer.size;
+    }
+    memcpy(scsi_buffer.data+scsi_buffer.size, src, len);
+    scsi_buffer.size+=len;
+    if (len>0 && scsi_buffer.size==scsi_buffer.limit) {
+        if (scsi_buffer.disk==true) {
+            scsi_write_sector();  /* sets status phase if done or error */
+        } else {
+            SCSIbus.phase = PHASE_ST;
+        }
+    }
+    return len;
+}
+
+
 void SCSI_ReadSector(Uint8 *cdb) {
     Uint8 target = SCSIbus.target;
     
     SCSIdisk[target].lba = SCSI_GetOffset(cdb[0], cdb);
     SCSIdisk[target].blockcounter = SCSI_GetCount(cdb[0], cdb);
+    SCSIdisk[target].readahead = (SCSIdisk[target].lba==SCSIdisk[target].endlba);
+    SCSIdisk[target].endlba = SCSIdisk[target].lba+SCSIdisk[target].blockcounter;
     scsi_buffer.disk=true;
     scsi_buffer.size=0;
     SCSIbus.phase = PHASE_DI;
@@ -632,33 +1440,29 @@ void SCSI_ReadSector(Uint8 *cdb) {
     scsi_read_sector();
 }
 
-void scsi_read_sector(void) {
-    Uint8 target = SCSIbus.target;
+/* Pass the data of a slot to the transfer */
+static void scsi_read_done(Uint8 target, int slot) {
+    SCSIIOSLOT *io = &SCSIdisk[target].io[slot];
+    Uint32 offset = SCSIdisk[target].lba-io->req.lba;
+    Uint32 n = 0;
     
-    if (SCSIdisk[target].blockcounter==0) {
-        SCSIbus.phase = PHASE_ST;
-        return;
-    }
-
-    int n;
-    
-    Log_Printf(LOG_SCSI_LEVEL, "[SCSI] Reading block at offset %i (%i blocks remaining).",
-               SCSIdisk[target].lba,SCSIdisk[target].blockcounter-1);
-    
-    /* seek to the position */
-	if ((SCSIdisk[target].dsk==NULL) || (fseek(SCSIdisk[target].dsk, SCSIdisk[target].lba*BLOCKSIZE, SEEK_SET) != 0)) {
-        n = 0;
-	} else {
-        n = fread(scsi_buffer.data, BLOCKSIZE, 1, SCSIdisk[target].dsk);
-        scsi_buffer.limit=scsi_buffer.size=BLOCKSIZE;
+    if (io->req.result > offset) {
+        n = io->req.result-offset;
+        if (n > SCSIdisk[target].blockcounter) {
+            n = SCSIdisk[target].blockcounter;
+        }
     }
+    SCSIdisk[target].ioslot = slot;
     
-    if (n == 1) {
+    /* Pass the blocks read so far, the error is reported for the next block */
+    if (n > 0) {
+        scsi_buffer.data = io->req.buf+(size_t)offset*BLOCKSIZE;
+        scsi_buffer.limit=scsi_buffer.size=n*BLOCKSIZE;
         SCSIdisk[target].status = STAT_GOOD;
         SCSIdisk[target].sense.code = SC_NO_ERROR;
         SCSIdisk[target].sense.valid = false;
-        SCSIdisk[target].lba++;
-        SCSIdisk[target].blockcounter--;
+        SCSIdisk[target].lba+=n;
+        SCSIdisk[target].blockcounter-=n;
     } else {
         SCSIdisk[target].status = STAT_CHECK_COND;
         SCSIdisk[target].sense.code = SC_INVALID_LBA;
@@ -668,8 +1472,108 @@ void scsi_read_sector(void) {
     }
 }
 
+static void scsi_io_read_done(DISKIO_REQUEST *req) {
+    Uint8 target = req->unit;
+    
+    if (scsi_buffer.pending && SCSIbus.target==target &&
+        req==&SCSIdisk[target].io[scsi_wait_slot].req) {
+        scsi_buffer.pending = false;
+        scsi_read_done(target, scsi_wait_slot);
+        scsi_wait_slot = -1;
+    }
+}
+
+static void scsi_submit_read(Uint8 target, int slot, Uint32 lba, Uint32 blocks) {
+    SCSIIOSLOT *io = &SCSIdisk[target].io[slot];
+    
+    if (SCSIdisk[target].map) {
+        /* Transfer directly from the mapped image, no need to copy */
+        blocks = scsi_mapped_blocks(target, lba, blocks);
+        if (blocks > 0) {
+            scsi_advise_read(target, lba, blocks);
+        }
+        io->req.buf = SCSIdisk[target].map+(size_t)lba*BLOCKSIZE;
+    } else {
+        /* Read as many blocks as possible at once */
+        blocks = scsi_prepare_buffer(target, slot, blocks);
+    }
+    Log_Printf(LOG_SCSI_LEVEL, "[SCSI] Reading %i block(s) at offset %i.", blocks, lba);
+    
+    io->req.work = scsi_io_read;
+    io->req.done = scsi_io_read_done;
+    io->req.lba = lba;
+    io->req.blocks = blocks;
+    io->valid = true;
+    DiskIO_Submit(&io->req, 0);
+}
+
+/* Fetch the blocks that follow the data of a slot: the rest of the
+ * command, or the same amount beyond the command if the guest reads
+ * sequentially. Nothing is done if the other slot is still busy. */
+static void scsi_read_ahead(Uint8 target, int slot) {
+    SCSIIOSLOT *io = &SCSIdisk[target].io[slot];
+    Uint32 lba = io->req.lba+io->req.blocks;
+    Uint32 total = SCSIdisk[target].size/BLOCKSIZE;
+    Uint32 blocks;
+    int next;
+    
+    if (lba < SCSIdisk[target].endlba) {
+        blocks = SCSIdisk[target].endlba-lba;
+    } else if (SCSIdisk[target].readahead) {
+        blocks = io->req.blocks;
+    } else {
+        return;
+    }
+    if (lba >= total || scsi_find_slot(target, lba) >= 0) {
+        return;
+    }
+    if (blocks > total-lba) {
+        blocks = total-lba;
+    }
+    for (next = 0; next < SCSI_IO_SLOTS; next++) {
+        if (next!=slot && !SCSIdisk[target].io[next].req.busy) {
+            scsi_submit_read(target, next, lba, blocks);
+            return;
+        }
+    }
+}
+
+void scsi_read_sector(void) {
+    Uint8 target = SCSIbus.target;
+    int slot;
+    
+    if (SCSIdisk[target].blockcounter==0) {
+        SCSIbus.phase = PHASE_ST;
+        return;
+    }
+    
+    slot = scsi_find_slot(target, SCSIdisk[target].lba);
+    if (slot < 0) {
+        slot = scsi_get_slot(target, -1);
+        scsi_submit_read(target, slot, SCSIdisk[target].lba, SCSIdisk[target].blockcounter);
+    }
+    scsi_read_ahead(target, slot);
+    
+    if (SCSIdisk[target].io[slot].req.busy) {
+        /* The transfer continues when the data is there */
+        scsi_buffer.pending = true;
+        scsi_buffer.limit=scsi_buffer.size=0;
+        scsi_wait_slot = slot;
+    } else {
+        scsi_read_done(target, slot);
+    }
+}
+
+/* Block until the data for the transfer is there */
+static void scsi_wait_data(void) {
+    if (scsi_buffer.pending) {
+        DiskIO_Wait(&SCSIdisk[SCSIbus.target].io[scsi_wait_slot].req);
+    }
+}
+
 Uint8 SCSIdisk_Send_Data(void) {
     /* Send one byte. If the transfer is complete, set status phase */
+    scsi_wait_data();
     Uint8 val=scsi_buffer.data[scsi_buffer.limit-scsi_buffer.size];
     scsi_buffer.size--;
     if (scsi_buffer.size==0) {
@@ -683,6 +1587,25 @@ Uint8 SCSIdisk_Send_Data(void) {
 }
 
 
+/* Send up to len bytes at once (used by DMA). Stops at the end of the
+ * current buffer. Returns the number of bytes sent. */
+Uint32 SCSIdisk_Send_Data_Block(Uint8 *dst, Uint32 len) {
+    scsi_wait_data();
+    if (len > scsi_buffer.size) {
+        len = scsi_buffer.size;
+    }
+    memcpy(dst, scsi_buffer.data+scsi_buffer.limit-scsi_buffer.size, len);
+    scsi_buffer.size-=len;
+    if (len>0 && scsi_buffer.size==0) {
+        if (scsi_buffer.disk==true) {
+            scsi_read_sector(); /* sets status phase if done or error */
+        } else {
+            SCSIbus.phase = PHASE_ST;
+        }
+    }
+    return len;
+}
+
 void SCSI_Inquiry (Uint8 *cdb) {
     Uint8 target = SCSIbus.target;
     
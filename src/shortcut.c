@@ -16,6 +16,8 @@ const char ShortCut_fileid[] = "Hatari shortcut.c : " __DATE__ " " __TIME__;
 #include "m68000.h"
 #include "memorySnapShot.h"
 #include "reset.h"
+#include "rewind.h"
+#include "bootCache.h"
 #include "screen.h"
 #include "screenSnapShot.h"
 #include "configuration.h"
@@ -232,6 +234,12 @@ void ShortCut_ActKey(void)
 	 case SHORTCUT_SAVEMEM:
 		MemorySnapShot_Capture(ConfigureParams.Memory.szMemoryCaptureFileName, true);
 		break;
+	 case SHORTCUT_REWIND:
+		Rewind_Step();                 /* Go back to last checkpoint */
+		break;
+	 case SHORTCUT_BOOTCACHE:
+		BootCache_Save();              /* Boot finished, cache the state */
+		break;
 	 case SHORTCUT_INSERTDISKA:
 //		ShortCut_InsertDisk(0);
 		break;
@@ -264,6 +272,8 @@ bool Shortcut_Invoke(const char *shortcut)
 		{ SHORTCUT_RECANIM, "recanim" },
 		{ SHORTCUT_RECSOUND, "recsound" },
 		{ SHORTCUT_SAVEMEM, "savemem" },
+		{ SHORTCUT_REWIND, "rewind" },
+		{ SHORTCUT_BOOTCACHE, "bootcache" },
 		{ SHORTCUT_QUIT, "quit" },
 		{ SHORTCUT_NONE, NULL }
 	};
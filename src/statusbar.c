@@ -39,6 +39,7 @@ const char Statusbar_fileid[] = "Hatari statusbar.c : " __DATE__ " " __TIME__;
 #include "sdlgui.h"
 #include "statusbar.h"
 #include "screen.h"
+#include "scsi.h"
 #include "video.h"
 #include "avi_record.h"
 
@@ -428,6 +429,14 @@ void Statusbar_UpdateInfo(void)
     if (ConfigureParams.System.bColor)
         end = Statusbar_AddString(end, " Color");
 
+	/* SCSI block cache hit rate */
+	Uint32 hits, misses;
+	if (SCSI_GetCacheStats(&hits, &misses) && hits+misses > 0) {
+		char cache[24];
+		sprintf(cache, " SCSI cache %i%%", (int)((Uint64)hits*100/(hits+misses)));
+		end = Statusbar_AddString(end, cache);
+	}
+
 	*end = '\0';
 
 	assert(end - DefaultMessage.msg < MAX_MESSAGE_LEN);
@@ -11,6 +11,7 @@
 #include "sysReg.h"
 #include "rtcnvram.h"
 #include "statusbar.h"
+#include "memorySnapShot.h"
 
 
 #define LOG_HARDCLOCK_LEVEL LOG_DEBUG
@@ -30,6 +31,9 @@ static Uint8 scr2_3=0x00;
 
 static Uint32 intStat=0x00000000;
 static Uint32 intMask=0x00000000;
+static int intLevel=0;
+
+static void update_interrupt_level(void);
 
 
 
@@ -88,6 +92,7 @@ void SID_Read(void) {
 #define SCR1_CONST_MASK     0xFFFFFF00
 
 void SCR_Reset(void) {
+    CycInt_RegisterHandler(INTERRUPT_HARDCLOCK, Hardclock_InterruptHandler);
     SCR_ROM_overlay = 0;
     
     scr2_0=0x00;
@@ -97,6 +102,7 @@ void SCR_Reset(void) {
     
     intStat=0x00000000;
     intMask=0x00000000;
+    update_interrupt_level();
 
     if (ConfigureParams.System.bTurbo) {
         scr1 = SCR1_TURBO;
@@ -310,6 +316,7 @@ void SCR2_Write2(void)
 	if ((old_scr2_2&SCR2_TIMERIPL7)!=(scr2_2&SCR2_TIMERIPL7)) {
 		Log_Printf(LOG_WARN,"SCR2 TIMER IPL7 change at $%08x val=%x PC=$%08x\n",
                            IoAccessCurrentAddress,scr2_2&SCR2_TIMERIPL7,m68k_getpc());
+		update_interrupt_level();
 	}
 
     /* RTC enabled */
@@ -365,20 +372,23 @@ void IntRegStatRead(void) {
 
 void IntRegStatWrite(void) {
     intStat = IoMem_ReadLong(IoAccessCurrentAddress & IO_SEG_MASK);
+    update_interrupt_level();
 }
 
 void set_interrupt(Uint32 intr, Uint8 state) {
-    /* The interrupt gets polled by the cpu via intlev()
-     * --> see previous-glue.c
-     */
     if (state==SET_INT) {
         intStat |= intr;
     } else {
         intStat &= ~intr;
     }
+    update_interrupt_level();
 }
 
-int get_interrupt_level(void) {
+/* The interrupt level is only recomputed when the status register, the
+ * mask register or the timer IPL bit changes. If the level changes we
+ * raise SPCFLAG_INT so the cpu polls it via intlev() --> see newcpu.c
+ */
+static int compute_interrupt_level(void) {
     Uint32 interrupt = intStat&intMask;
     
     if (!interrupt) {
@@ -404,6 +414,19 @@ int get_interrupt_level(void) {
     }
 }
 
+static void update_interrupt_level(void) {
+    int level = compute_interrupt_level();
+    
+    if (level!=intLevel) {
+        intLevel = level;
+        M68000_SetSpecial(SPCFLAG_INT);
+    }
+}
+
+int get_interrupt_level(void) {
+    return intLevel;
+}
+
 /* Interrupt Mask Register */
 
 void IntRegMaskRead(void) {
@@ -413,6 +436,7 @@ void IntRegMaskRead(void) {
 void IntRegMaskWrite(void) {
 	intMask = IoMem_ReadLong(IoAccessCurrentAddress & IO_SEG_MASK);
         Log_Printf(LOG_WARN,"Interrupt mask: %08x", intMask);
+    update_interrupt_level();
 }
 
 /*
@@ -485,3 +509,28 @@ void HardclockReadCSR(void) {
 }
 
 
+
+
+/* Save/Restore snapshot of system control, interrupt and hardclock registers */
+void SysReg_MemorySnapShot_Capture(bool bSave) {
+    MemorySnapShot_Store(&SCR_ROM_overlay, sizeof(SCR_ROM_overlay));
+    MemorySnapShot_Store(&scr1, sizeof(scr1));
+    MemorySnapShot_Store(&turboscr1, sizeof(turboscr1));
+    MemorySnapShot_Store(&scr2_0, sizeof(scr2_0));
+    MemorySnapShot_Store(&scr2_1, sizeof(scr2_1));
+    MemorySnapShot_Store(&scr2_2, sizeof(scr2_2));
+    MemorySnapShot_Store(&scr2_3, sizeof(scr2_3));
+    MemorySnapShot_Store(&intStat, sizeof(intStat));
+    MemorySnapShot_Store(&intMask, sizeof(intMask));
+    MemorySnapShot_Store(&intLevel, sizeof(intLevel));
+    MemorySnapShot_Store(&hardclock_csr, sizeof(hardclock_csr));
+    MemorySnapShot_Store(&hardclock1, sizeof(hardclock1));
+    MemorySnapShot_Store(&hardclock0, sizeof(hardclock0));
+    MemorySnapShot_Store(&pseudo_counter, sizeof(pseudo_counter));
+    MemorySnapShot_Store(&latch_hardclock, sizeof(latch_hardclock));
+    
+    if (!bSave) {
+        /* Let the CPU check the restored interrupt level */
+        M68000_SetSpecial(SPCFLAG_INT);
+    }
+}
@@ -24,6 +24,9 @@ const char Video_fileid[] = "Hatari video.c : " __DATE__ " " __TIME__;
 #include "avi_record.h"
 #include "dma.h"
 #include "ramdac.h"
+#include "rewind.h"
+#include "bootCache.h"
+#include "scsi.h"
 
 
 /*--------------------------------------------------------------*/
@@ -45,6 +48,10 @@ int nCyclesPerLine = 1120;
  */
 void Video_MemorySnapShot_Capture(bool bSave)
 {
+	MemorySnapShot_StoreBlock("VRAM", NEXTVideo, sizeof(NEXTVideo));
+	MemorySnapShot_StoreBlock("CRAM", NEXTColorVideo, sizeof(NEXTColorVideo));
+	if (!bSave)
+		memset(NEXTVideo_DirtyLines, 0xff, sizeof(NEXTVideo_DirtyLines));
 }
 
 
@@ -54,6 +61,7 @@ void Video_MemorySnapShot_Capture(bool bSave)
  */
 void Video_Reset(void)
 {
+	CycInt_RegisterHandler(INTERRUPT_VIDEO_VBL, Video_InterruptHandler_VBL);
 	Video_StartInterrupts(0);
 }
 
@@ -139,7 +147,15 @@ void Video_InterruptHandler_VBL ( void )
 	Video_DrawScreen();
     Main_EventHandler();
     Video_InterruptHandler();
+    /* When idle time has been skipped the emulation runs ahead of real time, */
+    /* so wait for the host to catch up. Busy frames still run at full speed. */
+    Main_WaitOnVbl(bCpuWasIdle);
+    bCpuWasIdle = false;
     CycInt_AddRelativeInterrupt(CYCLES_PER_FRAME, INT_CPU_CYCLE, INTERRUPT_VIDEO_VBL);
+    /* Checkpoints include the next VBL */
+    Rewind_VBL();
+    BootCache_VBL();
+    SCSI_VBL();
 }
 
 
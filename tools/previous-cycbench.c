@@ -0,0 +1,162 @@
+/*
+  Previous - previous-cycbench.c
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+
+  Measure the cost of the cycle interrupt scheduler (cycInt.c). Periodic
+  handlers stand in for the devices: VBL and hardclock are scheduled from
+  their last deadline, SCSI, MO and Ethernet events with varying delays
+  from the current time. Each handler acknowledges its event and
+  schedules it again. The CPU is not emulated, the loop jumps straight to
+  the next event like the idle skip does, so only the scheduler is timed.
+
+  The handlers have the names of the device handlers, so the driver can
+  also be linked with a cycInt.c that still has a fixed handler table
+  instead of CycInt_RegisterHandler. Define CYCINT_FIXED_TABLE for that.
+*/
+
+#include <time.h>
+
+#include "main.h"
+#include "cycInt.h"
+#include "cycles.h"
+#include "memorySnapShot.h"
+
+
+#define EVENTS          20000000
+
+/* Periods in CPU cycles at 25 MHz */
+#define VBL_CYCLES      (25000000/68)
+#define HARDCLOCK_CYCLES 25000
+
+
+/* Device handlers, normally declared by the device headers */
+void Video_InterruptHandler_VBL(void);
+void Hardclock_InterruptHandler(void);
+void ESP_InterruptHandler(void);
+void ESP_IO_Handler(void);
+void M2RDMA_InterruptHandler(void);
+void R2MDMA_InterruptHandler(void);
+void MO_InterruptHandler(void);
+void MO_IO_Handler(void);
+void ECC_IO_Handler(void);
+void ENET_IO_Handler(void);
+void DiskIO_InterruptHandler(void);
+
+/* Emulator state used by cycInt.c */
+int nCyclesMainCounter;
+int nCyclesBatched;
+int nCpuFreqShift;
+bool bCpuWasIdle;
+FILE *TraceFile;
+Uint64 LogTraceFlags;
+
+static Uint32 nEvents[MAX_INTERRUPTS];
+static Uint32 seed = 1;
+
+
+int Cycles_GetCounter(int nId)
+{
+	return 0;
+}
+
+void MemorySnapShot_Store(void *pData, int Size)
+{
+}
+
+
+static Uint32 random_delay(Uint32 min, Uint32 range)
+{
+	seed = seed * 1103515245 + 12345;
+	return min + (seed >> 8) % range;
+}
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Acknowledge the event and schedule it again.
+ */
+static void absolute(interrupt_id id, int cycles)
+{
+	nEvents[id]++;
+	CycInt_AcknowledgeInterrupt();
+	CycInt_AddAbsoluteInterrupt(cycles, INT_CPU_CYCLE, id);
+}
+
+static void relative(interrupt_id id, Uint32 min, Uint32 range)
+{
+	nEvents[id]++;
+	CycInt_AcknowledgeInterrupt();
+	CycInt_AddRelativeInterrupt(random_delay(min, range), INT_CPU_CYCLE, id);
+}
+
+void Video_InterruptHandler_VBL(void)  { absolute(INTERRUPT_VIDEO_VBL, VBL_CYCLES); }
+void Hardclock_InterruptHandler(void)  { absolute(INTERRUPT_HARDCLOCK, HARDCLOCK_CYCLES); }
+void ESP_InterruptHandler(void)        { relative(INTERRUPT_ESP, 2000, 20000); }
+void ESP_IO_Handler(void)              { relative(INTERRUPT_ESP_IO, 100, 2000); }
+void M2RDMA_InterruptHandler(void)     { relative(INTERRUPT_M2R, 200, 800); }
+void R2MDMA_InterruptHandler(void)     { relative(INTERRUPT_R2M, 200, 800); }
+void MO_InterruptHandler(void)         { relative(INTERRUPT_MO, 5000, 50000); }
+void MO_IO_Handler(void)               { relative(INTERRUPT_MO_IO, 500, 5000); }
+void ECC_IO_Handler(void)              { relative(INTERRUPT_ECC_IO, 500, 2000); }
+void ENET_IO_Handler(void)             { relative(INTERRUPT_ENET_IO, 1000, 10000); }
+void DiskIO_InterruptHandler(void)     { relative(INTERRUPT_DISKIO, 1000, 10000); }
+
+
+#ifndef CYCINT_FIXED_TABLE
+static void (* const handlers[MAX_INTERRUPTS])(void) =
+{
+	NULL,
+	Video_InterruptHandler_VBL,
+	Hardclock_InterruptHandler,
+	ESP_InterruptHandler,
+	ESP_IO_Handler,
+	M2RDMA_InterruptHandler,
+	R2MDMA_InterruptHandler,
+	MO_InterruptHandler,
+	MO_IO_Handler,
+	ECC_IO_Handler,
+	ENET_IO_Handler,
+	DiskIO_InterruptHandler
+};
+#endif
+
+
+int main(int argc, char *argv[])
+{
+	clock_t start;
+	double time;
+	Uint32 i;
+	int id;
+
+	CycInt_Reset();
+#ifndef CYCINT_FIXED_TABLE
+	for (id = INTERRUPT_VIDEO_VBL; id < MAX_INTERRUPTS; id++)
+		CycInt_RegisterHandler(id, handlers[id]);
+#endif
+	CycInt_AddRelativeInterrupt(VBL_CYCLES, INT_CPU_CYCLE, INTERRUPT_VIDEO_VBL);
+	CycInt_AddRelativeInterrupt(HARDCLOCK_CYCLES, INT_CPU_CYCLE, INTERRUPT_HARDCLOCK);
+	for (id = INTERRUPT_ESP; id < MAX_INTERRUPTS; id++)
+	{
+#ifdef CYCINT_FIXED_TABLE
+		/* The fixed table predates the disk I/O thread */
+		if (id == INTERRUPT_DISKIO)
+			continue;
+#endif
+		CycInt_AddRelativeInterrupt(random_delay(100, 1000), INT_CPU_CYCLE, id);
+	}
+
+	start = clock();
+	for (i = 0; i < EVENTS; i++)
+	{
+		/* Skip to the next event */
+		PendingInterruptCount = 0;
+		CALL_VAR(PendingInterruptFunction);
+	}
+	time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("%u events in %.2f s, %.1f ns per event\n", EVENTS, time, time * 1e9 / EVENTS);
+	for (id = INTERRUPT_VIDEO_VBL; id < MAX_INTERRUPTS; id++)
+		printf("  interrupt %2i: %u\n", id, nEvents[id]);
+	return 0;
+}
@@ -0,0 +1,161 @@
+/*
+  Previous - previous-mo.c
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+
+  Convert magneto-optical disk images between the encoded format, which
+  stores the sectors with ECC like they are on the disk, and the logical
+  format, which stores only the data of each sector and a bitmap of erased
+  sectors (see mo.h).
+*/
+
+#include "main.h"
+#include "mo.h"
+#include "rs.h"
+
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s <command> <input image> <output image>\n"
+		"\n"
+		"Commands:\n"
+		"  logical  convert an encoded image into a logical image\n"
+		"  encoded  convert a logical image into an encoded image\n",
+		name);
+}
+
+
+static bool is_erased(const Uint8 *sector)
+{
+	int i;
+
+	for (i = 0; i < MO_SECTORSIZE_DISK; i++)
+	{
+		if (sector[i] != 0xFF)
+			return false;
+	}
+	return true;
+}
+
+/* Encoded images shorter than a full disk are rejected */
+static bool to_logical(FILE *in, FILE *out, Uint32 *errors)
+{
+	Uint8 sector[MO_SECTORSIZE_DISK];
+	Uint8 *map = calloc(1, MO_LOGICAL_MAPSIZE);
+	Uint32 i;
+
+	if (!map)
+		return false;
+	for (i = 0; i < MO_SECTORS; i++)
+	{
+		/* A short image would turn the missing sectors into valid zero
+		 * sectors, so reject it */
+		if (fread(sector, MO_SECTORSIZE_DISK, 1, in) != 1)
+			break;
+		if (is_erased(sector))
+		{
+			map[i/8] |= 1 << (i%8);
+			memset(sector, 0, MO_SECTORSIZE_DATA);
+		}
+		else if (rs_decode(sector) < 0)
+		{
+			(*errors)++;
+		}
+		if (fwrite(sector, MO_SECTORSIZE_DATA, 1, out) != 1)
+			break;
+	}
+	if (i == MO_SECTORS && fwrite(map, MO_LOGICAL_MAPSIZE, 1, out) != 1)
+		i = 0;
+	free(map);
+	return i == MO_SECTORS;
+}
+
+static bool to_encoded(FILE *in, FILE *out)
+{
+	Uint8 sector[MO_SECTORSIZE_DISK];
+	Uint8 *map = malloc(MO_LOGICAL_MAPSIZE);
+	Uint32 i;
+
+	if (!map)
+		return false;
+	if (fseek(in, MO_LOGICAL_MAPSTART, SEEK_SET) != 0 ||
+	    fread(map, MO_LOGICAL_MAPSIZE, 1, in) != 1 ||
+	    fseek(in, 0, SEEK_SET) != 0)
+	{
+		free(map);
+		return false;
+	}
+	for (i = 0; i < MO_SECTORS; i++)
+	{
+		if (fread(sector, MO_SECTORSIZE_DATA, 1, in) != 1)
+			break;
+		if (map[i/8] & (1 << (i%8)))
+			memset(sector, 0xFF, MO_SECTORSIZE_DISK);
+		else
+			rs_encode(sector);
+		if (fwrite(sector, MO_SECTORSIZE_DISK, 1, out) != 1)
+			break;
+	}
+	free(map);
+	return i == MO_SECTORS;
+}
+
+
+int main(int argc, char *argv[])
+{
+	FILE *in, *out;
+	Uint32 errors = 0;
+	long size;
+	bool ok;
+
+	if (argc != 4 || (strcmp(argv[1], "logical") != 0 && strcmp(argv[1], "encoded") != 0))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	in = fopen(argv[2], "rb");
+	if (!in)
+	{
+		fprintf(stderr, "%s: Can not open '%s'.\n", argv[0], argv[2]);
+		return 1;
+	}
+	fseek(in, 0, SEEK_END);
+	size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	if ((size == MO_LOGICAL_SIZE) != (strcmp(argv[1], "encoded") == 0))
+	{
+		fprintf(stderr, "%s: '%s' is %s logical image.\n", argv[0], argv[2],
+		        size == MO_LOGICAL_SIZE ? "already a" : "not a");
+		fclose(in);
+		return 1;
+	}
+
+	out = fopen(argv[3], "wb");
+	if (!out)
+	{
+		fprintf(stderr, "%s: Can not create '%s'.\n", argv[0], argv[3]);
+		fclose(in);
+		return 1;
+	}
+
+	if (strcmp(argv[1], "logical") == 0)
+		ok = to_logical(in, out, &errors);
+	else
+		ok = to_encoded(in, out);
+
+	fclose(in);
+	if (fclose(out) != 0)
+		ok = false;
+
+	if (!ok)
+	{
+		fprintf(stderr, "%s: Converting '%s' to '%s' failed.\n", argv[0], argv[2], argv[3]);
+		return 1;
+	}
+	if (errors)
+		fprintf(stderr, "%s: Warning: %u sectors had uncorrectable errors.\n", argv[0], errors);
+	return 0;
+}
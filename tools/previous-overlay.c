@@ -0,0 +1,101 @@
+/*
+  Previous - previous-overlay.c
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+
+  Show, commit or discard the changes collected in a SCSI disk overlay
+  file (see diskOverlay.c).
+*/
+
+#include "main.h"
+#include "diskOverlay.h"
+
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s <command> <overlay file>\n"
+		"\n"
+		"Commands:\n"
+		"  info     show the base image and the amount of changed data\n"
+		"  commit   write the changes into the base image and empty the overlay\n"
+		"  discard  drop all changes and empty the overlay\n",
+		name);
+}
+
+
+int main(int argc, char *argv[])
+{
+	char basename[FILENAME_MAX];
+	DISKOVERLAY *ovl;
+	FILE *base = NULL;
+	const char *cmd, *name;
+	bool ok = true;
+
+	if (argc != 3)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	cmd = argv[1];
+	name = argv[2];
+
+	if (!DiskOverlay_GetBaseName(name, basename, sizeof(basename)))
+	{
+		fprintf(stderr, "%s: '%s' is not an overlay file.\n", argv[0], name);
+		return 1;
+	}
+
+	if (strcmp(cmd, "commit") == 0)
+	{
+		base = fopen(basename, "rb+");
+		if (!base)
+		{
+			fprintf(stderr, "%s: Can not open base image '%s' for writing.\n", argv[0], basename);
+			return 1;
+		}
+	}
+	else if (strcmp(cmd, "info") != 0 && strcmp(cmd, "discard") != 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* Opening with the base image also checks that its size still matches */
+	ovl = DiskOverlay_Open(name, base, basename);
+	if (!ovl)
+	{
+		fprintf(stderr, "%s: Can not use overlay '%s' with base image '%s'.\n", argv[0], name, basename);
+		if (base)
+			fclose(base);
+		return 1;
+	}
+
+	if (strcmp(cmd, "info") == 0)
+	{
+		printf("Base image: %s\n", basename);
+		printf("Changed:    %u blocks (%u kB)\n", DiskOverlay_GetUsedBlocks(ovl),
+		       DiskOverlay_GetUsedBlocks(ovl) / (1024 / OVERLAY_BLOCKSIZE));
+	}
+	else
+	{
+		if (base)
+		{
+			ok = DiskOverlay_Commit(ovl);
+			if (!ok)
+				fprintf(stderr, "%s: Writing to base image '%s' failed, overlay kept.\n", argv[0], basename);
+		}
+		if (ok)
+		{
+			ok = DiskOverlay_Discard(ovl);
+			if (!ok)
+				fprintf(stderr, "%s: Can not empty overlay '%s'.\n", argv[0], name);
+		}
+	}
+
+	DiskOverlay_Close(ovl);
+	if (base)
+		fclose(base);
+	return ok ? 0 : 1;
+}
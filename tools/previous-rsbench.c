@@ -0,0 +1,124 @@
+/*
+  Previous - previous-rsbench.c
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+
+  Measure the throughput of the Reed-Solomon encoder and decoder used for
+  magneto-optical disk sectors (rs.c). Without an image, a full disk's
+  worth of random sectors is encoded and decoded, some of them with
+  correctable errors. With an encoded image, all of its sectors are
+  decoded.
+*/
+
+#include <time.h>
+
+#include "main.h"
+#include "mo.h"
+#include "rs.h"
+
+
+#define POOL_SECTORS    256     /* different random sectors used */
+#define ERROR_INTERVAL  16      /* every n-th sector gets errors */
+#define ERROR_BYTES     4
+
+
+static double seconds(clock_t start)
+{
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void report(const char *what, Uint32 sectors, double time)
+{
+	double mb = (double)sectors * MO_SECTORSIZE_DATA / (1024 * 1024);
+
+	printf("%s: %u sectors (%.0f MB) in %.2f s, %.1f MB/s\n",
+	       what, sectors, mb, time, time > 0 ? mb / time : 0);
+}
+
+
+static bool bench_random(void)
+{
+	Uint8 *pool = malloc(POOL_SECTORS * MO_SECTORSIZE_DISK);
+	Uint8 sector[MO_SECTORSIZE_DISK];
+	Uint32 seed = 1, i, j, failed = 0;
+	clock_t start;
+
+	if (!pool)
+		return false;
+	for (i = 0; i < POOL_SECTORS * MO_SECTORSIZE_DISK; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		pool[i] = seed >> 16;
+	}
+
+	start = clock();
+	for (i = 0; i < MO_SECTORS; i++)
+		rs_encode(&pool[(i % POOL_SECTORS) * MO_SECTORSIZE_DISK]);
+	report("encode", MO_SECTORS, seconds(start));
+
+	start = clock();
+	for (i = 0; i < MO_SECTORS; i++)
+	{
+		memcpy(sector, &pool[(i % POOL_SECTORS) * MO_SECTORSIZE_DISK], MO_SECTORSIZE_DISK);
+		if (i % ERROR_INTERVAL == 0)
+		{
+			for (j = 0; j < ERROR_BYTES; j++)
+				sector[(i * 7 + j * 331) % MO_SECTORSIZE_DISK] ^= 0x5A;
+		}
+		if (rs_decode(sector) < 0)
+			failed++;
+	}
+	report("decode", MO_SECTORS, seconds(start));
+
+	free(pool);
+	if (failed)
+		printf("%u sectors could not be corrected.\n", failed);
+	return failed == 0;
+}
+
+
+static bool bench_image(FILE *in)
+{
+	Uint8 sector[MO_SECTORSIZE_DISK];
+	Uint32 sectors = 0, failed = 0;
+	clock_t start, total = 0;
+
+	while (fread(sector, MO_SECTORSIZE_DISK, 1, in) == 1)
+	{
+		start = clock();
+		if (rs_decode(sector) < 0)
+			failed++;
+		total += clock() - start;
+		sectors++;
+	}
+	report("decode", sectors, (double)total / CLOCKS_PER_SEC);
+	if (failed)
+		printf("%u sectors had uncorrectable errors (or were erased).\n", failed);
+	return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+	FILE *in;
+	bool ok;
+
+	if (argc > 2)
+	{
+		fprintf(stderr, "Usage: %s [encoded image]\n", argv[0]);
+		return 1;
+	}
+	if (argc == 1)
+		return bench_random() ? 0 : 1;
+
+	in = fopen(argv[1], "rb");
+	if (!in)
+	{
+		fprintf(stderr, "%s: Can not open '%s'.\n", argv[0], argv[1]);
+		return 1;
+	}
+	ok = bench_image(in);
+	fclose(in);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+/*
+  Previous - previous-ttbench.c
+
+  This file is distributed under the GNU Public License, version 2 or at
+  your option any later version. Read the file gpl.txt for details.
+
+  Measure the cost of the 68030 transparent translation check done on
+  every memory access (mmu030_match_ttr_access in cpummu030.c). The old
+  check compares the access with TT0 and TT1 each time, the new one looks
+  the result up in a table built when TT0 or TT1 change. Both are run on
+  the same random accesses and their results are compared.
+
+  The functions below are copies of mmu030_decode_tt, mmu030_do_match_ttr
+  and mmu030_build_tt_table, as linking the MMU code would need most of
+  the CPU core.
+*/
+
+#include <time.h>
+
+#include "main.h"
+
+
+#define TT_FC_MASK      0x00000007
+#define TT_FC_BASE      0x00000070
+#define TT_RWM          0x00000100
+#define TT_RW           0x00000200
+#define TT_ENABLE       0x00008000
+#define TT_ADDR_MASK    0x00FF0000
+#define TT_ADDR_BASE    0xFF000000
+
+#define TT_NO_MATCH     0x1
+#define TT_OK_MATCH     0x2
+#define TT_NO_READ      0x4
+#define TT_NO_WRITE     0x8
+
+#define ACCESSES        200000000
+#define POOL_SIZE       4096    /* different random accesses used */
+
+typedef struct {
+	Uint32 addr_base;
+	Uint32 addr_mask;
+	Uint32 fc_base;
+	Uint32 fc_mask;
+} TT_info;
+
+typedef struct {
+	Uint32 addr;
+	Uint32 fc;
+	bool write;
+} ACCESS;
+
+static Uint32 tt0_030, tt1_030;
+static TT_info tt0_info, tt1_info;
+static int tt_enabled;
+static Uint8 tt_table[2][8][256];
+static ACCESS pool[POOL_SIZE];
+
+
+static TT_info decode_tt(Uint32 TT)
+{
+	TT_info ret;
+
+	ret.fc_mask = ~((TT&TT_FC_MASK)|0xFFFFFFF8);
+	ret.fc_base = (TT&TT_FC_BASE)>>4;
+	ret.addr_base = TT & TT_ADDR_BASE;
+	ret.addr_mask = ~(((TT&TT_ADDR_MASK)<<8)|0x00FFFFFF);
+	return ret;
+}
+
+static int do_match_ttr(Uint32 tt, TT_info comp, Uint32 addr, Uint32 fc, bool write)
+{
+	if (tt & TT_ENABLE)
+	{
+		if ((comp.fc_base&comp.fc_mask)==(fc&comp.fc_mask))
+		{
+			if ((comp.addr_base&comp.addr_mask)==(addr&comp.addr_mask))
+			{
+				if (tt&TT_RWM)
+					return TT_OK_MATCH;
+				else if (tt&TT_RW)
+					return write ? TT_NO_WRITE : TT_OK_MATCH;
+				else
+					return write ? TT_OK_MATCH : TT_NO_READ;
+			}
+		}
+	}
+	return TT_NO_MATCH;
+}
+
+/* mmu030_match_ttr_access before the table */
+static int match_ttr_compare(Uint32 addr, Uint32 fc, bool write)
+{
+	int tt0, tt1;
+
+	if (!tt_enabled)
+		return 0;
+	tt0 = do_match_ttr(tt0_030, tt0_info, addr, fc, write);
+	tt1 = do_match_ttr(tt1_030, tt1_info, addr, fc, write);
+	return (tt0|tt1) & TT_OK_MATCH;
+}
+
+/* mmu030_match_ttr_access now */
+static int match_ttr_table(Uint32 addr, Uint32 fc, bool write)
+{
+	return tt_table[write ? 1 : 0][fc & 7][addr >> 24];
+}
+
+static void build_tt_table(void)
+{
+	int write, fc, i;
+	Uint32 addr;
+
+	tt_enabled = (tt0_030 & TT_ENABLE) || (tt1_030 & TT_ENABLE);
+
+	for (write = 0; write < 2; write++)
+	{
+		for (fc = 0; fc < 8; fc++)
+		{
+			for (i = 0; i < 256; i++)
+			{
+				addr = (Uint32)i << 24;
+				tt_table[write][fc][i] =
+				    (do_match_ttr(tt0_030, tt0_info, addr, fc, write) |
+				     do_match_ttr(tt1_030, tt1_info, addr, fc, write)) & TT_OK_MATCH;
+			}
+		}
+	}
+}
+
+
+static double bench(const char *what, int (*match)(Uint32, Uint32, bool))
+{
+	clock_t start = clock();
+	Uint32 i, hits = 0;
+	double time;
+	ACCESS *a;
+
+	for (i = 0; i < ACCESSES; i++)
+	{
+		a = &pool[i % POOL_SIZE];
+		hits += match(a->addr, a->fc, a->write) != 0;
+	}
+	time = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("%s: %u accesses, %u transparent, %.2f ns per access\n",
+	       what, ACCESSES, hits, time * 1e9 / ACCESSES);
+	return time;
+}
+
+
+int main(int argc, char *argv[])
+{
+	Uint32 seed = 1, i;
+
+	/* Default: TT0 maps 0x00-0x03xxxxxx for all accesses,
+	 * TT1 maps 0x02-0x03xxxxxx for reads */
+	tt0_030 = 0x0003C107;
+	tt1_030 = 0x02018207;
+	if (argc == 3)
+	{
+		tt0_030 = strtoul(argv[1], NULL, 16);
+		tt1_030 = strtoul(argv[2], NULL, 16);
+	}
+	else if (argc != 1)
+	{
+		fprintf(stderr, "Usage: %s [TT0 TT1 (hex)]\n", argv[0]);
+		return 1;
+	}
+	printf("TT0 = %08X, TT1 = %08X\n", tt0_030, tt1_030);
+
+	tt0_info = decode_tt(tt0_030);
+	tt1_info = decode_tt(tt1_030);
+	build_tt_table();
+
+	for (i = 0; i < POOL_SIZE; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		/* Favour the mapped range, so that all outcomes are frequent */
+		pool[i].addr = (seed & 0x80000000) ? (seed & 0x03FFFFFF) : seed * 2654435761u;
+		pool[i].fc = (seed >> 8) & 7;
+		pool[i].write = (seed >> 12) & 1;
+		if (match_ttr_compare(pool[i].addr, pool[i].fc, pool[i].write) !=
+		    match_ttr_table(pool[i].addr, pool[i].fc, pool[i].write))
+		{
+			fprintf(stderr, "Mismatch for address %08X, FC %u, %s.\n", pool[i].addr,
+			        pool[i].fc, pool[i].write ? "write" : "read");
+			return 1;
+		}
+	}
+
+	bench("compare with TT0/TT1", match_ttr_compare);
+	bench("table lookup        ", match_ttr_table);
+	return 0;
+}